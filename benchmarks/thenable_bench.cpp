@@ -0,0 +1,814 @@
+/*
+ * Latency and throughput benchmarks for thenable
+ *
+ * Each benchmark times a single operation, like resolving a promise through one `then` link, in batches large enough
+ * for the clock to be meaningful, and reports the mean, median, 99th percentile and fastest time per operation across all batches.
+ *
+ * Usage: thenable_bench [--filter=substring] [--min-time=seconds] [--out=results.json]
+ *
+ * Results are printed as a table and, with --out, written as JSON along with the revision and machine they were taken on,
+ * so runs from different commits can be compared.
+ * */
+
+#include <thenable/thenable.hpp>
+#include <thenable/pipeline.hpp>
+#include <thenable/batcher.hpp>
+#include <thenable/cache.hpp>
+#include <thenable/lazy.hpp>
+#include <thenable/shared_value.hpp>
+#include <thenable/stream.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef THENABLE_BENCH_REVISION
+#define THENABLE_BENCH_REVISION "unknown"
+#endif
+
+using namespace thenable;
+
+namespace bench {
+    typedef std::chrono::steady_clock clock_type;
+
+    struct options {
+        std::string filter;
+        double      min_time = 0.25;
+        std::string out;
+    };
+
+    struct result {
+        std::string name;
+        std::size_t items_per_op;
+        std::size_t iterations;
+        double      mean_ns;
+        double      median_ns;
+        double      p99_ns;
+        double      min_ns;
+        double      items_per_second;
+    };
+
+    /*
+     * Prevents the optimizer from discarding a computed value
+     * */
+    template <typename T>
+    inline void keep( T &&value ) {
+        asm volatile( "" : : "g"( &value ) : "memory" );
+    }
+
+    class runner {
+            options             _options;
+            std::vector<result> _results;
+
+        public:
+            inline explicit runner( options opts ) : _options( std::move( opts )) {}
+
+            /*
+             * Runs `op` repeatedly until the minimum time has passed. Each sample is a batch of operations
+             * sized to take at least 10 microseconds, so very fast operations aren't dominated by the clock itself.
+             * */
+            template <typename Functor>
+            void run( const std::string &name, std::size_t items_per_op, Functor &&op ) {
+                if( !_options.filter.empty() && name.find( _options.filter ) == std::string::npos ) {
+                    return;
+                }
+
+                const auto min_sample = std::chrono::microseconds( 10 );
+                const auto min_total  = std::chrono::duration<double>( _options.min_time );
+
+                //Warm up and calibrate the batch size
+                std::size_t batch = 1;
+
+                while( true ) {
+                    auto start = clock_type::now();
+
+                    for( std::size_t i = 0; i < batch; ++i ) {
+                        op();
+                    }
+
+                    auto elapsed = clock_type::now() - start;
+
+                    if( elapsed >= min_sample || batch >= ( 1u << 20 )) {
+                        break;
+                    }
+
+                    batch *= 2;
+                }
+
+                std::vector<double> samples;
+                std::size_t         iterations = 0;
+                clock_type::duration total{0};
+
+                while( total < min_total || samples.size() < 10 ) {
+                    auto start = clock_type::now();
+
+                    for( std::size_t i = 0; i < batch; ++i ) {
+                        op();
+                    }
+
+                    auto elapsed = clock_type::now() - start;
+
+                    total += elapsed;
+                    iterations += batch;
+
+                    samples.push_back( std::chrono::duration<double, std::nano>( elapsed ).count() / batch );
+                }
+
+                std::sort( samples.begin(), samples.end());
+
+                result r;
+
+                r.name         = name;
+                r.items_per_op = items_per_op;
+                r.iterations   = iterations;
+                r.mean_ns      = std::chrono::duration<double, std::nano>( total ).count() / iterations;
+                r.median_ns    = samples[samples.size() / 2];
+                r.p99_ns       = samples[std::min( samples.size() - 1, ( samples.size() * 99 ) / 100 )];
+                r.min_ns       = samples.front();
+
+                r.items_per_second = r.mean_ns > 0 ? ( items_per_op * 1e9 ) / r.mean_ns : 0;
+
+                std::printf( "%-48s %12.1f %12.1f %12.1f %12.1f %14.0f %10zu\n", r.name.c_str(), r.mean_ns, r.median_ns, r.p99_ns, r.min_ns,
+                             r.items_per_second, r.iterations );
+
+                std::fflush( stdout );
+
+                _results.push_back( std::move( r ));
+            }
+
+            inline void print_header() const {
+                std::printf( "%-48s %12s %12s %12s %12s %14s %10s\n", "benchmark", "mean ns", "median ns", "p99 ns", "min ns", "items/s", "iterations" );
+            }
+
+            bool write_json( const std::string &path ) const {
+                std::FILE *out = std::fopen( path.c_str(), "w" );
+
+                if( !out ) {
+                    return false;
+                }
+
+                char        date[32];
+                std::time_t now = std::time( nullptr );
+
+                std::strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%SZ", std::gmtime( &now ));
+
+#if defined(__clang__)
+                const char *compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+                const char *compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+                const char *compiler = "msvc";
+#else
+                const char *compiler = "unknown";
+#endif
+
+                std::fprintf( out, "{\n" );
+                std::fprintf( out, "  \"context\": {\n" );
+                std::fprintf( out, "    \"revision\": \"%s\",\n", THENABLE_BENCH_REVISION );
+                std::fprintf( out, "    \"date\": \"%s\",\n", date );
+                std::fprintf( out, "    \"compiler\": \"%s\",\n", compiler );
+                std::fprintf( out, "    \"hardware_concurrency\": %u,\n", std::thread::hardware_concurrency());
+                std::fprintf( out, "    \"min_time\": %g\n", _options.min_time );
+                std::fprintf( out, "  },\n" );
+                std::fprintf( out, "  \"benchmarks\": [\n" );
+
+                for( std::size_t i = 0; i < _results.size(); ++i ) {
+                    const result &r = _results[i];
+
+                    std::fprintf( out, "    {\"name\": \"%s\", \"items_per_op\": %zu, \"iterations\": %zu, \"mean_ns\": %.2f, \"median_ns\": %.2f, "
+                                       "\"p99_ns\": %.2f, \"min_ns\": %.2f, \"items_per_second\": %.2f}%s\n",
+                                  r.name.c_str(), r.items_per_op, r.iterations, r.mean_ns, r.median_ns, r.p99_ns, r.min_ns, r.items_per_second,
+                                  i + 1 < _results.size() ? "," : "" );
+                }
+
+                std::fprintf( out, "  ]\n}\n" );
+
+                return std::fclose( out ) == 0;
+            }
+    };
+
+    //////////
+
+    inline auto increment() {
+        return []( int i ) {
+            return i + 1;
+        };
+    }
+
+    /*
+     * A small amount of real work for the parallel benchmarks, so they measure scheduling rather than just queue traffic
+     * */
+    inline int spin_work( int seed ) {
+        unsigned x = static_cast<unsigned>(seed) + 1;
+
+        for( int i = 0; i < 2000; ++i ) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+
+        return static_cast<int>(x);
+    }
+
+    template <typename LaunchPolicy>
+    void then_latency( runner &r, const std::string &name, LaunchPolicy policy ) {
+        r.run( "then/latency/" + name, 1, [policy] {
+            ThenablePromise<int> p;
+
+            auto f = p.get_future().then( increment(), policy );
+
+            p.set_value( 1 );
+
+            keep( f.get());
+        } );
+    }
+
+    template <typename LaunchPolicy>
+    void then_chain( runner &r, const std::string &name, LaunchPolicy policy, std::size_t depth ) {
+        r.run( "then/chain/" + name + "/" + std::to_string( depth ), depth, [policy, depth] {
+            ThenablePromise<int> p;
+
+            ThenableFuture<int> f = p.get_future();
+
+            for( std::size_t i = 0; i < depth; ++i ) {
+                f = f.then( increment(), policy );
+            }
+
+            p.set_value( 0 );
+
+            keep( f.get());
+        } );
+    }
+
+    template <typename Lazy>
+    inline Lazy fuse_increments( Lazy &&l, std::index_sequence<> ) {
+        return std::move( l );
+    }
+
+    template <typename Lazy, std::size_t I, std::size_t... Rest>
+    inline auto fuse_increments( Lazy &&l, std::index_sequence<I, Rest...> ) {
+        return fuse_increments( std::move( l ).then( increment()), std::index_sequence<Rest...>());
+    }
+
+    /*
+     * The same chain as then_chain, but fused into a single continuation with lazy()
+     * */
+    template <typename LaunchPolicy, std::size_t Depth>
+    void fused_chain( runner &r, const std::string &name, LaunchPolicy policy, std::integral_constant<std::size_t, Depth> ) {
+        r.run( "then/fused/" + name + "/" + std::to_string( Depth ), Depth, [policy] {
+            ThenablePromise<int> p;
+
+            ThenableFuture<int> f = fuse_increments( lazy( p.get_future(), policy ), std::make_index_sequence<Depth>());
+
+            p.set_value( 0 );
+
+            keep( f.get());
+        } );
+    }
+
+    //////////
+
+    template <std::size_t... I>
+    void parallel_throughput( runner &r, std::size_t concurrency, std::index_sequence<I...> ) {
+        r.run( "parallel_n/64/concurrency/" + std::to_string( concurrency ), sizeof...( I ), [concurrency] {
+            auto futures = parallel2_n( concurrency, [] {
+                return spin_work( I );
+            }... );
+
+            std::apply( []( auto &... f ) {
+                int sum = 0;
+
+                (void)std::initializer_list<int>{( sum += f.get(), 0 )...};
+
+                keep( sum );
+            }, futures );
+        } );
+    }
+
+    template <typename LaunchPolicy, std::size_t... I>
+    inline auto await_pending( std::vector<ThenablePromise<int>> &promises, LaunchPolicy policy, std::index_sequence<I...> ) {
+        return await_all( std::make_tuple( promises[I].get_future()... ), policy );
+    }
+
+    template <std::size_t I>
+    using promise_of_int = ThenablePromise<int>;
+
+    template <std::size_t... I>
+    inline auto make_promise_tuple( std::index_sequence<I...> ) {
+        return std::tuple<promise_of_int<I>...>();
+    }
+
+    template <std::size_t N>
+    inline auto make_promise_tuple() {
+        return make_promise_tuple( std::make_index_sequence<N>());
+    }
+
+    template <std::size_t... I>
+    inline auto await_ready( std::index_sequence<I...> ) {
+        return await_all( std::make_tuple( make_ready_future( static_cast<int>(I))... ));
+    }
+
+    template <std::size_t N>
+    void await_all_fan_in( runner &r ) {
+        r.run( "await_all/pending/" + std::to_string( N ), N, [] {
+            std::vector<ThenablePromise<int>> promises( N );
+
+            auto all = await_pending( promises, default_policy, std::make_index_sequence<N>());
+
+            for( ThenablePromise<int> &p : promises ) {
+                p.set_value( 1 );
+            }
+
+            keep( all.get());
+        } );
+
+        //Nothing is launched for thenable futures, so this should cost the same as the default policy
+        r.run( "await_all/pending/detached/" + std::to_string( N ), N, [] {
+            std::vector<ThenablePromise<int>> promises( N );
+
+            auto all = await_pending( promises, then_launch::detached, std::make_index_sequence<N>());
+
+            for( ThenablePromise<int> &p : promises ) {
+                p.set_value( 1 );
+            }
+
+            keep( all.get());
+        } );
+
+        r.run( "await_all/promises/" + std::to_string( N ), N, [] {
+            auto promises = make_promise_tuple<N>();
+
+            auto all = await_all( std::move( promises ));
+
+            std::apply( []( auto &... p ) {
+                (void)std::initializer_list<int>{( p.set_value( 1 ), 0 )...};
+            }, promises );
+
+            keep( all.get());
+        } );
+
+        r.run( "await_all/ready/" + std::to_string( N ), N, [] {
+            keep( await_ready( std::make_index_sequence<N>()).get());
+        } );
+
+        r.run( "when_all/pending/" + std::to_string( N ), N, [] {
+            std::vector<ThenablePromise<int>> promises( N );
+            std::vector<ThenableFuture<int>>  futures;
+
+            futures.reserve( N );
+
+            for( ThenablePromise<int> &p : promises ) {
+                futures.push_back( p.get_future());
+            }
+
+            auto all = when_all( std::move( futures ));
+
+            for( ThenablePromise<int> &p : promises ) {
+                p.set_value( 1 );
+            }
+
+            keep( all.get());
+        } );
+    }
+
+    template <typename LaunchPolicy, std::size_t... I>
+    void waterfall_depth( runner &r, const std::string &name, LaunchPolicy policy, std::index_sequence<I...> ) {
+        constexpr std::size_t depth = sizeof...( I ) + 1;
+
+        r.run( "waterfall/" + name + "/" + std::to_string( depth ), depth, [policy] {
+            auto f = waterfall( policy, [] {
+                return 0;
+            }, ((void)I, increment())... );
+
+            keep( f.get());
+        } );
+    }
+
+    /*
+     * Pushes a batch of items through three stages of spin_work, from a separate producer thread
+     * */
+    void pipeline_throughput( runner &r, std::size_t parallelism, bool in_order ) {
+        constexpr std::size_t items = 1000;
+
+        r.run( std::string( "pipeline/" ) + ( in_order ? "ordered" : "unordered" ) + "/parallelism/" + std::to_string( parallelism ), items, [parallelism, in_order] {
+            auto builder = make_pipeline<int>( 256 )
+                .then( spin_work, parallelism )
+                .then( spin_work, parallelism )
+                .then( spin_work, parallelism );
+
+            auto p = in_order ? std::move( builder ).ordered().build() : std::move( builder ).build();
+
+            std::thread producer( [p]() mutable {
+                for( std::size_t i = 0; i < items; ++i ) {
+                    p.push( static_cast<int>(i));
+                }
+
+                p.close();
+            } );
+
+            int sum = 0;
+
+            while( auto result = p.pop()) {
+                sum += result->get();
+            }
+
+            producer.join();
+
+            keep( sum );
+        } );
+    }
+
+    /*
+     * Delivers a sequence of chunks to a consumer on default_executor(), either through a stream,
+     * or with a new promise and continuation for every chunk
+     * */
+    void stream_delivery( runner &r ) {
+        constexpr std::size_t chunks = 1024;
+
+        r.run( "stream/for_each", chunks, [] {
+            ThenableStreamWriter<int> w( 64 );
+
+            int sum = 0;
+
+            auto done = w.get_stream().for_each( [&sum]( int i ) {
+                sum += i;
+            } );
+
+            for( std::size_t i = 0; i < chunks; ++i ) {
+                w.push( static_cast<int>(i)).get();
+            }
+
+            w.close();
+
+            done.get();
+
+            keep( sum );
+        } );
+
+        r.run( "stream/map_filter_reduce", chunks, [] {
+            ThenableStreamWriter<int> w( 64 );
+
+            auto total = w.get_stream()
+                .map( []( int i ) {
+                    return i * 2;
+                } )
+                .filter( []( const int &i ) {
+                    return i % 3 != 0;
+                } )
+                .reduce( 0, []( int sum, int i ) {
+                    return sum + i;
+                } );
+
+            for( std::size_t i = 0; i < chunks; ++i ) {
+                w.push( static_cast<int>(i)).get();
+            }
+
+            w.close();
+
+            keep( total.get());
+        } );
+
+        r.run( "stream/promise_per_chunk", chunks, [] {
+            int sum = 0;
+
+            for( std::size_t i = 0; i < chunks; ++i ) {
+                ThenablePromise<int> p;
+
+                ThenableFuture<void> next = p.get_future().then( [&sum]( int i ) {
+                    sum += i;
+                }, default_executor());
+
+                p.set_value( static_cast<int>(i));
+
+                //Keep the chunks in order, like the stream does
+                next.wait();
+            }
+
+            keep( sum );
+        } );
+    }
+
+    /*
+     * Fetches keys from a backend that costs one spin_work per call no matter how many keys it's given,
+     * either one make_promise per key or through a batcher with the given batch size
+     * */
+    void batched_fetch( runner &r, std::size_t max_size ) {
+        constexpr std::size_t keys = 256;
+
+        r.run( "batcher/size/" + std::to_string( max_size ), keys, [max_size] {
+            batcher<int, int> b( []( std::vector<int> k ) {
+                int base = spin_work( static_cast<int>(k.size()));
+
+                for( int &v : k ) {
+                    v += base;
+                }
+
+                return k;
+            }, max_size, std::chrono::milliseconds( 1 ), default_executor());
+
+            std::vector<ThenableFuture<int>> futures;
+
+            futures.reserve( keys );
+
+            for( std::size_t i = 0; i < keys; ++i ) {
+                futures.push_back( b.get( static_cast<int>(i)));
+            }
+
+            int sum = 0;
+
+            for( auto &f : futures ) {
+                sum += f.get();
+            }
+
+            keep( sum );
+        } );
+    }
+
+    template <typename LaunchPolicy>
+    void make_promise_round_trip( runner &r, const std::string &name, LaunchPolicy policy ) {
+        r.run( "make_promise/" + name, 1, [policy] {
+            auto f = make_promise2<int>( []( auto resolve, auto ) {
+                resolve( 1 );
+            }, policy );
+
+            keep( f.get());
+        } );
+    }
+
+    /*
+     * Passes a large buffer through make_promise and back out again. It's only ever moved,
+     * so this should cost the same as make_promise/default. A single copy along the way would allocate and copy the whole buffer.
+     * */
+    void make_promise_payload( runner &r ) {
+        r.run( "make_promise/payload/4mb", 1, [] {
+            static std::vector<char> payload( 4 << 20 );
+
+            auto f = make_promise2<std::vector<char>>( []( auto resolve, auto ) {
+                resolve( std::move( payload ));
+            }, default_policy );
+
+            payload = f.get();
+
+            keep( payload.size());
+        } );
+    }
+
+    /*
+     * Hands a 4 MB value to every continuation on one shared future, either by value, which copies it for each of them,
+     * or as a shared_value, which never copies it at all
+     * */
+    void shared_fan_out( runner &r, std::size_t subscribers ) {
+        typedef std::vector<char> payload_type;
+
+        r.run( "shared_future/fan_out/by_value/" + std::to_string( subscribers ), subscribers, [subscribers] {
+            ThenablePromise<payload_type>            p;
+            ThenableSharedFuture<payload_type>       s = p.get_future().share();
+            std::vector<ThenableFuture<std::size_t>> results;
+
+            results.reserve( subscribers );
+
+            for( std::size_t i = 0; i < subscribers; ++i ) {
+                results.push_back( s.then( []( payload_type v ) {
+                    return v.size();
+                } ));
+            }
+
+            p.set_value( payload_type( 4 << 20 ));
+
+            for( auto &f : results ) {
+                keep( f.get());
+            }
+        } );
+
+        r.run( "shared_future/fan_out/shared_value/" + std::to_string( subscribers ), subscribers, [subscribers] {
+            ThenablePromise<payload_type>            p;
+            ThenableSharedFuture<payload_type>       s = p.get_future().share();
+            std::vector<ThenableFuture<std::size_t>> results;
+
+            results.reserve( subscribers );
+
+            for( std::size_t i = 0; i < subscribers; ++i ) {
+                results.push_back( then_shared( s, []( shared_value<payload_type> v ) {
+                    return v->size();
+                } ));
+            }
+
+            p.set_value( payload_type( 4 << 20 ));
+
+            for( auto &f : results ) {
+                keep( f.get());
+            }
+        } );
+    }
+}
+
+int main( int argc, char **argv ) {
+    using namespace bench;
+
+    options opts;
+
+    for( int i = 1; i < argc; ++i ) {
+        const char *arg = argv[i];
+
+        if( std::strncmp( arg, "--filter=", 9 ) == 0 ) {
+            opts.filter = arg + 9;
+
+        } else if( std::strncmp( arg, "--min-time=", 11 ) == 0 ) {
+            opts.min_time = std::atof( arg + 11 );
+
+        } else if( std::strncmp( arg, "--out=", 6 ) == 0 ) {
+            opts.out = arg + 6;
+
+        } else {
+            std::fprintf( stderr, "usage: %s [--filter=substring] [--min-time=seconds] [--out=results.json]\n", argv[0] );
+
+            return 2;
+        }
+    }
+
+    runner r( opts );
+
+#ifdef THENABLE_INSTRUMENTATION
+    //Everything below is measured with the histogram collector recording every task
+    instrumentation::histogram_collector collector;
+
+    collector.install();
+#endif
+
+    r.print_header();
+
+    //Single link latency, from setting the value to getting the result of the continuation
+    then_latency( r, "default", default_policy );
+    then_latency( r, "async", std::launch::async );
+    then_latency( r, "deferred", std::launch::deferred );
+    then_latency( r, "detached", then_launch::detached );
+    then_latency( r, "inline_if_ready", then_launch::inline_if_ready );
+
+    r.run( "then/latency/ready", 1, [] {
+        keep( make_ready_future( 1 ).then( increment()).get());
+    } );
+
+    r.run( "then/latency/std_future", 1, [] {
+        std::promise<int> p;
+
+        auto f = then( p.get_future(), increment(), then_launch::detached );
+
+        p.set_value( 1 );
+
+        keep( f.get());
+    } );
+
+    //Chain depth scaling
+    for( std::size_t depth : {1, 10, 100, 1000} ) {
+        then_chain( r, "default", default_policy, depth );
+        then_chain( r, "deferred", std::launch::deferred, depth );
+        then_chain( r, "async", std::launch::async, depth );
+        then_chain( r, "detached", then_launch::detached, depth );
+    }
+
+    fused_chain( r, "default", default_policy, std::integral_constant<std::size_t, 10>());
+    fused_chain( r, "detached", then_launch::detached, std::integral_constant<std::size_t, 10>());
+    fused_chain( r, "default", default_policy, std::integral_constant<std::size_t, 100>());
+    fused_chain( r, "detached", then_launch::detached, std::integral_constant<std::size_t, 100>());
+
+    //parallel_n throughput against the number of functors allowed to run at once
+    for( std::size_t concurrency : {1, 2, 4, 8, 16, 32, 64} ) {
+        parallel_throughput( r, concurrency, std::make_index_sequence<64>());
+    }
+
+    //await_all fan-in
+    await_all_fan_in<2>( r );
+    await_all_fan_in<8>( r );
+    await_all_fan_in<32>( r );
+
+    //waterfall depth
+    waterfall_depth( r, "deferred", std::launch::deferred, std::make_index_sequence<0>());
+    waterfall_depth( r, "deferred", std::launch::deferred, std::make_index_sequence<7>());
+    waterfall_depth( r, "deferred", std::launch::deferred, std::make_index_sequence<31>());
+    waterfall_depth( r, "detached", then_launch::detached, std::make_index_sequence<0>());
+    waterfall_depth( r, "detached", then_launch::detached, std::make_index_sequence<7>());
+    waterfall_depth( r, "detached", then_launch::detached, std::make_index_sequence<31>());
+
+    //Arming a deadline and cancelling it when the value arrives in time
+    r.run( "with_timeout/resolved", 1, [] {
+        ThenablePromise<int> p;
+
+        auto f = with_timeout( p.get_future(), std::chrono::seconds( 10 ));
+
+        p.set_value( 1 );
+
+        keep( f.get());
+    } );
+
+    then_latency( r, "deadline", with_timeout( std::chrono::hours( 1 )));
+
+    //pipeline throughput against per-stage parallelism
+    for( std::size_t parallelism : {1, 2, 4, 8} ) {
+        pipeline_throughput( r, parallelism, false );
+        pipeline_throughput( r, parallelism, true );
+    }
+
+    //streams against a promise per chunk
+    stream_delivery( r );
+
+    //batcher against one backend call per key
+    r.run( "batcher/unbatched", 256, [] {
+        std::vector<ThenableFuture<int>> futures;
+
+        futures.reserve( 256 );
+
+        for( int i = 0; i < 256; ++i ) {
+            futures.push_back( make_promise2<int>( [i]( auto resolve, auto ) {
+                resolve( spin_work( 1 ) + i );
+            }, default_executor()));
+        }
+
+        int sum = 0;
+
+        for( auto &f : futures ) {
+            sum += f.get();
+        }
+
+        keep( sum );
+    } );
+
+    for( std::size_t max_size : {1, 16, 64, 256} ) {
+        batched_fetch( r, max_size );
+    }
+
+    //async_cache lookups that hit a finished entry, and ones that always miss and run the loader inline
+    {
+        async_cache<int, int> cache( []( int k ) {
+            return k;
+        }, 1024 );
+
+        int key = 0;
+
+        r.run( "async_cache/hit", 1, [&cache, &key] {
+            keep( cache.get( key++ & 255 ).get());
+        } );
+
+        r.run( "async_cache/miss", 1, [&cache, &key] {
+            keep( cache.get( 1024 + key++ ).get());
+        } );
+    }
+
+    //make_promise round trips
+    make_promise_round_trip( r, "default", default_policy );
+    make_promise_round_trip( r, "async", std::launch::async );
+    make_promise_round_trip( r, "detached", then_launch::detached );
+    make_promise_payload( r );
+
+    //shared future fan-out
+    shared_fan_out( r, 200 );
+
+    r.run( "make_promise/pool_allocator", 1, [] {
+        auto f = make_promise2<int>( std::allocator_arg, pool_allocator<int>(), []( auto resolve, auto ) {
+            resolve( 1 );
+        } );
+
+        keep( f.get());
+    } );
+
+    r.run( "make_promise/pmr", 1, [] {
+        static std::pmr::unsynchronized_pool_resource resource;
+
+        auto f = make_promise2<int>( &resource, []( auto resolve, auto ) {
+            resolve( 1 );
+        } );
+
+        keep( f.get());
+    } );
+
+#ifdef THENABLE_INSTRUMENTATION
+    instrumentation::install( nullptr );
+
+    std::printf( "\ninstrumented tasks: queue delay p50 %lld ns p99 %lld ns, run time p50 %lld ns p99 %lld ns, %llu threads spawned\n",
+                 static_cast<long long>(collector.queue_delay().percentile( 0.5 ).count()),
+                 static_cast<long long>(collector.queue_delay().percentile( 0.99 ).count()),
+                 static_cast<long long>(collector.run_time().percentile( 0.5 ).count()),
+                 static_cast<long long>(collector.run_time().percentile( 0.99 ).count()),
+                 static_cast<unsigned long long>(instrumentation::threads_spawned()));
+#endif
+
+    if( !opts.out.empty()) {
+        if( !r.write_json( opts.out )) {
+            std::fprintf( stderr, "failed to write %s\n", opts.out.c_str());
+
+            return 1;
+        }
+
+        std::printf( "\nresults written to %s\n", opts.out.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef THENABLE_BATCHER_HPP_INCLUDED
+#define THENABLE_BATCHER_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Batching
+ *
+ * A batcher collects individual requests for keys and hands them to a batch function all at once, for backends where
+ * fetching many keys in one call is much cheaper than fetching them one at a time.
+ *
+ * get(key) returns a ThenableFuture right away. Keys are collected until there are max_size of them, or max_delay has passed since
+ * the first one, and then the batch function is launched with all of them according to the launch policy, by default on default_executor().
+ * The batch function takes a std::vector<Key> and returns a std::vector<Value> with one value per key in the same order,
+ * or a future for one, and each future returned by get() resolves with its own value. If the batch function throws,
+ * every future in that batch gets the exception.
+ *
+ * Asking for the same key more than once within a batch only passes it to the batch function once, and every request gets a copy of its value.
+ * Move-only values can't be shared like that, so for those each request passes its key to the batch function on its own.
+ * The batch function may be running for several batches at once.
+ * */
+
+namespace thenable {
+    namespace detail {
+        /*
+         * Every duplicate gets a copy, and the last one gets the original
+         * */
+        template <typename Value>
+        inline void resolve_batch_waiters( std::vector<state_ptr<shared_state<Value>>> &w, Value &value, std::true_type ) {
+            for( std::size_t j = 0; j + 1 < w.size(); ++j ) {
+                w[j]->set_value( value );
+            }
+
+            w.back()->set_value( std::move( value ));
+        }
+
+        /*
+         * Move-only values are never shared between requests, so there's only ever the one
+         * */
+        template <typename Value>
+        inline void resolve_batch_waiters( std::vector<state_ptr<shared_state<Value>>> &w, Value &value, std::false_type ) {
+            w.back()->set_value( std::move( value ));
+        }
+
+        template <typename Value>
+        inline void distribute_batch( shared_state<std::vector<Value>> &src, std::vector<std::vector<state_ptr<shared_state<Value>>>> &waiters ) THENABLE_NOEXCEPT {
+            std::vector<Value> results;
+
+            try {
+                results = src.take();
+
+                if( results.size() != waiters.size()) {
+                    throw std::length_error( "batch function returned a different number of values than it was given keys" );
+                }
+
+            } catch( ... ) {
+                std::exception_ptr e = std::current_exception();
+
+                for( auto &w : waiters ) {
+                    for( auto &dest : w ) {
+                        dest->set_exception( e );
+                    }
+                }
+
+                return;
+            }
+
+            for( std::size_t i = 0; i < waiters.size(); ++i ) {
+                resolve_batch_waiters( waiters[i], results[i], std::is_copy_constructible<Value>());
+            }
+        }
+
+        template <typename Key, typename Value, typename Hash, typename KeyEqual>
+        class batcher_state : public std::enable_shared_from_this<batcher_state<Key, Value, Hash, KeyEqual>> {
+            public:
+                typedef state_ptr<shared_state<Value>> waiter_type;
+                typedef std::vector<std::vector<waiter_type>> waiter_list;
+
+                typedef unique_function<void( std::vector<Key> &&, waiter_list && )> dispatch_type;
+
+            private:
+                struct batch {
+                    std::vector<Key>                                  keys;
+                    waiter_list                                       waiters;
+                    std::unordered_map<Key, std::size_t, Hash, KeyEqual> index;
+                };
+
+                dispatch_type                        _dispatch;
+                std::size_t                          _max_size;
+                std::chrono::steady_clock::duration _max_delay;
+                timer_wheel                          _timer;
+
+                std::mutex    _mutex;
+                batch         _pending;
+                std::uint64_t _generation = 0;
+                timer_handle  _deadline;
+
+                /*
+                 * Takes the pending batch while holding the lock, so it can be dispatched after letting go of it
+                 * */
+                inline batch take_pending() {
+                    batch b;
+
+                    std::swap( b, _pending );
+
+                    ++_generation;
+
+                    _deadline.cancel();
+
+                    return b;
+                }
+
+                inline void dispatch( batch &&b ) {
+                    if( !b.keys.empty()) {
+                        _dispatch( std::move( b.keys ), std::move( b.waiters ));
+                    }
+                }
+
+                inline void expire( std::uint64_t generation ) {
+                    batch b;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        //The batch this timer was for was already dispatched when it filled up
+                        if( generation != _generation ) {
+                            return;
+                        }
+
+                        b = take_pending();
+                    }
+
+                    dispatch( std::move( b ));
+                }
+
+            public:
+                inline batcher_state( dispatch_type &&d, std::size_t max_size, std::chrono::steady_clock::duration max_delay, timer_wheel timer )
+                    : _dispatch( std::move( d )), _max_size( std::max<std::size_t>( max_size, 1 )), _max_delay( max_delay ), _timer( std::move( timer )) {}
+
+                /*
+                 * Whatever is still pending is dispatched rather than left hanging
+                 * */
+                inline ~batcher_state() {
+                    dispatch( take_pending());
+                }
+
+                inline ThenableFuture<Value> get( Key &&key ) {
+                    waiter_type dest = make_state<Value>();
+
+                    ThenableFuture<Value> result = state_access::make<ThenableFuture<Value>>( waiter_type( dest ));
+
+                    batch full;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( std::is_copy_constructible<Value>::value ) {
+                            auto it = _pending.index.find( key );
+
+                            if( it != _pending.index.end()) {
+                                _pending.waiters[it->second].push_back( std::move( dest ));
+
+                                return result;
+                            }
+
+                            _pending.index.emplace( key, _pending.keys.size());
+                        }
+
+                        _pending.keys.push_back( std::move( key ));
+                        _pending.waiters.emplace_back();
+                        _pending.waiters.back().push_back( std::move( dest ));
+
+                        if( _pending.keys.size() >= _max_size ) {
+                            full = take_pending();
+
+                        } else if( _pending.keys.size() == 1 ) {
+                            std::weak_ptr<batcher_state> self = this->shared_from_this();
+
+                            _deadline = _timer.schedule_after( _max_delay, [self, generation = _generation] {
+                                if( auto s = self.lock()) {
+                                    s->expire( generation );
+                                }
+                            } );
+                        }
+                    }
+
+                    dispatch( std::move( full ));
+
+                    return result;
+                }
+
+                inline void flush() {
+                    batch b;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        b = take_pending();
+                    }
+
+                    dispatch( std::move( b ));
+                }
+        };
+    }
+
+    /*
+     * batcher objects are handles, so copies share the same pending batch.
+     * When the last one is destroyed, anything still pending is dispatched right away.
+     * */
+    template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+    class batcher {
+            typedef detail::batcher_state<Key, Value, Hash, KeyEqual> state_type;
+
+            std::shared_ptr<state_type> _state;
+
+        public:
+            template <typename Functor, typename Rep, typename Period, typename LaunchPolicy = work_stealing_pool>
+            batcher( Functor &&f, std::size_t max_size, const std::chrono::duration<Rep, Period> &max_delay,
+                     LaunchPolicy policy = default_executor(), const timer_wheel &timer = default_timer()) {
+                typedef typename state_type::waiter_list waiter_list;
+                typedef std::vector<Value>               result_type;
+
+                auto fn = std::make_shared<typename std::decay<Functor>::type>( std::forward<Functor>( f ));
+
+                typename state_type::dispatch_type dispatch = [fn, policy = detail::undeferred( policy )]( std::vector<Key> &&keys, waiter_list &&waiters ) mutable {
+                    auto dest = detail::make_state<result_type>();
+
+                    detail::launch_into( dest, [fn, keys2 = std::move( keys )]( const detail::state_ptr<detail::shared_state<result_type>> &d ) mutable {
+                        try {
+                            detail::invoke_into( d, *fn, std::move( keys2 ));
+
+                        } catch( ... ) {
+                            d->set_exception( std::current_exception());
+                        }
+                    }, policy );
+
+                    detail::shared_state<result_type> &state = *dest;
+
+                    state.add_continuation( [dest, waiters2 = std::move( waiters )]() mutable THENABLE_NOEXCEPT {
+                        detail::distribute_batch( *dest, waiters2 );
+                    } );
+                };
+
+                _state = std::make_shared<state_type>( std::move( dispatch ), max_size,
+                                                       std::chrono::ceil<std::chrono::steady_clock::duration>( max_delay ), timer );
+            }
+
+            inline ThenableFuture<Value> get( Key key ) const {
+                return _state->get( std::move( key ));
+            }
+
+            /*
+             * Dispatches the pending batch right away, without waiting for it to fill up or for its delay to pass
+             * */
+            inline void flush() const {
+                _state->flush();
+            }
+    };
+}
+
+#endif //THENABLE_BATCHER_HPP_INCLUDED
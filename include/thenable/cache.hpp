@@ -0,0 +1,282 @@
+#ifndef THENABLE_CACHE_HPP_INCLUDED
+#define THENABLE_CACHE_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+/*
+ * Caching
+ *
+ * An async_cache memoizes an asynchronous loader function by key. Every caller asking for the same key gets the same
+ * ThenableSharedFuture, whether the load is still in flight or already finished, so the loader only runs once per key
+ * no matter how many callers ask for it at the same time.
+ *
+ * Finished entries are kept until they are older than the TTL, or until they're the least recently used entry once the cache is full.
+ * Loads that fail are dropped as soon as they fail, so the next caller tries again,
+ * though everybody who asked for it while it was in flight gets the exception.
+ *
+ * Keys are spread over a number of independently locked shards, so lookups for different keys rarely contend on the same mutex.
+ * Capacity is divided evenly between the shards, and least recently used is tracked per shard.
+ * */
+
+namespace thenable {
+    namespace detail {
+        template <typename Key, typename Value, typename Hash, typename KeyEqual>
+        class async_cache_state : public std::enable_shared_from_this<async_cache_state<Key, Value, Hash, KeyEqual>> {
+            public:
+                typedef std::chrono::steady_clock      clock_type;
+                typedef state_ptr<shared_state<Value>> value_state;
+
+                typedef unique_function<void( const Key &, const value_state & )> load_type;
+
+            private:
+                struct entry {
+                    value_state                      state;
+                    //time_point::max() while the load is in flight
+                    clock_type::time_point           expires;
+                    typename std::list<Key>::iterator lru;
+                };
+
+                struct alignas( 64 ) shard {
+                    std::mutex                                      mutex;
+                    std::unordered_map<Key, entry, Hash, KeyEqual> entries;
+                    //Most recently used at the front
+                    std::list<Key>                                  lru;
+                };
+
+                load_type                _load;
+                std::size_t              _shard_capacity;
+                clock_type::duration     _ttl;
+                Hash                     _hash;
+                std::unique_ptr<shard[]> _shards;
+                std::size_t              _mask;
+
+                /*
+                 * std::hash is often just the identity, so the bits are mixed before picking a shard
+                 * */
+                inline shard &shard_for( const Key &key ) const {
+                    std::uint64_t h = static_cast<std::uint64_t>(_hash( key )) * 0x9E3779B97F4A7C15ull;
+
+                    return _shards[static_cast<std::size_t>( h >> 40 ) & _mask];
+                }
+
+                inline clock_type::time_point expiry( clock_type::time_point now ) const {
+                    return _ttl >= clock_type::time_point::max() - now ? clock_type::time_point::max() : now + _ttl;
+                }
+
+                inline void erase_entry( shard &s, typename std::unordered_map<Key, entry, Hash, KeyEqual>::iterator it ) {
+                    s.lru.erase( it->second.lru );
+                    s.entries.erase( it );
+                }
+
+                /*
+                 * Called once a load finishes, to start its TTL or drop it if it failed.
+                 * The entry may have been evicted or replaced by then, in which case there's nothing to do.
+                 * */
+                inline void settle( const Key &key, shared_state<Value> *state ) {
+                    shard &s = shard_for( key );
+
+                    std::lock_guard<std::mutex> lock( s.mutex );
+
+                    auto it = s.entries.find( key );
+
+                    if( it == s.entries.end() || it->second.state.get() != state ) {
+                        return;
+                    }
+
+                    if( state->has_exception()) {
+                        erase_entry( s, it );
+
+                    } else {
+                        it->second.expires = expiry( clock_type::now());
+                    }
+                }
+
+            public:
+                inline async_cache_state( load_type &&load, std::size_t capacity, clock_type::duration ttl )
+                    : _load( std::move( load )), _ttl( ttl ) {
+                    capacity = std::max<std::size_t>( capacity, 1 );
+
+                    //A few shards per core, but not so many that each one only holds a handful of entries
+                    std::size_t wanted = std::min<std::size_t>( std::max( std::thread::hardware_concurrency(), 1u ) * 4, std::max<std::size_t>( capacity / 8, 1 ));
+                    std::size_t count  = 1;
+
+                    while( count < wanted ) {
+                        count <<= 1;
+                    }
+
+                    _shards.reset( new shard[count] );
+                    _mask           = count - 1;
+                    _shard_capacity = ( capacity + count - 1 ) / count;
+                }
+
+                inline ThenableSharedFuture<Value> get( const Key &key ) {
+                    shard &s = shard_for( key );
+
+                    value_state dest;
+
+                    {
+                        std::lock_guard<std::mutex> lock( s.mutex );
+
+                        auto it = s.entries.find( key );
+
+                        if( it != s.entries.end()) {
+                            if( it->second.expires > clock_type::now()) {
+                                s.lru.splice( s.lru.begin(), s.lru, it->second.lru );
+
+                                return state_access::make<ThenableSharedFuture<Value>>( value_state( it->second.state ));
+                            }
+
+                            erase_entry( s, it );
+                        }
+
+                        dest = make_state<Value>();
+
+                        s.lru.push_front( key );
+                        s.entries.emplace( key, entry{dest, clock_type::time_point::max(), s.lru.begin()} );
+
+                        //Evicting an entry that's still loading is fine, anybody already waiting on it still gets the result
+                        while( s.entries.size() > _shard_capacity ) {
+                            erase_entry( s, s.entries.find( s.lru.back()));
+                        }
+                    }
+
+                    std::weak_ptr<async_cache_state> self = this->shared_from_this();
+
+                    //The continuation is stored in the state itself, so it only needs a plain pointer to it
+                    shared_state<Value> *state = dest.get();
+
+                    state->add_continuation( [self, state, key]() mutable THENABLE_NOEXCEPT {
+                        if( auto c = self.lock()) {
+                            c->settle( key, state );
+                        }
+                    } );
+
+                    _load( key, dest );
+
+                    return state_access::make<ThenableSharedFuture<Value>>( std::move( dest ));
+                }
+
+                /*
+                 * Returns true if there was an entry for the key. Callers already holding its future still get the result.
+                 * */
+                inline bool erase( const Key &key ) {
+                    shard &s = shard_for( key );
+
+                    std::lock_guard<std::mutex> lock( s.mutex );
+
+                    auto it = s.entries.find( key );
+
+                    if( it == s.entries.end()) {
+                        return false;
+                    }
+
+                    erase_entry( s, it );
+
+                    return true;
+                }
+
+                inline void clear() {
+                    for( std::size_t i = 0; i <= _mask; ++i ) {
+                        std::lock_guard<std::mutex> lock( _shards[i].mutex );
+
+                        _shards[i].entries.clear();
+                        _shards[i].lru.clear();
+                    }
+                }
+
+                /*
+                 * The number of entries, including ones still loading and ones past their TTL that haven't been looked up since
+                 * */
+                inline std::size_t size() const {
+                    std::size_t total = 0;
+
+                    for( std::size_t i = 0; i <= _mask; ++i ) {
+                        std::lock_guard<std::mutex> lock( _shards[i].mutex );
+
+                        total += _shards[i].entries.size();
+                    }
+
+                    return total;
+                }
+        };
+    }
+
+    /*
+     * async_cache objects are handles, so copies share the same entries.
+     *
+     * The loader is called with the key and returns a Value, or a future for one. It's launched according to the launch policy,
+     * which by default runs it right away on the thread that missed the cache.
+     * */
+    template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+    class async_cache {
+            typedef detail::async_cache_state<Key, Value, Hash, KeyEqual> state_type;
+
+            std::shared_ptr<state_type> _state;
+
+        public:
+            typedef std::chrono::steady_clock clock_type;
+
+            template <typename Functor, typename LaunchPolicy = std::launch>
+            async_cache( Functor &&f, std::size_t capacity, LaunchPolicy policy = default_policy )
+                : async_cache( std::forward<Functor>( f ), capacity, clock_type::duration::max(), policy ) {}
+
+            template <typename Functor, typename Rep, typename Period, typename LaunchPolicy = std::launch>
+            async_cache( Functor &&f, std::size_t capacity, const std::chrono::duration<Rep, Period> &ttl, LaunchPolicy policy = default_policy ) {
+                typedef typename state_type::value_state value_state;
+
+                auto fn = std::make_shared<typename std::decay<Functor>::type>( std::forward<Functor>( f ));
+
+                typename state_type::load_type load = [fn, policy = detail::undeferred( policy )]( const Key &key, const value_state &dest ) mutable {
+                    detail::launch_into( dest, [fn, key]( const value_state &d ) {
+                        try {
+                            detail::invoke_into( d, *fn, key );
+
+                        } catch( ... ) {
+                            d->set_exception( std::current_exception());
+                        }
+                    }, policy );
+                };
+
+                //Anything too long to represent just never expires
+                typedef std::chrono::duration<double> seconds;
+
+                clock_type::duration d = seconds( ttl ) >= seconds( clock_type::duration::max())
+                                         ? clock_type::duration::max()
+                                         : std::chrono::ceil<clock_type::duration>( ttl );
+
+                _state = std::make_shared<state_type>( std::move( load ), capacity, d );
+            }
+
+            /*
+             * Returns the cached future for the key, starting a load if there isn't one in flight or still fresh
+             * */
+            inline ThenableSharedFuture<Value> get( const Key &key ) const {
+                return _state->get( key );
+            }
+
+            inline bool erase( const Key &key ) const {
+                return _state->erase( key );
+            }
+
+            inline void clear() const {
+                _state->clear();
+            }
+
+            inline std::size_t size() const {
+                return _state->size();
+            }
+    };
+}
+
+#endif //THENABLE_CACHE_HPP_INCLUDED
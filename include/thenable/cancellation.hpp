@@ -0,0 +1,225 @@
+#ifndef THENABLE_CANCELLATION_HPP_INCLUDED
+#define THENABLE_CANCELLATION_HPP_INCLUDED
+
+#include <thenable/function.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+
+/*
+ * Cooperative cancellation
+ *
+ * A cancellation_source hands out cancellation_tokens. Once the source is cancelled, every token from it reports so,
+ * and any callbacks registered on them are invoked on the thread that cancelled it.
+ *
+ * Nothing is ever interrupted. Work that hasn't started yet is dropped, and functors that are already running can poll their token
+ * to stop early. Futures that were dropped resolve with a cancelled_error.
+ * */
+
+namespace thenable {
+    /*
+     * The exception stored in futures whose work was dropped because of cancellation
+     * */
+    class cancelled_error : public std::runtime_error {
+        public:
+            inline cancelled_error() : std::runtime_error( "operation was cancelled" ) {}
+    };
+
+    namespace detail {
+        class cancellation_state {
+                typedef unique_function<void()> callback_type;
+
+                std::atomic_bool                                     _cancelled{false};
+                std::mutex                                           _mutex;
+                std::vector<std::pair<std::size_t, callback_type>> _callbacks;
+                std::size_t                                          _next_id = 1;
+
+            public:
+                inline bool is_cancelled() const noexcept {
+                    return _cancelled.load( std::memory_order_acquire );
+                }
+
+                /*
+                 * Returns false if it had already been cancelled
+                 * */
+                inline bool cancel() {
+                    std::vector<std::pair<std::size_t, callback_type>> callbacks;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( _cancelled.exchange( true, std::memory_order_acq_rel )) {
+                            return false;
+                        }
+
+                        callbacks.swap( _callbacks );
+                    }
+
+                    for( auto &callback : callbacks ) {
+                        callback.second();
+                    }
+
+                    return true;
+                }
+
+                /*
+                 * If it's already cancelled the callback is invoked right away and 0 is returned
+                 * */
+                inline std::size_t subscribe( callback_type &&callback ) {
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( !_cancelled.load( std::memory_order_relaxed )) {
+                            std::size_t id = _next_id++;
+
+                            _callbacks.emplace_back( id, std::forward<callback_type>( callback ));
+
+                            return id;
+                        }
+                    }
+
+                    callback();
+
+                    return 0;
+                }
+
+                inline void unsubscribe( std::size_t id ) {
+                    callback_type removed;
+
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    for( auto it = _callbacks.begin(); it != _callbacks.end(); ++it ) {
+                        if( it->first == id ) {
+                            removed = std::move( it->second );
+
+                            _callbacks.erase( it );
+
+                            break;
+                        }
+                    }
+                }
+        };
+
+        inline std::exception_ptr make_cancelled_exception() {
+            return std::make_exception_ptr( cancelled_error());
+        }
+    }
+
+    /*
+     * Unregisters a cancellation callback when destroyed. If the source is being cancelled at the same time,
+     * the callback may still run after this is destroyed, so it shouldn't reference anything it doesn't own.
+     * */
+    class cancellation_registration {
+            std::shared_ptr<detail::cancellation_state> _state;
+            std::size_t                                 _id = 0;
+
+        public:
+            cancellation_registration() noexcept = default;
+
+            inline cancellation_registration( std::shared_ptr<detail::cancellation_state> state, std::size_t id ) noexcept
+                : _state( std::move( state )), _id( id ) {}
+
+            inline cancellation_registration( cancellation_registration &&other ) noexcept
+                : _state( std::move( other._state )), _id( std::exchange( other._id, 0 )) {}
+
+            cancellation_registration( const cancellation_registration & ) = delete;
+
+            cancellation_registration &operator=( const cancellation_registration & ) = delete;
+
+            inline cancellation_registration &operator=( cancellation_registration &&other ) noexcept {
+                cancellation_registration( std::move( other )).swap( *this );
+
+                return *this;
+            }
+
+            inline ~cancellation_registration() {
+                reset();
+            }
+
+            inline void swap( cancellation_registration &other ) noexcept {
+                std::swap( _state, other._state );
+                std::swap( _id, other._id );
+            }
+
+            inline void reset() {
+                if( _state && _id != 0 ) {
+                    _state->unsubscribe( _id );
+                }
+
+                _state = nullptr;
+                _id    = 0;
+            }
+    };
+
+    /*
+     * Tokens are cheap handles that can be copied into every functor that needs one.
+     * A default constructed token is never cancelled.
+     * */
+    class cancellation_token {
+            std::shared_ptr<detail::cancellation_state> _state;
+
+            friend class cancellation_source;
+
+            inline explicit cancellation_token( std::shared_ptr<detail::cancellation_state> state ) noexcept : _state( std::move( state )) {}
+
+        public:
+            cancellation_token() noexcept = default;
+
+            inline bool can_be_cancelled() const noexcept {
+                return static_cast<bool>(_state);
+            }
+
+            inline bool is_cancelled() const noexcept {
+                return _state && _state->is_cancelled();
+            }
+
+            inline void throw_if_cancelled() const {
+                if( is_cancelled()) {
+                    throw cancelled_error();
+                }
+            }
+
+            /*
+             * Invokes the callback when the source is cancelled, or right away if it already has been
+             * */
+            template <typename Functor>
+            inline cancellation_registration on_cancel( Functor &&f ) const {
+                if( !_state ) {
+                    return cancellation_registration();
+                }
+
+                std::size_t id = _state->subscribe( unique_function<void()>( std::forward<Functor>( f )));
+
+                return cancellation_registration( _state, id );
+            }
+    };
+
+    class cancellation_source {
+            std::shared_ptr<detail::cancellation_state> _state;
+
+        public:
+            inline cancellation_source() : _state( std::make_shared<detail::cancellation_state>()) {}
+
+            inline cancellation_token token() const noexcept {
+                return cancellation_token( _state );
+            }
+
+            inline bool is_cancelled() const noexcept {
+                return _state->is_cancelled();
+            }
+
+            /*
+             * Returns false if the source had already been cancelled
+             * */
+            inline bool cancel() {
+                return _state->cancel();
+            }
+    };
+}
+
+#endif //THENABLE_CANCELLATION_HPP_INCLUDED
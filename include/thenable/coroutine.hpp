@@ -0,0 +1,337 @@
+#ifndef THENABLE_COROUTINE_HPP_INCLUDED
+#define THENABLE_COROUTINE_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "thenable/coroutine.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/*
+ * Coroutines
+ *
+ * ThenableFuture, ThenableSharedFuture and ThenablePromise can be awaited inside a coroutine. Rather than blocking in get(),
+ * awaiting one registers a continuation on its shared state that resumes the coroutine, so just like a `then` callback
+ * with the default policy, the coroutine carries on on whatever thread provides the value.
+ *
+ * task<T> is a lazily started coroutine type. Awaiting it from another coroutine starts it, and the awaiting coroutine is resumed
+ * directly when it finishes. start() runs it to its first suspension point and returns a ThenableFuture for the result,
+ * which is how it's handed to `then`, `await_all`, `waterfall` and everything else that works with futures.
+ *
+ * This header requires C++20, unlike the rest of the library.
+ * */
+
+namespace thenable {
+    template <typename T = void>
+    class task;
+
+    namespace detail {
+        /*
+         * Awaits a single-consumer future. Ready futures don't suspend at all.
+         * */
+        template <typename T>
+        class future_awaiter {
+                ThenableFuture<T> _future;
+
+            public:
+                inline explicit future_awaiter( ThenableFuture<T> &&f ) THENABLE_NOEXCEPT : _future( std::move( f )) {}
+
+                inline bool await_ready() const THENABLE_NOEXCEPT {
+                    return _future.is_ready();
+                }
+
+                /*
+                 * If the state completes before the continuation is added, add_continuation resumes the coroutine immediately,
+                 * so nothing here may be touched after that call.
+                 * */
+                inline void await_suspend( std::coroutine_handle<> h ) {
+                    const auto &s = state_access::state( _future );
+
+                    check_state( s );
+
+                    s->add_continuation( [h]() THENABLE_NOEXCEPT {
+                        h.resume();
+                    } );
+                }
+
+                inline T await_resume() {
+                    return _future.get();
+                }
+        };
+
+        template <typename T>
+        class shared_future_awaiter {
+                ThenableSharedFuture<T> _future;
+
+            public:
+                inline explicit shared_future_awaiter( const ThenableSharedFuture<T> &f ) THENABLE_NOEXCEPT : _future( f ) {}
+
+                inline bool await_ready() const THENABLE_NOEXCEPT {
+                    return _future.is_ready();
+                }
+
+                inline void await_suspend( std::coroutine_handle<> h ) {
+                    const auto &s = state_access::state( _future );
+
+                    check_state( s );
+
+                    s->add_continuation( [h]() THENABLE_NOEXCEPT {
+                        h.resume();
+                    } );
+                }
+
+                /*
+                 * Same as ThenableSharedFuture::get, so value types are returned as const T&
+                 * */
+                inline decltype( auto ) await_resume() const {
+                    return _future.get();
+                }
+        };
+
+        /*
+         * Resumes the awaiting coroutine as a task on an executor, or on a new thread for then_launch::detached
+         * */
+        template <typename LaunchPolicy>
+        class resume_awaiter {
+                LaunchPolicy _policy;
+
+            public:
+                inline explicit resume_awaiter( LaunchPolicy policy ) : _policy( std::move( policy )) {}
+
+                constexpr bool await_ready() const THENABLE_NOEXCEPT {
+                    return false;
+                }
+
+                inline void await_suspend( std::coroutine_handle<> h ) {
+                    launch_detached( _policy, [h]() THENABLE_NOEXCEPT {
+                        h.resume();
+                    } );
+                }
+
+                constexpr void await_resume() const THENABLE_NOEXCEPT {}
+        };
+
+        //////////
+
+        /*
+         * The result of a task is kept in a ready_result until it's either taken by the awaiting coroutine
+         * or stored into the shared state of the future returned by task::start.
+         * */
+        template <typename T>
+        struct task_promise_base {
+            ready_result<T>             result;
+            std::coroutine_handle<>     continuation;
+            state_ptr<shared_state<T>>  dest;
+
+            struct final_awaiter {
+                constexpr bool await_ready() const THENABLE_NOEXCEPT {
+                    return false;
+                }
+
+                /*
+                 * An awaited task transfers straight back into the coroutine awaiting it. A started task has nothing
+                 * to go back to, so it destroys its own frame before completing the future, in case a continuation on the future takes a while.
+                 * */
+                template <typename Promise>
+                inline std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> h ) THENABLE_NOEXCEPT {
+                    Promise &p = h.promise();
+
+                    if( p.continuation ) {
+                        return p.continuation;
+                    }
+
+                    state_ptr<shared_state<T>> d = std::move( p.dest );
+                    ready_result<T>            r( std::move( p.result ));
+
+                    h.destroy();
+
+                    if( d ) {
+                        r.store( *d );
+                    }
+
+                    return std::noop_coroutine();
+                }
+
+                constexpr void await_resume() const THENABLE_NOEXCEPT {}
+            };
+
+            inline std::suspend_always initial_suspend() const THENABLE_NOEXCEPT {
+                return {};
+            }
+
+            inline final_awaiter final_suspend() const THENABLE_NOEXCEPT {
+                return {};
+            }
+
+            inline void unhandled_exception() THENABLE_NOEXCEPT {
+                result.exception = std::current_exception();
+            }
+        };
+
+        template <typename T>
+        struct task_promise : task_promise_base<T> {
+            inline task<T> get_return_object() THENABLE_NOEXCEPT;
+
+            template <typename U>
+            inline void return_value( U &&value ) {
+                this->result.set_value( std::forward<U>( value ));
+            }
+        };
+
+        template <>
+        struct task_promise<void> : task_promise_base<void> {
+            inline task<void> get_return_object() THENABLE_NOEXCEPT;
+
+            inline void return_void() THENABLE_NOEXCEPT {
+                this->result.set_value();
+            }
+        };
+    }
+
+    //////////
+
+    /*
+     * Awaiting a future consumes it, just like calling `then` on it would
+     * */
+    template <typename T>
+    inline detail::future_awaiter<T> operator co_await( ThenableFuture<T> &&f ) THENABLE_NOEXCEPT {
+        return detail::future_awaiter<T>( std::move( f ));
+    }
+
+    template <typename T>
+    inline detail::future_awaiter<T> operator co_await( ThenableFuture<T> &f ) THENABLE_NOEXCEPT {
+        return detail::future_awaiter<T>( std::move( f ));
+    }
+
+    template <typename T>
+    inline detail::shared_future_awaiter<T> operator co_await( const ThenableSharedFuture<T> &f ) THENABLE_NOEXCEPT {
+        return detail::shared_future_awaiter<T>( f );
+    }
+
+    template <typename T>
+    inline detail::future_awaiter<T> operator co_await( ThenablePromise<T> &p ) {
+        return detail::future_awaiter<T>( p.get_future());
+    }
+
+    /*
+     * `co_await resume_on( executor )` moves the rest of the coroutine onto the executor, or a new thread with then_launch::detached
+     * */
+    template <typename LaunchPolicy, typename = detail::enable_if_detached_t<LaunchPolicy>>
+    inline detail::resume_awaiter<LaunchPolicy> resume_on( LaunchPolicy policy ) {
+        return detail::resume_awaiter<LaunchPolicy>( std::move( policy ));
+    }
+
+    //////////
+
+    template <typename T>
+    class task {
+        public:
+            typedef detail::task_promise<T>             promise_type;
+            typedef std::coroutine_handle<promise_type> handle_type;
+
+        private:
+            handle_type _handle;
+
+            struct awaiter {
+                handle_type _handle;
+
+                constexpr bool await_ready() const THENABLE_NOEXCEPT {
+                    return false;
+                }
+
+                inline std::coroutine_handle<> await_suspend( std::coroutine_handle<> h ) THENABLE_NOEXCEPT {
+                    _handle.promise().continuation = h;
+
+                    return _handle;
+                }
+
+                inline T await_resume() {
+                    return _handle.promise().result.take();
+                }
+            };
+
+        public:
+            constexpr task() THENABLE_NOEXCEPT = default;
+
+            inline explicit task( handle_type h ) THENABLE_NOEXCEPT : _handle( h ) {}
+
+            inline task( task &&other ) THENABLE_NOEXCEPT : _handle( std::exchange( other._handle, nullptr )) {}
+
+            task( const task & ) = delete;
+
+            task &operator=( const task & ) = delete;
+
+            inline task &operator=( task &&other ) THENABLE_NOEXCEPT {
+                task( std::move( other )).swap( *this );
+
+                return *this;
+            }
+
+            /*
+             * A task that was never started or awaited is just destroyed without running
+             * */
+            inline ~task() {
+                if( _handle ) {
+                    _handle.destroy();
+                }
+            }
+
+            inline void swap( task &other ) THENABLE_NOEXCEPT {
+                std::swap( _handle, other._handle );
+            }
+
+            inline bool valid() const THENABLE_NOEXCEPT {
+                return static_cast<bool>(_handle);
+            }
+
+            inline awaiter operator co_await() && THENABLE_NOEXCEPT {
+                return awaiter{_handle};
+            }
+
+            /*
+             * Runs the task on the current thread until it first suspends, and returns a future for its result.
+             * The task object is left empty and the coroutine frame cleans itself up when it finishes.
+             * */
+            inline ThenableFuture<T> start() && {
+                if( !_handle ) {
+                    throw std::future_error( std::future_errc::no_state );
+                }
+
+                auto dest = detail::make_state<T>();
+
+                handle_type h = std::exchange( _handle, nullptr );
+
+                h.promise().dest = dest;
+
+                h.resume();
+
+                return detail::state_access::make<ThenableFuture<T>>( std::move( dest ));
+            }
+
+            inline operator ThenableFuture<T>() && {
+                return std::move( *this ).start();
+            }
+
+            template <typename Functor, typename LaunchPolicy = std::launch>
+            inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) && {
+                return std::move( *this ).start().then( std::forward<Functor>( f ), policy );
+            }
+    };
+
+    namespace detail {
+        template <typename T>
+        inline task<T> task_promise<T>::get_return_object() THENABLE_NOEXCEPT {
+            return task<T>( std::coroutine_handle<task_promise<T>>::from_promise( *this ));
+        }
+
+        inline task<void> task_promise<void>::get_return_object() THENABLE_NOEXCEPT {
+            return task<void>( std::coroutine_handle<task_promise<void>>::from_promise( *this ));
+        }
+    }
+}
+
+#endif //THENABLE_COROUTINE_HPP_INCLUDED
@@ -0,0 +1,425 @@
+#ifndef THENABLE_EXECUTOR_HPP_INCLUDED
+#define THENABLE_EXECUTOR_HPP_INCLUDED
+
+#include <thenable/function.hpp>
+
+#include <assert.h>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <functional>
+#include <type_traits>
+
+/*
+ * Executors
+ *
+ * An executor is any object with an `execute` member function accepting a unique_function<void()>. They can be given to `then`, `then2`,
+ * `await_all`, `waterfall` and `make_promise` anywhere a launch policy is accepted, and the tasks those create will be run by the executor.
+ *
+ * Executors are passed around by value just like launch policies, so they should be cheap handles to whatever actually runs the tasks,
+ * like thread_pool below. Executors that can't be copied can be wrapped in std::ref.
+ * */
+
+namespace thenable {
+    namespace detail {
+        template <typename E, typename = void>
+        struct is_executor_helper : std::false_type {
+        };
+
+        template <typename E>
+        struct is_executor_helper<E, std::void_t<decltype( std::declval<E &>().execute( std::declval<unique_function<void()>>()))>> : std::true_type {
+        };
+
+        template <typename E>
+        inline E &unwrap_executor( E &executor ) noexcept {
+            return executor;
+        }
+
+        template <typename E>
+        inline E &unwrap_executor( std::reference_wrapper<E> &executor ) noexcept {
+            return executor.get();
+        }
+
+        template <typename E>
+        inline E &unwrap_executor( const std::reference_wrapper<E> &executor ) noexcept {
+            return executor.get();
+        }
+    }
+
+    template <typename E>
+    struct is_executor : detail::is_executor_helper<typename std::decay<E>::type> {
+    };
+
+    template <typename E>
+    struct is_executor<std::reference_wrapper<E>> : is_executor<E> {
+    };
+
+    /*
+     * Submits any callable to an executor
+     * */
+    template <typename Executor, typename Functor>
+    inline void execute( Executor &executor, Functor &&f ) {
+        detail::unwrap_executor( executor ).execute( unique_function<void()>( std::forward<Functor>( f )));
+    }
+
+    //////////
+
+    /*
+     * Runs tasks immediately on the thread submitting them.
+     * */
+    struct inline_executor {
+        inline void execute( unique_function<void()> &&task ) const {
+            task();
+        }
+    };
+
+    //////////
+
+    /*
+     * A fixed-size pool of worker threads sharing a single task queue.
+     *
+     * thread_pool objects are handles, so copies refer to the same set of workers. When the last handle is destroyed
+     * the workers finish whatever is left in the queue and are joined.
+     * */
+    class thread_pool {
+            struct task_queue {
+                std::mutex                          mutex;
+                std::condition_variable             cv;
+                std::deque<unique_function<void()>> tasks;
+                bool                                stopped = false;
+
+                inline void run() {
+                    std::unique_lock<std::mutex> lock( mutex );
+
+                    while( true ) {
+                        cv.wait( lock, [this] {
+                            return stopped || !tasks.empty();
+                        } );
+
+                        if( tasks.empty()) {
+                            return;
+                        }
+
+                        unique_function<void()> task = std::move( tasks.front());
+
+                        tasks.pop_front();
+
+                        lock.unlock();
+
+                        task();
+
+                        lock.lock();
+                    }
+                }
+            };
+
+            /*
+             * The workers only hold on to the queue, so if the last handle happens to be destroyed by a task running on the pool,
+             * that worker can just be detached and exit by itself.
+             * */
+            struct workers {
+                std::shared_ptr<task_queue> queue;
+                std::vector<std::thread>    threads;
+
+                inline ~workers() {
+                    {
+                        std::lock_guard<std::mutex> lock( queue->mutex );
+
+                        queue->stopped = true;
+                    }
+
+                    queue->cv.notify_all();
+
+                    for( std::thread &thread : threads ) {
+                        if( thread.get_id() == std::this_thread::get_id()) {
+                            thread.detach();
+
+                        } else {
+                            thread.join();
+                        }
+                    }
+                }
+            };
+
+            std::shared_ptr<task_queue> _queue;
+            std::shared_ptr<workers>    _workers;
+
+        public:
+            inline explicit thread_pool( std::size_t size = std::thread::hardware_concurrency())
+                : _queue( std::make_shared<task_queue>()), _workers( std::make_shared<workers>()) {
+                _workers->queue = _queue;
+
+                for( std::size_t i = 0, n = std::max<std::size_t>( size, 1 ); i < n; ++i ) {
+                    _workers->threads.emplace_back( [queue = _queue] {
+                        queue->run();
+                    } );
+                }
+            }
+
+            inline void execute( unique_function<void()> &&task ) const {
+                {
+                    std::lock_guard<std::mutex> lock( _queue->mutex );
+
+                    _queue->tasks.push_back( std::forward<unique_function<void()>>( task ));
+                }
+
+                _queue->cv.notify_one();
+            }
+
+            inline std::size_t size() const noexcept {
+                return _workers->threads.size();
+            }
+    };
+
+    //////////
+
+    /*
+     * A fixed-size pool where each worker has its own task deque.
+     *
+     * Tasks submitted from a worker go onto the back of its own deque, and it takes them back off the back, so related work stays on the same core.
+     * Tasks submitted from outside the pool are spread across the deques round-robin. Workers that run out of work steal from the front of the other deques,
+     * and only go to sleep when there is nothing left anywhere.
+     *
+     * A worker that has to wait on a future runs the tasks queued on its own deque in the meantime, rather than blocking outright.
+     * Tasks that submit more work to the pool and then wait for it, like nested `parallel` calls, can't starve the pool that way,
+     * since the work they're waiting on is run by the waiting worker itself if nobody else gets to it first.
+     *
+     * Like thread_pool, these are handles, and the workers are joined once the last handle is destroyed.
+     * */
+    namespace detail {
+        inline bool help_while_waiting();
+
+        inline bool is_pool_worker() noexcept;
+    }
+
+    class work_stealing_pool {
+            friend bool detail::help_while_waiting();
+
+            friend bool detail::is_pool_worker() noexcept;
+
+            struct worker_queue {
+                std::mutex                          mutex;
+                std::deque<unique_function<void()>> tasks;
+            };
+
+            struct shared_state;
+
+            /*
+             * Identifies which pool, if any, the current thread is a worker of
+             * */
+            struct worker_identity {
+                shared_state *pool  = nullptr;
+                std::size_t  index = 0;
+            };
+
+            static inline worker_identity &current_worker() noexcept {
+                static thread_local worker_identity identity;
+
+                return identity;
+            }
+
+            struct shared_state {
+                std::vector<std::unique_ptr<worker_queue>> queues;
+                std::atomic_size_t                         next{0};
+                std::atomic_size_t                         pending{0};
+                std::atomic_size_t                         sleeping{0};
+                std::mutex                                 sleep_mutex;
+                std::condition_variable                    sleep_cv;
+                bool                                       stopped = false;
+
+                inline void push( unique_function<void()> &&task ) {
+                    worker_identity &self = current_worker();
+
+                    std::size_t index = self.pool == this ? self.index : next.fetch_add( 1, std::memory_order_relaxed ) % queues.size();
+
+                    {
+                        std::lock_guard<std::mutex> lock( queues[index]->mutex );
+
+                        queues[index]->tasks.push_back( std::forward<unique_function<void()>>( task ));
+                    }
+
+                    pending.fetch_add( 1 );
+
+                    if( sleeping.load() > 0 ) {
+                        std::lock_guard<std::mutex> lock( sleep_mutex );
+
+                        sleep_cv.notify_one();
+                    }
+                }
+
+                /*
+                 * Takes from the back of our own deque first, then tries to steal from the front of everyone else's
+                 * */
+                inline bool try_pop( std::size_t index, unique_function<void()> &task ) {
+                    for( std::size_t i = 0, n = queues.size(); i < n; ++i ) {
+                        worker_queue &queue = *queues[( index + i ) % n];
+
+                        std::lock_guard<std::mutex> lock( queue.mutex );
+
+                        if( !queue.tasks.empty()) {
+                            if( i == 0 ) {
+                                task = std::move( queue.tasks.back());
+
+                                queue.tasks.pop_back();
+
+                            } else {
+                                task = std::move( queue.tasks.front());
+
+                                queue.tasks.pop_front();
+                            }
+
+                            pending.fetch_sub( 1 );
+
+                            return true;
+                        }
+                    }
+
+                    return false;
+                }
+
+                /*
+                 * Runs the most recently queued task on the current worker's own deque, if there is one
+                 * */
+                inline bool run_own( std::size_t index ) {
+                    unique_function<void()> task;
+
+                    {
+                        worker_queue &queue = *queues[index];
+
+                        std::lock_guard<std::mutex> lock( queue.mutex );
+
+                        if( queue.tasks.empty()) {
+                            return false;
+                        }
+
+                        task = std::move( queue.tasks.back());
+
+                        queue.tasks.pop_back();
+                    }
+
+                    pending.fetch_sub( 1 );
+
+                    task();
+
+                    return true;
+                }
+
+                inline void run( std::size_t index ) {
+                    current_worker() = worker_identity{this, index};
+
+                    unique_function<void()> task;
+
+                    while( true ) {
+                        if( try_pop( index, task )) {
+                            task();
+
+                            task = nullptr;
+
+                        } else {
+                            std::unique_lock<std::mutex> lock( sleep_mutex );
+
+                            if( stopped && pending.load() == 0 ) {
+                                return;
+                            }
+
+                            sleeping.fetch_add( 1 );
+
+                            sleep_cv.wait( lock, [this] {
+                                return stopped || pending.load() > 0;
+                            } );
+
+                            sleeping.fetch_sub( 1 );
+                        }
+                    }
+                }
+            };
+
+            struct workers {
+                std::shared_ptr<shared_state> state;
+                std::vector<std::thread>      threads;
+
+                inline ~workers() {
+                    {
+                        std::lock_guard<std::mutex> lock( state->sleep_mutex );
+
+                        state->stopped = true;
+                    }
+
+                    state->sleep_cv.notify_all();
+
+                    for( std::thread &thread : threads ) {
+                        if( thread.get_id() == std::this_thread::get_id()) {
+                            thread.detach();
+
+                        } else {
+                            thread.join();
+                        }
+                    }
+                }
+            };
+
+            std::shared_ptr<shared_state> _state;
+            std::shared_ptr<workers>      _workers;
+
+        public:
+            inline explicit work_stealing_pool( std::size_t size = std::thread::hardware_concurrency())
+                : _state( std::make_shared<shared_state>()), _workers( std::make_shared<workers>()) {
+                size = std::max<std::size_t>( size, 1 );
+
+                for( std::size_t i = 0; i < size; ++i ) {
+                    _state->queues.emplace_back( new worker_queue());
+                }
+
+                _workers->state = _state;
+
+                for( std::size_t i = 0; i < size; ++i ) {
+                    _workers->threads.emplace_back( [state = _state, i] {
+                        state->run( i );
+                    } );
+                }
+            }
+
+            inline void execute( unique_function<void()> &&task ) const {
+                _state->push( std::forward<unique_function<void()>>( task ));
+            }
+
+            inline std::size_t size() const noexcept {
+                return _state->queues.size();
+            }
+    };
+
+    namespace detail {
+        /*
+         * Called while waiting on a future. If the current thread is a work_stealing_pool worker, runs one task from its own deque
+         * and returns true, otherwise returns false and the caller should just block.
+         * */
+        inline bool help_while_waiting() {
+            work_stealing_pool::worker_identity &self = work_stealing_pool::current_worker();
+
+            return self.pool != nullptr && self.pool->run_own( self.index );
+        }
+
+        /*
+         * Whether the current thread is a work_stealing_pool worker, which shouldn't block without helping
+         * */
+        inline bool is_pool_worker() noexcept {
+            return work_stealing_pool::current_worker().pool != nullptr;
+        }
+    }
+
+    /*
+     * The process-wide work_stealing_pool used by `parallel` and friends, with one worker per hardware thread.
+     * */
+    inline const work_stealing_pool &default_executor() {
+        static work_stealing_pool pool;
+
+        return pool;
+    }
+}
+
+#endif //THENABLE_EXECUTOR_HPP_INCLUDED
@@ -0,0 +1,182 @@
+#ifndef THENABLE_FUNCTION_HPP_INCLUDED
+#define THENABLE_FUNCTION_HPP_INCLUDED
+
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+/*
+ * Callables up to this size are stored inline in unique_function instead of being allocated on the heap.
+ *
+ * The default leaves room for the captures of a typical continuation: a couple of shared states and a small lambda.
+ * */
+#ifndef THENABLE_FUNCTION_BUFFER_SIZE
+#define THENABLE_FUNCTION_BUFFER_SIZE (6 * sizeof( void * ))
+#endif
+
+namespace thenable {
+    /*
+     * unique_function is a move-only equivalent of std::function.
+     *
+     * std::function requires the stored callable to be copyable, which rules out most continuations since
+     * they tend to own a promise, a future or some other move-only state. This only requires the callable to be movable.
+     *
+     * Small callables that can be moved without throwing are stored in an internal buffer, so wrapping them doesn't allocate.
+     * */
+
+    template <typename>
+    class unique_function;
+
+    template <typename R, typename... Args>
+    class unique_function<R( Args... )> {
+            typedef typename std::aligned_storage<THENABLE_FUNCTION_BUFFER_SIZE>::type buffer_type;
+
+            struct callable_base {
+                virtual ~callable_base() = default;
+
+                virtual R invoke( Args &&... ) = 0;
+
+                /*
+                 * Moves an inline callable into another buffer, leaving this one to be destroyed
+                 * */
+                virtual callable_base *move_to( buffer_type &buffer ) noexcept = 0;
+            };
+
+            template <typename Functor>
+            struct callable : callable_base {
+                Functor _f;
+
+                template <typename F>
+                inline callable( F &&f ) : _f( std::forward<F>( f )) {}
+
+                R invoke( Args &&... args ) override {
+                    return static_cast<R>(_f( std::forward<Args>( args )... ));
+                }
+
+                callable_base *move_to( buffer_type &buffer ) noexcept override {
+                    return ::new( &buffer ) callable( std::move( _f ));
+                }
+            };
+
+            template <typename Functor>
+            struct is_inline : std::integral_constant<bool, sizeof( callable<Functor> ) <= sizeof( buffer_type ) &&
+                                                            alignof( callable<Functor> ) <= alignof( buffer_type ) &&
+                                                            std::is_nothrow_move_constructible<Functor>::value> {
+            };
+
+            buffer_type   _buffer;
+            callable_base *_callable = nullptr;
+
+            inline bool is_local() const noexcept {
+                return static_cast<const void *>(_callable) == static_cast<const void *>(&_buffer);
+            }
+
+            inline void reset() noexcept {
+                if( is_local()) {
+                    _callable->~callable_base();
+
+                } else {
+                    delete _callable;
+                }
+
+                _callable = nullptr;
+            }
+
+            /*
+             * Takes over the callable of another unique_function, which must be empty beforehand
+             * */
+            inline void take( unique_function &other ) noexcept {
+                if( other.is_local()) {
+                    _callable = other._callable->move_to( _buffer );
+
+                    other.reset();
+
+                } else {
+                    _callable = other._callable;
+
+                    other._callable = nullptr;
+                }
+            }
+
+            template <typename Functor, typename F = typename std::decay<Functor>::type>
+            inline typename std::enable_if<is_inline<F>::value>::type emplace( Functor &&f ) {
+                _callable = ::new( &_buffer ) callable<F>( std::forward<Functor>( f ));
+            }
+
+            template <typename Functor, typename F = typename std::decay<Functor>::type>
+            inline typename std::enable_if<!is_inline<F>::value>::type emplace( Functor &&f ) {
+                _callable = new callable<F>( std::forward<Functor>( f ));
+            }
+
+        public:
+            inline unique_function() noexcept {}
+
+            inline unique_function( std::nullptr_t ) noexcept {}
+
+            template <typename Functor, typename = typename std::enable_if<!std::is_same<typename std::decay<Functor>::type, unique_function>::value>::type>
+            inline unique_function( Functor &&f ) {
+                emplace( std::forward<Functor>( f ));
+            }
+
+            inline unique_function( unique_function &&other ) noexcept {
+                if( other._callable ) {
+                    take( other );
+                }
+            }
+
+            inline unique_function &operator=( unique_function &&other ) noexcept {
+                if( this != &other ) {
+                    if( _callable ) {
+                        reset();
+                    }
+
+                    if( other._callable ) {
+                        take( other );
+                    }
+                }
+
+                return *this;
+            }
+
+            unique_function( const unique_function & ) = delete;
+
+            unique_function &operator=( const unique_function & ) = delete;
+
+            inline ~unique_function() {
+                if( _callable ) {
+                    reset();
+                }
+            }
+
+            inline unique_function &operator=( std::nullptr_t ) noexcept {
+                if( _callable ) {
+                    reset();
+                }
+
+                return *this;
+            }
+
+            inline explicit operator bool() const noexcept {
+                return _callable != nullptr;
+            }
+
+            inline R operator()( Args... args ) {
+                if( !_callable ) {
+                    throw std::bad_function_call();
+                }
+
+                return _callable->invoke( std::forward<Args>( args )... );
+            }
+
+            inline void swap( unique_function &other ) noexcept {
+                unique_function tmp( std::move( other ));
+
+                other = std::move( *this );
+
+                *this = std::move( tmp );
+            }
+    };
+}
+
+#endif //THENABLE_FUNCTION_HPP_INCLUDED
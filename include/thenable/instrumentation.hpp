@@ -0,0 +1,405 @@
+#ifndef THENABLE_INSTRUMENTATION_HPP_INCLUDED
+#define THENABLE_INSTRUMENTATION_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Instrumentation
+ *
+ * Defining THENABLE_INSTRUMENTATION before including thenable makes every task the library schedules report to a set of
+ * user-installed hooks: when it's scheduled, when it starts running and when it completes. It also counts the threads spawned for
+ * std::launch::async and then_launch::detached, and how many threads are blocked waiting on a result.
+ *
+ * A task is scheduled once whatever it was waiting on is ready and it's handed off to run, so the time between on_schedule and on_start
+ * is how long it sat in a queue or waited for a new thread. Deferred tasks are scheduled when they're created, since nothing sets them off.
+ *
+ * Without THENABLE_INSTRUMENTATION none of the hooks are ever called and tasks aren't wrapped at all,
+ * so the types below are still available but nothing is recorded.
+ * */
+
+namespace thenable {
+    namespace instrumentation {
+        typedef std::chrono::steady_clock clock_type;
+
+        /*
+         * parent is the id of the task that was running on the thread that scheduled this one, or zero if there wasn't one.
+         * Timestamps that haven't happened yet are left at their default.
+         * */
+        struct task_event {
+            std::uint64_t          id     = 0;
+            std::uint64_t          parent = 0;
+            clock_type::time_point scheduled;
+            clock_type::time_point started;
+            clock_type::time_point completed;
+        };
+
+        /*
+         * Any of the hooks may be left null. They're called on whatever thread the event happens on, so they must be thread safe,
+         * and they must not throw. context is passed back to each of them as is.
+         * */
+        struct hooks {
+            void *context = nullptr;
+
+            void ( *on_schedule )( void *, const task_event & )     = nullptr;
+            void ( *on_start )( void *, const task_event & )        = nullptr;
+            void ( *on_complete )( void *, const task_event & )     = nullptr;
+            void ( *on_thread_spawn )( void *, std::uint64_t total ) = nullptr;
+        };
+
+        namespace detail {
+            inline std::atomic<const hooks *> &installed_hooks() noexcept {
+                static std::atomic<const hooks *> h{nullptr};
+
+                return h;
+            }
+
+            inline std::atomic<std::uint64_t> &spawned_counter() noexcept {
+                static std::atomic<std::uint64_t> n{0};
+
+                return n;
+            }
+
+            inline std::atomic<std::size_t> &blocked_counter() noexcept {
+                static std::atomic<std::size_t> n{0};
+
+                return n;
+            }
+
+            inline std::uint64_t next_task_id() noexcept {
+                static std::atomic<std::uint64_t> next{0};
+
+                return next.fetch_add( 1, std::memory_order_relaxed ) + 1;
+            }
+
+            inline std::uint64_t &current_task_slot() noexcept {
+                thread_local std::uint64_t id = 0;
+
+                return id;
+            }
+        }
+
+        /*
+         * Installs the hooks, replacing any that were installed before, or uninstalls them given nullptr.
+         * The hooks object isn't copied, so it has to outlive any task that might still report to it.
+         * */
+        inline void install( const hooks *h ) noexcept {
+            detail::installed_hooks().store( h, std::memory_order_release );
+        }
+
+        inline const hooks *installed() noexcept {
+            return detail::installed_hooks().load( std::memory_order_acquire );
+        }
+
+        /*
+         * The total number of threads spawned by the library for std::launch::async and then_launch::detached tasks
+         * */
+        inline std::uint64_t threads_spawned() noexcept {
+            return detail::spawned_counter().load( std::memory_order_relaxed );
+        }
+
+        /*
+         * The number of threads currently blocked in get() or wait() for a result, including the ones recursive_get waits on
+         * */
+        inline std::size_t threads_blocked() noexcept {
+            return detail::blocked_counter().load( std::memory_order_relaxed );
+        }
+
+        /*
+         * The id of the task running on this thread, or zero if there isn't one
+         * */
+        inline std::uint64_t current_task() noexcept {
+            return detail::current_task_slot();
+        }
+
+        //////////
+
+        /*
+         * A histogram of durations in power of two buckets. Bucket 0 counts zero durations, and bucket i counts durations
+         * of at least 2^(i-1) nanoseconds and less than 2^i.
+         * */
+        class histogram {
+            public:
+                static constexpr std::size_t bucket_count = 65;
+
+            private:
+                std::array<std::uint64_t, bucket_count> _buckets{};
+
+            public:
+                static inline std::size_t bucket_of( std::chrono::nanoseconds d ) noexcept {
+                    std::uint64_t ns = d.count() > 0 ? static_cast<std::uint64_t>(d.count()) : 0;
+                    std::size_t   i  = 0;
+
+                    while( ns ) {
+                        ns >>= 1;
+                        ++i;
+                    }
+
+                    return i;
+                }
+
+                /*
+                 * The largest duration counted in the bucket
+                 * */
+                static inline std::chrono::nanoseconds upper_bound( std::size_t bucket ) noexcept {
+                    if( bucket == 0 ) {
+                        return std::chrono::nanoseconds( 0 );
+                    }
+
+                    if( bucket >= 64 ) {
+                        return std::chrono::nanoseconds::max();
+                    }
+
+                    return std::chrono::nanoseconds( static_cast<std::chrono::nanoseconds::rep>(( std::uint64_t( 1 ) << ( bucket - 1 )) * 2 - 1 ));
+                }
+
+                inline void add( std::size_t bucket, std::uint64_t n = 1 ) noexcept {
+                    _buckets[bucket] += n;
+                }
+
+                inline std::uint64_t operator[]( std::size_t bucket ) const noexcept {
+                    return _buckets[bucket];
+                }
+
+                inline std::uint64_t count() const noexcept {
+                    std::uint64_t total = 0;
+
+                    for( std::uint64_t n : _buckets ) {
+                        total += n;
+                    }
+
+                    return total;
+                }
+
+                /*
+                 * The upper bound of the bucket the given fraction of samples fall at or below, like 0.99 for the 99th percentile
+                 * */
+                inline std::chrono::nanoseconds percentile( double p ) const noexcept {
+                    std::uint64_t total = count();
+
+                    if( total == 0 ) {
+                        return std::chrono::nanoseconds( 0 );
+                    }
+
+                    double        target = p * static_cast<double>(total);
+                    std::uint64_t seen   = 0;
+
+                    for( std::size_t i = 0; i < bucket_count; ++i ) {
+                        seen += _buckets[i];
+
+                        if( seen > 0 && static_cast<double>(seen) >= target ) {
+                            return upper_bound( i );
+                        }
+                    }
+
+                    return upper_bound( bucket_count - 1 );
+                }
+        };
+
+        /*
+         * Collects histograms of queue delay, from on_schedule to on_start, and run time, from on_start to on_complete.
+         *
+         * Recording never takes a lock. Each thread counts into its own cache line sized block of buckets,
+         * picked once per thread, so threads don't contend unless there are more of them than blocks.
+         * Reading the histograms adds up every block, so it's only consistent once no tasks are running.
+         *
+         * Hooks installed by install() refer to the collector, so it has to outlive them.
+         * */
+        class histogram_collector {
+                static constexpr std::size_t block_count = 64;
+
+                struct alignas( 64 ) block {
+                    std::atomic<std::uint64_t> queue_delay[histogram::bucket_count];
+                    std::atomic<std::uint64_t> run_time[histogram::bucket_count];
+                };
+
+                std::unique_ptr<block[]> _blocks;
+                hooks                    _hooks;
+
+                static inline std::size_t thread_block() noexcept {
+                    static std::atomic_size_t next{0};
+
+                    thread_local std::size_t index = next.fetch_add( 1, std::memory_order_relaxed ) % block_count;
+
+                    return index;
+                }
+
+                static inline void record( std::atomic<std::uint64_t> *buckets, clock_type::duration d ) noexcept {
+                    buckets[histogram::bucket_of( d )].fetch_add( 1, std::memory_order_relaxed );
+                }
+
+                static inline void on_start( void *context, const task_event &e ) noexcept {
+                    auto *self = static_cast<histogram_collector *>(context);
+
+                    record( self->_blocks[thread_block()].queue_delay, e.started - e.scheduled );
+                }
+
+                static inline void on_complete( void *context, const task_event &e ) noexcept {
+                    auto *self = static_cast<histogram_collector *>(context);
+
+                    record( self->_blocks[thread_block()].run_time, e.completed - e.started );
+                }
+
+                template <typename Member>
+                inline histogram collect( Member member ) const noexcept {
+                    histogram h;
+
+                    for( std::size_t b = 0; b < block_count; ++b ) {
+                        for( std::size_t i = 0; i < histogram::bucket_count; ++i ) {
+                            h.add( i, ( _blocks[b].*member )[i].load( std::memory_order_relaxed ));
+                        }
+                    }
+
+                    return h;
+                }
+
+            public:
+                inline histogram_collector() : _blocks( new block[block_count] ) {
+                    reset();
+
+                    _hooks.context     = this;
+                    _hooks.on_start    = &histogram_collector::on_start;
+                    _hooks.on_complete = &histogram_collector::on_complete;
+                }
+
+                histogram_collector( const histogram_collector & ) = delete;
+
+                histogram_collector &operator=( const histogram_collector & ) = delete;
+
+                /*
+                 * The hooks that record into this collector, for forwarding to from other hooks
+                 * */
+                inline const hooks &get_hooks() const noexcept {
+                    return _hooks;
+                }
+
+                inline void install() const noexcept {
+                    instrumentation::install( &_hooks );
+                }
+
+                inline histogram queue_delay() const noexcept {
+                    return collect( &block::queue_delay );
+                }
+
+                inline histogram run_time() const noexcept {
+                    return collect( &block::run_time );
+                }
+
+                inline void reset() noexcept {
+                    for( std::size_t b = 0; b < block_count; ++b ) {
+                        for( std::size_t i = 0; i < histogram::bucket_count; ++i ) {
+                            _blocks[b].queue_delay[i].store( 0, std::memory_order_relaxed );
+                            _blocks[b].run_time[i].store( 0, std::memory_order_relaxed );
+                        }
+                    }
+                }
+        };
+    }
+
+    //////////
+
+    namespace detail {
+#ifdef THENABLE_INSTRUMENTATION
+        /*
+         * Wraps a task to report when it starts and completes, and to be the current task on its thread while it runs
+         * */
+        template <typename Task>
+        struct instrumented_task {
+            instrumentation::task_event event;
+            Task                        task;
+
+            template <typename... Args>
+            inline void operator()( Args &&... args ) {
+                event.started = instrumentation::clock_type::now();
+
+                if( const instrumentation::hooks *h = instrumentation::installed()) {
+                    if( h->on_start ) {
+                        h->on_start( h->context, event );
+                    }
+                }
+
+                std::uint64_t &current = instrumentation::detail::current_task_slot();
+                std::uint64_t previous = current;
+
+                current = event.id;
+
+                task( std::forward<Args>( args )... );
+
+                current = previous;
+
+                event.completed = instrumentation::clock_type::now();
+
+                if( const instrumentation::hooks *h = instrumentation::installed()) {
+                    if( h->on_complete ) {
+                        h->on_complete( h->context, event );
+                    }
+                }
+            }
+        };
+
+        /*
+         * Called at the moment a task is scheduled
+         * */
+        template <typename Task>
+        inline instrumented_task<typename std::decay<Task>::type> instrument( Task &&task ) {
+            instrumented_task<typename std::decay<Task>::type> t{instrumentation::task_event(), std::forward<Task>( task )};
+
+            t.event.id        = instrumentation::detail::next_task_id();
+            t.event.parent    = instrumentation::current_task();
+            t.event.scheduled = instrumentation::clock_type::now();
+
+            if( const instrumentation::hooks *h = instrumentation::installed()) {
+                if( h->on_schedule ) {
+                    h->on_schedule( h->context, t.event );
+                }
+            }
+
+            return t;
+        }
+
+        inline void note_thread_spawn() noexcept {
+            std::uint64_t total = instrumentation::detail::spawned_counter().fetch_add( 1, std::memory_order_relaxed ) + 1;
+
+            if( const instrumentation::hooks *h = instrumentation::installed()) {
+                if( h->on_thread_spawn ) {
+                    h->on_thread_spawn( h->context, total );
+                }
+            }
+        }
+
+        /*
+         * Counts the current thread as blocked for as long as it's alive
+         * */
+        struct blocking_scope {
+            inline blocking_scope() noexcept {
+                instrumentation::detail::blocked_counter().fetch_add( 1, std::memory_order_relaxed );
+            }
+
+            inline ~blocking_scope() {
+                instrumentation::detail::blocked_counter().fetch_sub( 1, std::memory_order_relaxed );
+            }
+
+            blocking_scope( const blocking_scope & ) = delete;
+        };
+#else
+        template <typename Task>
+        inline Task &&instrument( Task &&task ) noexcept {
+            return std::forward<Task>( task );
+        }
+
+        inline void note_thread_spawn() noexcept {}
+
+        struct blocking_scope {
+            inline blocking_scope() noexcept {}
+        };
+#endif
+    }
+}
+
+#endif //THENABLE_INSTRUMENTATION_HPP_INCLUDED
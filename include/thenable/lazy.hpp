@@ -0,0 +1,209 @@
+#ifndef THENABLE_LAZY_HPP_INCLUDED
+#define THENABLE_LAZY_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <type_traits>
+#include <utility>
+
+/*
+ * Continuation fusion
+ *
+ * Every `then` on a ThenableFuture allocates a shared state and schedules a separate task, which is a lot of overhead for
+ * a chain of cheap transforms like f.then( a ).then( b ).then( c ), especially with a policy that hops to a new thread or executor for each one.
+ *
+ * `lazy( f )` instead returns a lazy_future, where `then` just composes the functor with the ones before it at compile time.
+ * Nothing is scheduled until the chain is turned back into a ThenableFuture, at which point the whole composed functor
+ * is attached to the original future as a single continuation with a single shared state, so N transforms cost one hop instead of N.
+ *
+ * Stages are only fused while they run under the same launch policy and return plain values. Giving `then` a launch policy,
+ * or adding a stage after one that returns a future, first schedules everything before it and then starts fusing again from there.
+ *
+ * If a stage throws, the rest of the fused stages are skipped and the exception goes to the resulting future, just like separate `then` calls.
+ * */
+
+namespace thenable {
+    template <typename T, typename Stage, typename LaunchPolicy>
+    class lazy_future;
+
+    namespace detail {
+        /*
+         * The stage of a lazy_future that doesn't have any functors yet
+         * */
+        struct no_stage {
+        };
+
+        template <typename Result>
+        struct fused_invoker {
+            template <typename F, typename G, typename... Args>
+            static inline decltype( auto ) invoke( F &f, G &g, Args &&... args ) {
+                return invoke_unpacked( g, invoke_unpacked( f, std::forward<Args>( args )... ));
+            }
+        };
+
+        template <>
+        struct fused_invoker<void> {
+            template <typename F, typename G, typename... Args>
+            static inline decltype( auto ) invoke( F &f, G &g, Args &&... args ) {
+                invoke_unpacked( f, std::forward<Args>( args )... );
+
+                return invoke_unpacked( g );
+            }
+        };
+
+        /*
+         * Runs f, then passes whatever it returned on to g the same way `then` would
+         * */
+        template <typename F, typename G>
+        struct fused_stage {
+            F f;
+            G g;
+
+            template <typename... Args>
+            inline decltype( auto ) operator()( Args &&... args ) {
+                typedef decltype( invoke_unpacked( f, std::forward<Args>( args )... )) Result;
+
+                return fused_invoker<Result>::invoke( f, g, std::forward<Args>( args )... );
+            }
+        };
+
+        template <typename G>
+        inline typename std::decay<G>::type fuse_stages( no_stage &&, G &&g ) {
+            return std::forward<G>( g );
+        }
+
+        template <typename F, typename G>
+        inline fused_stage<F, typename std::decay<G>::type> fuse_stages( F &&f, G &&g ) {
+            return {std::forward<F>( f ), std::forward<G>( g )};
+        }
+
+        /*
+         * What a stage returns when given the value of a ThenableFuture<T>, before any returned future is flattened
+         * */
+        template <typename T, typename Stage>
+        struct stage_result {
+            typedef decltype( invoke_unpacked( std::declval<Stage &>(), std::declval<T>())) type;
+        };
+
+        template <typename Stage>
+        struct stage_result<void, Stage> {
+            typedef decltype( invoke_unpacked( std::declval<Stage &>())) type;
+        };
+
+        template <typename T>
+        struct stage_result<T, no_stage> {
+            typedef T type;
+        };
+
+        template <>
+        struct stage_result<void, no_stage> {
+            typedef void type;
+        };
+
+        template <typename T, typename Stage>
+        using stage_result_t = typename stage_result<T, Stage>::type;
+
+        /*
+         * The value type of the ThenableFuture the stage ends up in, with any returned futures flattened like `then` does
+         * */
+        template <typename T, typename Stage>
+        using lazy_result_t = typename recursive_get_future_type<typename std::decay<stage_result_t<T, Stage>>::type>::type;
+
+        template <typename T, typename LaunchPolicy>
+        inline ThenableFuture<T> schedule_stage( ThenableFuture<T> &&source, no_stage &&, LaunchPolicy ) {
+            return std::move( source );
+        }
+
+        template <typename T, typename Stage, typename LaunchPolicy>
+        inline ThenableFuture<lazy_result_t<T, Stage>> schedule_stage( ThenableFuture<T> &&source, Stage &&stage, LaunchPolicy policy ) {
+            return then_as<lazy_result_t<T, Stage>>( std::move( source ), std::forward<Stage>( stage ), policy );
+        }
+    }
+
+    template <typename T, typename LaunchPolicy = std::launch>
+    inline lazy_future<T, detail::no_stage, LaunchPolicy> lazy( ThenableFuture<T> &&f, LaunchPolicy policy = default_policy );
+
+    /*
+     * lazy_future objects are move only, and each `then` consumes the one it's called on.
+     *
+     * T is the value type of the future the chain started from, and Stage is the composition of every functor since.
+     * */
+    template <typename T, typename Stage, typename LaunchPolicy>
+    class lazy_future {
+            ThenableFuture<T> _source;
+            Stage             _stage;
+            LaunchPolicy      _policy;
+
+            /*
+             * A stage that returns a future has to be scheduled before anything can be done with its value
+             * */
+            typedef detail::is_future_like<typename std::decay<detail::stage_result_t<T, Stage>>::type> ends_in_future;
+
+            template <typename Functor>
+            inline auto then_impl( Functor &&f, std::false_type ) && {
+                typedef decltype( detail::fuse_stages( std::move( _stage ), std::forward<Functor>( f ))) fused_type;
+
+                return lazy_future<T, fused_type, LaunchPolicy>( std::move( _source ), detail::fuse_stages( std::move( _stage ), std::forward<Functor>( f )), _policy );
+            }
+
+            template <typename Functor>
+            inline auto then_impl( Functor &&f, std::true_type ) && {
+                return lazy( std::move( *this ).schedule(), _policy ).then( std::forward<Functor>( f ));
+            }
+
+        public:
+            typedef detail::lazy_result_t<T, Stage> result_type;
+
+            inline lazy_future( ThenableFuture<T> &&source, Stage &&stage, LaunchPolicy policy )
+                : _source( std::move( source )), _stage( std::move( stage )), _policy( policy ) {}
+
+            lazy_future( lazy_future && ) = default;
+
+            lazy_future &operator=( lazy_future && ) = default;
+
+            /*
+             * Fuses the functor onto the end of the chain
+             * */
+            template <typename Functor>
+            inline auto then( Functor &&f ) && {
+                return std::move( *this ).then_impl( std::forward<Functor>( f ), ends_in_future());
+            }
+
+            /*
+             * Schedules the chain so far, and starts a new one under the given policy beginning with this functor
+             * */
+            template <typename Functor, typename OtherPolicy>
+            inline auto then( Functor &&f, OtherPolicy policy ) && {
+                return lazy( std::move( *this ).schedule(), policy ).then( std::forward<Functor>( f ));
+            }
+
+            /*
+             * Attaches the whole chain to the original future as a single continuation
+             * */
+            inline ThenableFuture<result_type> schedule() && {
+                return detail::schedule_stage( std::move( _source ), std::move( _stage ), _policy );
+            }
+
+            inline operator ThenableFuture<result_type>() && {
+                return std::move( *this ).schedule();
+            }
+
+            inline ThenableSharedFuture<result_type> share() && {
+                return std::move( *this ).schedule().share();
+            }
+
+            inline result_type get() && {
+                return std::move( *this ).schedule().get();
+            }
+    };
+
+    /*
+     * Starts a lazy chain from a future. Fused stages are scheduled together under the given policy.
+     * */
+    template <typename T, typename LaunchPolicy>
+    inline lazy_future<T, detail::no_stage, LaunchPolicy> lazy( ThenableFuture<T> &&f, LaunchPolicy policy ) {
+        return lazy_future<T, detail::no_stage, LaunchPolicy>( std::move( f ), detail::no_stage(), policy );
+    }
+}
+
+#endif //THENABLE_LAZY_HPP_INCLUDED
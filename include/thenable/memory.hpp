@@ -0,0 +1,159 @@
+#ifndef THENABLE_MEMORY_HPP_INCLUDED
+#define THENABLE_MEMORY_HPP_INCLUDED
+
+#include <new>
+#include <cstddef>
+#include <type_traits>
+
+/*
+ * Shared state pool
+ *
+ * Promise/future pairs are created and destroyed at a very high rate, and they all come in a handful of sizes.
+ * Rather than going through the global allocator every time, each thread keeps a few free lists of recently released blocks,
+ * grouped into size classes, so allocating a shared state is usually just popping a pointer off a list without any locking.
+ *
+ * Blocks released on a different thread than the one they were allocated on simply join the free lists of the releasing thread.
+ *
+ * Defining THENABLE_NO_STATE_POOL makes everything go straight to the global allocator instead, which is useful for leak checkers.
+ * */
+
+namespace thenable {
+    namespace detail {
+        class state_pool {
+                static constexpr std::size_t granularity = 64;
+                static constexpr std::size_t classes     = 8;
+                static constexpr std::size_t max_cached  = 256;
+
+                struct free_block {
+                    free_block *next;
+                };
+
+                /*
+                 * The cache itself is trivially destructible so it can still be looked at after its thread has started exiting,
+                 * and the guard empties it when the thread exits.
+                 * */
+                struct cache {
+                    free_block  *heads[classes];
+                    std::size_t counts[classes];
+                    bool        closed;
+                };
+
+                struct cache_guard {
+                    cache *c;
+
+                    inline ~cache_guard() {
+                        for( std::size_t i = 0; i < classes; ++i ) {
+                            while( c->heads[i] ) {
+                                free_block *block = c->heads[i];
+
+                                c->heads[i] = block->next;
+
+                                ::operator delete( block );
+                            }
+
+                            c->counts[i] = 0;
+                        }
+
+                        c->closed = true;
+                    }
+                };
+
+                static inline cache &local() noexcept {
+                    static thread_local cache       c;
+                    static thread_local cache_guard guard{&c};
+
+                    (void)guard;
+
+                    return c;
+                }
+
+            public:
+                static constexpr std::size_t max_size = granularity * classes;
+
+                static inline void *allocate( std::size_t size ) {
+#ifndef THENABLE_NO_STATE_POOL
+                    if( size != 0 && size <= max_size ) {
+                        std::size_t index = ( size - 1 ) / granularity;
+
+                        cache &c = local();
+
+                        if( c.heads[index] ) {
+                            free_block *block = c.heads[index];
+
+                            c.heads[index] = block->next;
+
+                            --c.counts[index];
+
+                            return block;
+                        }
+
+                        return ::operator new(( index + 1 ) * granularity );
+                    }
+#endif
+
+                    return ::operator new( size );
+                }
+
+                static inline void deallocate( void *p, std::size_t size ) noexcept {
+#ifndef THENABLE_NO_STATE_POOL
+                    if( size != 0 && size <= max_size ) {
+                        std::size_t index = ( size - 1 ) / granularity;
+
+                        cache &c = local();
+
+                        if( !c.closed && c.counts[index] < max_cached ) {
+                            free_block *block = static_cast<free_block *>(p);
+
+                            block->next = c.heads[index];
+
+                            c.heads[index] = block;
+
+                            ++c.counts[index];
+
+                            return;
+                        }
+                    }
+#else
+                    (void)size;
+#endif
+
+                    ::operator delete( p );
+                }
+        };
+    }
+
+    /*
+     * Standard allocator backed by the shared state pool, for anything else that is allocated as often as promises are.
+     * */
+    template <typename T>
+    struct pool_allocator {
+        typedef T value_type;
+
+        constexpr pool_allocator() noexcept = default;
+
+        template <typename U>
+        constexpr pool_allocator( const pool_allocator<U> & ) noexcept {}
+
+        inline T *allocate( std::size_t n ) {
+            static_assert( alignof( T ) <= alignof( std::max_align_t ));
+
+            return static_cast<T *>(detail::state_pool::allocate( n * sizeof( T )));
+        }
+
+        inline void deallocate( T *p, std::size_t n ) noexcept {
+            detail::state_pool::deallocate( p, n * sizeof( T ));
+        }
+
+        template <typename U>
+        constexpr bool operator==( const pool_allocator<U> & ) const noexcept {
+            return true;
+        }
+
+        template <typename U>
+        constexpr bool operator!=( const pool_allocator<U> & ) const noexcept {
+            return false;
+        }
+    };
+}
+
+#endif //THENABLE_MEMORY_HPP_INCLUDED
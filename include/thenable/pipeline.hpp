@@ -0,0 +1,737 @@
+#ifndef THENABLE_PIPELINE_HPP_INCLUDED
+#define THENABLE_PIPELINE_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * Pipelines
+ *
+ * Where `waterfall` runs a fixed chain of functors once for a single value, a pipeline runs a continuous stream of values
+ * through a chain of stages built up at runtime:
+ *
+ *     auto p = thenable::make_pipeline<record>()
+ *         .then( decode, 4 )
+ *         .then( enrich, 2 )
+ *         .then( score )
+ *         .ordered()
+ *         .build();
+ *
+ * Each stage takes the result of the stage before it, just like the functors given to `waterfall`, including tuples being unpacked
+ * into arguments and returned futures being waited on. Each one is run by its own fixed set of worker threads, as many as its degree of parallelism,
+ * so the functor is invoked concurrently from that many threads at once.
+ *
+ * Stages are connected by bounded lock-free queues. Once a queue is full, the stage feeding it waits, and so on back to `push`,
+ * so a slow stage holds back the producer rather than letting items pile up in memory.
+ *
+ * Results are popped off the end as ready ThenableFutures, so an exception thrown for one item shows up on that item alone.
+ * With `ordered()` they come out in the same order they were pushed in, otherwise in whatever order they finish.
+ * */
+
+namespace thenable {
+    namespace detail {
+        template <typename T>
+        struct pipeline_item {
+            std::size_t     seq = 0;
+            ready_result<T> result;
+        };
+
+        /*
+         * Anything a stage can hand its results to
+         * */
+        template <typename T>
+        class pipeline_sink {
+            public:
+                virtual ~pipeline_sink() = default;
+
+                /*
+                 * Waits for room if necessary, and returns false if the sink was aborted
+                 * */
+                virtual bool push( pipeline_item<T> &&item ) = 0;
+
+                virtual void close() = 0;
+        };
+
+        /*
+         * A bounded multi-producer multi-consumer queue, based on Dmitry Vyukov's array queue.
+         *
+         * Every cell has a sequence number telling producers and consumers whose turn it is, so pushing and popping are each a single
+         * compare-exchange on the position counter plus a store to the cell. Threads only fall back to the mutex and condition variable
+         * to go to sleep when the queue is full or empty, and they're only woken up if somebody is actually waiting.
+         *
+         * The pipeline input queue stamps every item with its position as it goes in, which is the order ordered() puts them back into.
+         * */
+        template <typename T>
+        class pipeline_queue final : public pipeline_sink<T> {
+                struct cell {
+                    std::atomic_size_t sequence;
+                    pipeline_item<T>   item;
+                };
+
+                std::unique_ptr<cell[]> _cells;
+                std::size_t             _mask;
+                bool                    _stamp;
+
+                alignas( 64 ) std::atomic_size_t _enqueue{0};
+                alignas( 64 ) std::atomic_size_t _dequeue{0};
+
+                std::atomic_bool        _closed{false};
+                std::atomic_bool        _aborted{false};
+                std::atomic_size_t      _pushing{0};
+                std::atomic_size_t      _waiters{0};
+                std::mutex              _mutex;
+                std::condition_variable _cv;
+
+                inline bool can_push() const noexcept {
+                    std::size_t pos = _enqueue.load( std::memory_order_relaxed );
+
+                    return _cells[pos & _mask].sequence.load( std::memory_order_acquire ) == pos;
+                }
+
+                inline bool can_pop() const noexcept {
+                    std::size_t pos = _dequeue.load( std::memory_order_relaxed );
+
+                    return _cells[pos & _mask].sequence.load( std::memory_order_acquire ) == pos + 1;
+                }
+
+                inline void wake() {
+                    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+                    if( _waiters.load( std::memory_order_relaxed ) > 0 ) {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        _cv.notify_all();
+                    }
+                }
+
+                inline bool try_push_open( pipeline_item<T> &item ) {
+                    std::size_t pos = _enqueue.load( std::memory_order_relaxed );
+
+                    while( true ) {
+                        cell &c = _cells[pos & _mask];
+
+                        std::intptr_t diff = static_cast<std::intptr_t>(c.sequence.load( std::memory_order_acquire )) - static_cast<std::intptr_t>(pos);
+
+                        if( diff == 0 ) {
+                            if( _enqueue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed )) {
+                                if( _stamp ) {
+                                    item.seq = pos;
+                                }
+
+                                c.item = std::move( item );
+
+                                c.sequence.store( pos + 1, std::memory_order_release );
+
+                                wake();
+
+                                return true;
+                            }
+
+                        } else if( diff < 0 ) {
+                            return false;
+
+                        } else {
+                            pos = _enqueue.load( std::memory_order_relaxed );
+                        }
+                    }
+                }
+
+                template <typename Predicate>
+                inline void wait( Predicate ready ) {
+                    std::unique_lock<std::mutex> lock( _mutex );
+
+                    _waiters.fetch_add( 1, std::memory_order_relaxed );
+
+                    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+                    _cv.wait( lock, ready );
+
+                    _waiters.fetch_sub( 1, std::memory_order_relaxed );
+                }
+
+            public:
+                inline explicit pipeline_queue( std::size_t capacity, bool stamp = false ) : _stamp( stamp ) {
+                    std::size_t size = 2;
+
+                    while( size < capacity ) {
+                        size <<= 1;
+                    }
+
+                    _cells.reset( new cell[size] );
+                    _mask = size - 1;
+
+                    for( std::size_t i = 0; i < size; ++i ) {
+                        _cells[i].sequence.store( i, std::memory_order_relaxed );
+                    }
+                }
+
+                /*
+                 * The item is only moved from if it was pushed. Returns false once the queue is closed.
+                 *
+                 * Pushes in progress are counted before the queue is checked for being closed, so once a consumer has seen it closed
+                 * it can wait for them to land instead of giving up on a cell that's been claimed but not filled yet.
+                 * */
+                inline bool try_push( pipeline_item<T> &item ) {
+                    _pushing.fetch_add( 1 );
+
+                    bool pushed = !_closed.load() && try_push_open( item );
+
+                    _pushing.fetch_sub( 1, std::memory_order_release );
+
+                    return pushed;
+                }
+
+                inline bool try_pop( pipeline_item<T> &item ) {
+                    std::size_t pos = _dequeue.load( std::memory_order_relaxed );
+
+                    while( true ) {
+                        cell &c = _cells[pos & _mask];
+
+                        std::intptr_t diff = static_cast<std::intptr_t>(c.sequence.load( std::memory_order_acquire )) - static_cast<std::intptr_t>(pos + 1);
+
+                        if( diff == 0 ) {
+                            if( _dequeue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed )) {
+                                item = std::move( c.item );
+
+                                c.sequence.store( pos + _mask + 1, std::memory_order_release );
+
+                                wake();
+
+                                return true;
+                            }
+
+                        } else if( diff < 0 ) {
+                            return false;
+
+                        } else {
+                            pos = _dequeue.load( std::memory_order_relaxed );
+                        }
+                    }
+                }
+
+                /*
+                 * Returns false once the queue is closed
+                 * */
+                inline bool push( pipeline_item<T> &&item ) override {
+                    while( !_closed.load( std::memory_order_acquire )) {
+                        if( try_push( item )) {
+                            return true;
+                        }
+
+                        wait( [this] {
+                            return _closed.load( std::memory_order_acquire ) || can_push();
+                        } );
+                    }
+
+                    return false;
+                }
+
+                /*
+                 * Returns false once the queue is closed and empty, or as soon as it's aborted
+                 * */
+                inline bool pop( pipeline_item<T> &item ) {
+                    while( !_aborted.load( std::memory_order_acquire )) {
+                        if( try_pop( item )) {
+                            return true;
+                        }
+
+                        if( _closed.load()) {
+                            //Anything still being pushed claimed its cell before the queue was closed, so it goes out too
+                            while( _pushing.load() > 0 ) {
+                                std::this_thread::yield();
+                            }
+
+                            return try_pop( item );
+                        }
+
+                        wait( [this] {
+                            return _closed.load( std::memory_order_acquire ) || can_pop();
+                        } );
+                    }
+
+                    return false;
+                }
+
+                inline void close() override {
+                    _closed.store( true );
+
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    _cv.notify_all();
+                }
+
+                /*
+                 * Like close, but anything still in the queue is abandoned
+                 * */
+                inline void abort() {
+                    _aborted.store( true, std::memory_order_release );
+
+                    close();
+                }
+        };
+
+        /*
+         * Bounds how far ahead of the oldest unfinished item an ordered pipeline can get.
+         *
+         * The first stage waits here before starting on an item that's `capacity` or more ahead of the next one the reorder sink is waiting for,
+         * so no more than that many results are ever held back for reordering. Waiting at the first stage rather than the last one means
+         * the item everything is waiting for is always already past it, and the queues in between can never fill up in front of it.
+         * */
+        class pipeline_window {
+                std::size_t             _capacity;
+                std::atomic_size_t      _next{0};
+                std::atomic_bool        _aborted{false};
+                std::atomic_size_t      _waiters{0};
+                std::mutex              _mutex;
+                std::condition_variable _cv;
+
+                inline bool open( std::size_t seq ) const noexcept {
+                    return seq < _next.load( std::memory_order_acquire ) + _capacity;
+                }
+
+                inline void wake() {
+                    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+                    if( _waiters.load( std::memory_order_relaxed ) > 0 ) {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        _cv.notify_all();
+                    }
+                }
+
+            public:
+                inline explicit pipeline_window( std::size_t capacity ) : _capacity( std::max<std::size_t>( capacity, 1 )) {}
+
+                /*
+                 * Returns false if the pipeline was aborted while waiting
+                 * */
+                inline bool wait( std::size_t seq ) {
+                    if( open( seq )) {
+                        return true;
+                    }
+
+                    std::unique_lock<std::mutex> lock( _mutex );
+
+                    _waiters.fetch_add( 1, std::memory_order_relaxed );
+
+                    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+                    _cv.wait( lock, [this, seq] {
+                        return _aborted.load( std::memory_order_acquire ) || open( seq );
+                    } );
+
+                    _waiters.fetch_sub( 1, std::memory_order_relaxed );
+
+                    return !_aborted.load( std::memory_order_acquire );
+                }
+
+                inline void advance( std::size_t next ) {
+                    _next.store( next, std::memory_order_release );
+
+                    wake();
+                }
+
+                inline void abort() {
+                    _aborted.store( true, std::memory_order_release );
+
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    _cv.notify_all();
+                }
+        };
+
+        /*
+         * Puts the results of the last stage back into the order they were pushed in before they go into the output queue
+         * */
+        template <typename T>
+        class pipeline_reorder_sink final : public pipeline_sink<T> {
+                std::shared_ptr<pipeline_queue<T>>         _output;
+                std::shared_ptr<pipeline_window>           _window;
+                std::mutex                                 _mutex;
+                std::map<std::size_t, pipeline_item<T>>    _pending;
+                std::size_t                                _next = 0;
+
+            public:
+                inline pipeline_reorder_sink( std::shared_ptr<pipeline_queue<T>> output, std::shared_ptr<pipeline_window> window )
+                    : _output( std::move( output )), _window( std::move( window )) {}
+
+                inline bool push( pipeline_item<T> &&item ) override {
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    if( item.seq != _next ) {
+                        _pending.emplace( item.seq, std::move( item ));
+
+                        return true;
+                    }
+
+                    if( !_output->push( std::move( item ))) {
+                        return false;
+                    }
+
+                    ++_next;
+
+                    for( auto it = _pending.begin(); it != _pending.end() && it->first == _next; it = _pending.erase( it ), ++_next ) {
+                        if( !_output->push( std::move( it->second ))) {
+                            return false;
+                        }
+                    }
+
+                    _window->advance( _next );
+
+                    return true;
+                }
+
+                /*
+                 * Anything left over was pushed after the input was closed, so it just goes out in order
+                 * */
+                inline void close() override {
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        for( auto &pending : _pending ) {
+                            if( !_output->push( std::move( pending.second ))) {
+                                break;
+                            }
+                        }
+
+                        _pending.clear();
+                    }
+
+                    _output->close();
+                }
+        };
+
+        //////////
+
+        class pipeline_stage_base {
+            public:
+                virtual ~pipeline_stage_base() = default;
+
+                virtual void start() = 0;
+
+                /*
+                 * Makes the stage wait for room in the reorder window before starting on each item
+                 * */
+                virtual void limit( std::shared_ptr<pipeline_window> window ) = 0;
+
+                virtual void abort() = 0;
+
+                virtual void join() = 0;
+        };
+
+        /*
+         * A stage owns its input queue and worker threads. The last worker to run out of input closes whatever comes after it,
+         * so closing the pipeline input ripples through every stage once they've finished what they already have.
+         * */
+        template <typename T, typename R, typename Functor>
+        class pipeline_stage final : public pipeline_stage_base {
+                Functor                            _f;
+                std::size_t                        _parallelism;
+                std::shared_ptr<pipeline_queue<T>> _input;
+                std::shared_ptr<pipeline_sink<R>>  _output;
+                std::shared_ptr<pipeline_window>   _window;
+                std::vector<std::thread>           _threads;
+                std::atomic_size_t                 _live{0};
+
+                inline void work() {
+                    pipeline_item<T> item;
+
+                    while( _input->pop( item )) {
+                        if( _window && !_window->wait( item.seq )) {
+                            break;
+                        }
+
+                        pipeline_item<R> out;
+
+                        out.seq = item.seq;
+
+                        ThenableFuture<R> f = ready_dispatcher<T>::template dispatch<R>( item.result, _f );
+
+                        ready_result<R> &ready = state_access::ready( f );
+
+                        if( !ready.empty()) {
+                            out.result = std::move( ready );
+
+                        } else {
+                            state_ptr<shared_state<R>> s = state_access::release( f );
+
+                            load_result( out.result, *s );
+                        }
+
+                        if( !_output->push( std::move( out ))) {
+                            break;
+                        }
+                    }
+
+                    if( _live.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+                        _output->close();
+                    }
+                }
+
+            public:
+                template <typename F>
+                inline pipeline_stage( F &&f, std::size_t parallelism, std::shared_ptr<pipeline_queue<T>> input )
+                    : _f( std::forward<F>( f )), _parallelism( std::max<std::size_t>( parallelism, 1 )), _input( std::move( input )) {}
+
+                inline void connect( std::shared_ptr<pipeline_sink<R>> output ) {
+                    _output = std::move( output );
+                }
+
+                inline void start() override {
+                    _live.store( _parallelism, std::memory_order_relaxed );
+
+                    for( std::size_t i = 0; i < _parallelism; ++i ) {
+                        _threads.emplace_back( [this] {
+                            work();
+                        } );
+                    }
+                }
+
+                inline void limit( std::shared_ptr<pipeline_window> window ) override {
+                    _window = std::move( window );
+                }
+
+                inline void abort() override {
+                    _input->abort();
+
+                    if( _window ) {
+                        _window->abort();
+                    }
+                }
+
+                inline void join() override {
+                    for( std::thread &thread : _threads ) {
+                        thread.join();
+                    }
+
+                    _threads.clear();
+                }
+        };
+
+        template <typename In, typename Out>
+        struct pipeline_state {
+            std::shared_ptr<pipeline_queue<In>>               input;
+            std::shared_ptr<pipeline_queue<Out>>              output;
+            std::vector<std::unique_ptr<pipeline_stage_base>> stages;
+
+            inline pipeline_state( std::shared_ptr<pipeline_queue<In>> i, std::shared_ptr<pipeline_queue<Out>> o,
+                                   std::vector<std::unique_ptr<pipeline_stage_base>> &&s )
+                : input( std::move( i )), output( std::move( o )), stages( std::move( s )) {
+                for( auto &stage : stages ) {
+                    stage->start();
+                }
+            }
+
+            /*
+             * Nobody can pop the results anymore, so everything still in flight is abandoned
+             * */
+            inline ~pipeline_state() {
+                output->abort();
+
+                for( auto &stage : stages ) {
+                    stage->abort();
+                }
+
+                for( auto &stage : stages ) {
+                    stage->join();
+                }
+            }
+        };
+
+        /*
+         * The first queue created becomes the pipeline input, which can only happen while the input and output types are still the same
+         * */
+        template <typename T>
+        inline void attach_pipeline_input( std::shared_ptr<pipeline_queue<T>> &input, const std::shared_ptr<pipeline_queue<T>> &queue ) {
+            input = queue;
+        }
+
+        template <typename T, typename U>
+        inline void attach_pipeline_input( std::shared_ptr<pipeline_queue<T>> &, const std::shared_ptr<pipeline_queue<U>> & ) {}
+    }
+
+    template <typename In, typename Out = In>
+    class pipeline;
+
+    template <typename In, typename Out = In>
+    class pipeline_builder;
+
+    /*
+     * Starts building a pipeline taking values of type In. Every queue between the stages holds up to `capacity` items.
+     * */
+    template <typename In>
+    inline pipeline_builder<In> make_pipeline( std::size_t capacity = 1024 ) {
+        return pipeline_builder<In>( capacity );
+    }
+
+    template <typename In, typename Out>
+    class pipeline_builder {
+            template <typename, typename>
+            friend class pipeline_builder;
+
+            std::size_t                                                            _capacity;
+            bool                                                                   _ordered = false;
+            std::shared_ptr<detail::pipeline_queue<In>>                            _input;
+            std::vector<std::unique_ptr<detail::pipeline_stage_base>>             _stages;
+            unique_function<void( std::shared_ptr<detail::pipeline_sink<Out>> )> _connect;
+
+        public:
+            inline explicit pipeline_builder( std::size_t capacity ) : _capacity( capacity ) {}
+
+            /*
+             * Adds a stage that runs the functor on up to `parallelism` items at once
+             * */
+            template <typename Functor>
+            pipeline_builder<In, implicit_result_of<typename std::decay<Functor>::type, std::future<Out>>> then( Functor &&f, std::size_t parallelism = 1 ) && {
+                typedef typename std::decay<Functor>::type                  F;
+                typedef implicit_result_of<F, std::future<Out>>             R;
+                typedef detail::pipeline_stage<Out, R, F>                   stage_type;
+
+                auto queue = std::make_shared<detail::pipeline_queue<Out>>( _capacity, _stages.empty());
+                auto stage = std::make_unique<stage_type>( std::forward<Functor>( f ), parallelism, queue );
+
+                if( _connect ) {
+                    _connect( std::move( queue ));
+
+                } else {
+                    detail::attach_pipeline_input( _input, queue );
+                }
+
+                pipeline_builder<In, R> next( _capacity );
+
+                next._ordered = _ordered;
+                next._input   = std::move( _input );
+                next._stages  = std::move( _stages );
+                next._connect = [s = stage.get()]( std::shared_ptr<detail::pipeline_sink<R>> sink ) {
+                    s->connect( std::move( sink ));
+                };
+
+                next._stages.push_back( std::move( stage ));
+
+                return next;
+            }
+
+            /*
+             * Results come out in the same order their inputs were pushed in, rather than in whatever order they finish.
+             * No more than `capacity` items past the oldest unfinished one are started, so a slow item holds back the rest
+             * instead of letting finished results pile up behind it.
+             * */
+            inline pipeline_builder &&ordered() && {
+                _ordered = true;
+
+                return std::move( *this );
+            }
+
+            /*
+             * Starts the worker threads of every stage
+             * */
+            pipeline<In, Out> build() && {
+                auto output = std::make_shared<detail::pipeline_queue<Out>>( _capacity, _stages.empty());
+
+                if( !_connect ) {
+                    detail::attach_pipeline_input( _input, output );
+
+                } else if( _ordered ) {
+                    auto window = std::make_shared<detail::pipeline_window>( _capacity );
+
+                    _stages.front()->limit( window );
+
+                    _connect( std::make_shared<detail::pipeline_reorder_sink<Out>>( output, std::move( window )));
+
+                } else {
+                    _connect( output );
+                }
+
+                return pipeline<In, Out>( std::make_shared<detail::pipeline_state<In, Out>>( std::move( _input ), std::move( output ), std::move( _stages )));
+            }
+    };
+
+    /*
+     * A running pipeline. These are handles, so a producer and a consumer can each hold one.
+     * When the last handle is destroyed, anything that hasn't been popped yet is dropped and the worker threads are joined.
+     * */
+    template <typename In, typename Out>
+    class pipeline {
+            template <typename, typename>
+            friend class pipeline_builder;
+
+            std::shared_ptr<detail::pipeline_state<In, Out>> _state;
+
+            inline explicit pipeline( std::shared_ptr<detail::pipeline_state<In, Out>> state ) : _state( std::move( state )) {}
+
+            static inline ThenableFuture<Out> to_future( detail::pipeline_item<Out> &item ) {
+                return detail::state_access::make_ready( std::move( item.result ));
+            }
+
+        public:
+            /*
+             * Waits while the first stage is full. Returns false if the pipeline has been closed.
+             * */
+            inline bool push( In value ) {
+                detail::pipeline_item<In> item;
+
+                item.result.set_value( std::move( value ));
+
+                return _state->input->push( std::move( item ));
+            }
+
+            /*
+             * Returns false without waiting if the first stage is full or the pipeline has been closed, and leaves the value alone
+             * */
+            inline bool try_push( In &value ) {
+                detail::pipeline_item<In> item;
+
+                item.result.set_value( std::move( value ));
+
+                if( _state->input->try_push( item )) {
+                    return true;
+                }
+
+                value = std::move( *item.result.value );
+
+                return false;
+            }
+
+            /*
+             * No more values can be pushed. Whatever is already in the pipeline still runs through to the end.
+             * */
+            inline void close() {
+                _state->input->close();
+            }
+
+            /*
+             * Waits for the next result, or returns nothing once the pipeline has been closed and every result has been popped
+             * */
+            inline std::optional<ThenableFuture<Out>> pop() {
+                detail::pipeline_item<Out> item;
+
+                if( _state->output->pop( item )) {
+                    return to_future( item );
+                }
+
+                return std::nullopt;
+            }
+
+            inline std::optional<ThenableFuture<Out>> try_pop() {
+                detail::pipeline_item<Out> item;
+
+                if( _state->output->try_pop( item )) {
+                    return to_future( item );
+                }
+
+                return std::nullopt;
+            }
+    };
+}
+
+#endif //THENABLE_PIPELINE_HPP_INCLUDED
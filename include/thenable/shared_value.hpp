@@ -0,0 +1,126 @@
+#ifndef THENABLE_SHARED_VALUE_HPP_INCLUDED
+#define THENABLE_SHARED_VALUE_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <type_traits>
+#include <utility>
+
+/*
+ * Zero-copy fan-out
+ *
+ * The value of a ThenableSharedFuture is stored once, in its shared state, and `then` passes each continuation a const reference to it.
+ * A continuation that takes the value by reference never copies it, but one that takes it by value, or keeps it around after returning,
+ * copies the whole thing once per continuation.
+ *
+ * A shared_value is an immutable, reference counted handle to the value inside the shared state. Copying one only bumps the reference count
+ * of the state, so any number of them can be handed out and kept for as long as needed while the value itself is never copied or moved.
+ *
+ * `then_shared` attaches a continuation to a shared future that's given a shared_value instead of a reference,
+ * and `get_shared` waits for one like `get()`.
+ * */
+
+namespace thenable {
+    template <typename T>
+    class shared_value {
+            static_assert( !std::is_void<T>::value && !std::is_reference<T>::value, "shared_value only refers to stored values" );
+
+            friend struct detail::state_access;
+
+            detail::state_ptr<detail::shared_state<T>> _state;
+            const T                                     *_value = nullptr;
+
+            /*
+             * The state must already be complete with a value
+             * */
+            inline explicit shared_value( detail::state_ptr<detail::shared_state<T>> &&s )
+                : _state( std::move( s )), _value( &_state->get()) {}
+
+        public:
+            typedef T element_type;
+
+            shared_value() = default;
+
+            shared_value( const shared_value & ) = default;
+
+            shared_value &operator=( const shared_value & ) = default;
+
+            inline shared_value( shared_value &&other ) noexcept
+                : _state( std::move( other._state )), _value( other._value ) {
+                other._value = nullptr;
+            }
+
+            inline shared_value &operator=( shared_value &&other ) noexcept {
+                _state       = std::move( other._state );
+                _value       = other._value;
+                other._value = nullptr;
+
+                return *this;
+            }
+
+            inline const T &get() const noexcept {
+                return *_value;
+            }
+
+            inline const T &operator*() const noexcept {
+                return *_value;
+            }
+
+            inline const T *operator->() const noexcept {
+                return _value;
+            }
+
+            inline explicit operator bool() const noexcept {
+                return _value != nullptr;
+            }
+    };
+
+    namespace detail {
+        template <typename T, typename Functor>
+        using shared_value_result_t = typename recursive_get_future_type<typename std::decay<decltype( invoke_unpacked( std::declval<Functor &>(), std::declval<shared_value<T>>()))>::type>::type;
+    }
+
+    /*
+     * Waits for the shared future like get(), and returns a handle to its value instead of a reference
+     * */
+    template <typename T>
+    inline shared_value<T> get_shared( const ThenableSharedFuture<T> &s ) {
+        s.get();
+
+        return detail::state_access::make<shared_value<T>>( detail::state_ptr<detail::shared_state<T>>( detail::state_access::state( s )));
+    }
+
+    /*
+     * Like `then` on a shared future, except the functor is given a shared_value handle to the value,
+     * so it can keep the value for as long as it likes without ever copying it.
+     *
+     * If the shared future fails, the functor isn't called and the resulting future gets the exception.
+     * */
+    template <typename T, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<detail::shared_value_result_t<T, Functor>> then_shared( const ThenableSharedFuture<T> &s, Functor &&f, LaunchPolicy policy = default_policy ) {
+        typedef detail::shared_value_result_t<T, Functor> R;
+
+        detail::state_ptr<detail::shared_state<T>> src = detail::state_access::state( s );
+
+        detail::check_state( src );
+
+        auto dest = detail::make_state<R>();
+
+        detail::shared_state<T> &state = *src;
+
+        detail::schedule_continuation( state, dest, [src2 = std::move( src ), f2 = std::forward<Functor>( f )]( const detail::state_ptr<detail::shared_state<R>> &d ) mutable {
+            try {
+                src2->get();
+
+                detail::invoke_into( d, std::move( f2 ), detail::state_access::make<shared_value<T>>( detail::state_ptr<detail::shared_state<T>>( src2 )));
+
+            } catch( ... ) {
+                d->set_exception( std::current_exception());
+            }
+        }, policy );
+
+        return detail::state_access::make<ThenableFuture<R>>( std::move( dest ));
+    }
+}
+
+#endif //THENABLE_SHARED_VALUE_HPP_INCLUDED
@@ -0,0 +1,758 @@
+#ifndef THENABLE_STREAM_HPP_INCLUDED
+#define THENABLE_STREAM_HPP_INCLUDED
+
+#include <thenable/thenable.hpp>
+
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Streams
+ *
+ * A ThenableFuture delivers exactly one value. A ThenableStream delivers any number of them, like pages of a paginated query
+ * or chunks of a download, without a new promise and continuation for each one.
+ *
+ * A ThenableStreamWriter pushes values into a bounded buffer, and the ThenableStream it hands out reads them:
+ *
+ *     thenable::ThenableStreamWriter<page> w( 16 );
+ *
+ *     ThenableFuture<std::size_t> total = w.get_stream()
+ *         .filter( []( const page &p ) { return !p.empty(); } )
+ *         .map( []( page p ) { return p.size(); } )
+ *         .reduce( std::size_t( 0 ), []( std::size_t n, std::size_t size ) { return n + size; } );
+ *
+ *     w.push( fetch_page( 0 ));
+ *     ...
+ *     w.close();
+ *
+ * `map`, `filter` and `batch` each return a new stream with its own buffer, and `for_each` and `reduce` end the stream
+ * with a ThenableFuture that resolves once the writer closes it. Each stage drains the buffer before it on an executor,
+ * by default default_executor(), taking whatever items are there at once. Nothing waits on an empty buffer.
+ * A stage is only ever run by one thread at a time, so items go through it in order and its functor needs no locking of its own.
+ *
+ * Every buffer holds up to its capacity. `push` returns a future that's ready right away while there's room, otherwise once the stage
+ * reading it has caught up, and stages wait on the stage after them the same way without blocking a thread. A buffer takes at most one item
+ * past its capacity: pushing again while an earlier push is still waiting for room throws a std::length_error instead of growing the buffer,
+ * so a producer can't get more than a buffer's worth ahead of the slowest stage whether it waits or not. `try_push` never goes past capacity,
+ * and just returns false while the buffer is full.
+ *
+ * If a functor throws, or the writer fails the stream with set_exception, the exception ends up in the terminal future,
+ * and everything upstream is abandoned. Later pushes then fail with a broken_promise error, as do pushes
+ * to a stream that's destroyed without being read.
+ * */
+
+namespace thenable {
+    template <typename T>
+    class ThenableStream;
+
+    template <typename T>
+    class ThenableStreamWriter;
+
+    namespace detail {
+        inline std::exception_ptr make_broken_stream_exception() {
+            return std::make_exception_ptr( std::future_error( std::future_errc::broken_promise ));
+        }
+
+        /*
+         * Whatever reads from a stream_state. It's told when the state has something to read again after running dry.
+         * */
+        class stream_consumer {
+            public:
+                virtual ~stream_consumer() = default;
+
+                virtual void readable() = 0;
+        };
+
+        /*
+         * The buffer between a writer, or a stage, and the stage reading from it.
+         *
+         * push only returns a ready future while the buffer is within its capacity. Past that it accepts one more item,
+         * and returns a future for when the consumer has taken enough to bring it within capacity. Until then further pushes are refused.
+         * */
+        template <typename T>
+        class stream_state {
+                std::mutex                        _mutex;
+                std::deque<T>                     _items;
+                std::deque<ThenablePromise<void>> _waiting;
+                std::size_t                       _capacity;
+                bool                              _closed    = false;
+                bool                              _abandoned = false;
+                bool                              _idle      = false;
+                std::exception_ptr                _error;
+                std::shared_ptr<stream_consumer>  _consumer;
+
+                /*
+                 * With the lock held, returns the consumer if it's waiting to be told about new items
+                 * */
+                inline std::shared_ptr<stream_consumer> wake() {
+                    if( !_idle ) {
+                        return nullptr;
+                    }
+
+                    _idle = false;
+
+                    return _consumer;
+                }
+
+            public:
+                inline explicit stream_state( std::size_t capacity ) : _capacity( capacity > 0 ? capacity : 1 ) {}
+
+                inline std::size_t capacity() const noexcept {
+                    return _capacity;
+                }
+
+                template <typename U>
+                inline ThenableFuture<void> push( U &&value ) {
+                    std::shared_ptr<stream_consumer> consumer;
+                    ThenableFuture<void>             room;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( _closed ) {
+                            throw std::future_error( std::future_errc::promise_already_satisfied );
+                        }
+
+                        if( _abandoned ) {
+                            return make_exceptional_future<void>( make_broken_stream_exception());
+                        }
+
+                        if( !_waiting.empty()) {
+                            throw std::length_error( "stream pushed to while waiting for room" );
+                        }
+
+                        _items.emplace_back( std::forward<U>( value ));
+
+                        if( _items.size() <= _capacity ) {
+                            room = make_ready_future();
+
+                        } else {
+                            _waiting.emplace_back();
+
+                            room = _waiting.back().get_future();
+                        }
+
+                        consumer = wake();
+                    }
+
+                    if( consumer ) {
+                        consumer->readable();
+                    }
+
+                    return room;
+                }
+
+                /*
+                 * Returns false without taking the value if the buffer is full
+                 * */
+                inline bool try_push( T &value ) {
+                    std::shared_ptr<stream_consumer> consumer;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( _closed ) {
+                            throw std::future_error( std::future_errc::promise_already_satisfied );
+                        }
+
+                        if( _abandoned ) {
+                            throw std::future_error( std::future_errc::broken_promise );
+                        }
+
+                        if( _items.size() >= _capacity ) {
+                            return false;
+                        }
+
+                        _items.emplace_back( std::move( value ));
+
+                        consumer = wake();
+                    }
+
+                    if( consumer ) {
+                        consumer->readable();
+                    }
+
+                    return true;
+                }
+
+                /*
+                 * Ends the stream once the consumer has read what's already there, with the given exception if there is one
+                 * */
+                inline void close( std::exception_ptr error = nullptr ) {
+                    std::shared_ptr<stream_consumer> consumer;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( _closed ) {
+                            return;
+                        }
+
+                        _closed = true;
+                        _error  = error;
+
+                        consumer = wake();
+                    }
+
+                    if( consumer ) {
+                        consumer->readable();
+                    }
+                }
+
+                /*
+                 * Sets the consumer and tells it to start reading
+                 * */
+                inline void attach( std::shared_ptr<stream_consumer> consumer ) {
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        _consumer = consumer;
+                    }
+
+                    consumer->readable();
+                }
+
+                /*
+                 * Moves up to max items into out. If there weren't any, either done is set because the stream has ended,
+                 * or the consumer is told once there's something to read.
+                 * */
+                inline void take( std::vector<T> &out, std::size_t max, bool &done, std::exception_ptr &error ) {
+                    std::vector<ThenablePromise<void>> ready;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        while( !_items.empty() && out.size() < max ) {
+                            out.push_back( std::move( _items.front()));
+
+                            _items.pop_front();
+                        }
+
+                        //Waiting items are the last ones in the buffer, so the first of them is within capacity once enough before it have been taken
+                        while( !_waiting.empty() && _items.size() < _capacity + _waiting.size()) {
+                            ready.push_back( std::move( _waiting.front()));
+
+                            _waiting.pop_front();
+                        }
+
+                        if( out.empty()) {
+                            if( _closed ) {
+                                done  = true;
+                                error = _error;
+
+                                _consumer.reset();
+
+                            } else {
+                                _idle = true;
+                            }
+                        }
+                    }
+
+                    for( ThenablePromise<void> &p : ready ) {
+                        p.set_value();
+                    }
+                }
+
+                /*
+                 * Drops everything, and fails any push waiting for room and every push after this
+                 * */
+                inline void abandon() {
+                    std::deque<ThenablePromise<void>> waiting;
+                    std::deque<T>                     items;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        _abandoned = true;
+
+                        std::swap( waiting, _waiting );
+                        std::swap( items, _items );
+
+                        _consumer.reset();
+                    }
+
+                    for( ThenablePromise<void> &p : waiting ) {
+                        p.set_exception( make_broken_stream_exception());
+                    }
+                }
+        };
+
+        //////////
+
+        /*
+         * A stream_pump drains a stream_state into a sink on the given launch policy.
+         *
+         * The sink's put returns a future for when it has room for more. If that isn't ready the pump stops, and picks up where it left off
+         * once it is, so a full buffer downstream holds back this stage without occupying a thread.
+         *
+         * The pump is only ever scheduled by one thing at a time, either the source having something to read again or the sink having room,
+         * so it never runs on two threads at once.
+         * */
+        template <typename T, typename Sink, typename LaunchPolicy>
+        class stream_pump final : public stream_consumer, public std::enable_shared_from_this<stream_pump<T, Sink, LaunchPolicy>> {
+                static constexpr std::size_t chunk_size = 64;
+
+                std::shared_ptr<stream_state<T>> _source;
+                Sink                             _sink;
+                LaunchPolicy                     _policy;
+                std::vector<T>                   _chunk;
+                std::size_t                      _next = 0;
+
+                inline void fail( std::exception_ptr error ) {
+                    _source->abandon();
+                    _sink.finish( error );
+                }
+
+                inline void run() {
+                    try {
+                        while( true ) {
+                            while( _next < _chunk.size()) {
+                                ThenableFuture<void> room = _sink.put( std::move( _chunk[_next++] ));
+
+                                if( !room.is_ready()) {
+                                    state_ptr<shared_state<void>> s     = state_access::release( room );
+                                    shared_state<void>            &state = *s;
+
+                                    state.add_continuation( [self = this->shared_from_this(), s2 = std::move( s )]() THENABLE_NOEXCEPT {
+                                        self->readable();
+                                    } );
+
+                                    return;
+                                }
+
+                                room.get();
+                            }
+
+                            _chunk.clear();
+                            _next = 0;
+
+                            bool               done = false;
+                            std::exception_ptr error;
+
+                            _source->take( _chunk, chunk_size, done, error );
+
+                            if( done ) {
+                                _sink.finish( error );
+
+                                return;
+                            }
+
+                            if( _chunk.empty()) {
+                                return;
+                            }
+                        }
+
+                    } catch( ... ) {
+                        fail( std::current_exception());
+                    }
+                }
+
+            public:
+                template <typename S>
+                inline stream_pump( std::shared_ptr<stream_state<T>> source, S &&sink, LaunchPolicy policy )
+                    : _source( std::move( source )), _sink( std::forward<S>( sink )), _policy( policy ) {}
+
+                inline void readable() override {
+                    try {
+                        launch_detached( _policy, [self = this->shared_from_this()]() mutable {
+                            self->run();
+                        } );
+
+                    } catch( ... ) {
+                        fail( std::current_exception());
+                    }
+                }
+
+                inline void start() {
+                    _source->attach( this->shared_from_this());
+                }
+        };
+
+        //////////
+
+        /*
+         * Sinks for each combinator. put takes each item in turn and returns a future for when there's room for the next one,
+         * and finish is called once with the exception the stream ended with, if any.
+         * */
+
+        template <typename R, typename Functor>
+        struct stream_map_sink {
+            Functor                          f;
+            std::shared_ptr<stream_state<R>> dest;
+
+            template <typename T>
+            inline ThenableFuture<void> put( T &&value ) {
+                return dest->push( invoke_unpacked( f, std::forward<T>( value )));
+            }
+
+            inline void finish( std::exception_ptr error ) {
+                dest->close( error );
+            }
+        };
+
+        template <typename T, typename Predicate>
+        struct stream_filter_sink {
+            Predicate                        pred;
+            std::shared_ptr<stream_state<T>> dest;
+
+            inline ThenableFuture<void> put( T &&value ) {
+                if( !pred( static_cast<const T &>(value))) {
+                    return make_ready_future();
+                }
+
+                return dest->push( std::move( value ));
+            }
+
+            inline void finish( std::exception_ptr error ) {
+                dest->close( error );
+            }
+        };
+
+        template <typename T>
+        struct stream_batch_sink {
+            std::size_t                                   size;
+            std::vector<T>                                pending;
+            std::shared_ptr<stream_state<std::vector<T>>> dest;
+
+            inline ThenableFuture<void> put( T &&value ) {
+                pending.push_back( std::move( value ));
+
+                if( pending.size() < size ) {
+                    return make_ready_future();
+                }
+
+                std::vector<T> full;
+
+                full.reserve( size );
+
+                std::swap( full, pending );
+
+                return dest->push( std::move( full ));
+            }
+
+            /*
+             * A partial batch left at the end still goes out, unless the stream failed
+             * */
+            inline void finish( std::exception_ptr error ) {
+                if( !error && !pending.empty()) {
+                    try {
+                        dest->push( std::move( pending ));
+
+                    } catch( ... ) {
+                        error = std::current_exception();
+                    }
+                }
+
+                dest->close( error );
+            }
+        };
+
+        template <typename Functor>
+        struct stream_for_each_sink {
+            Functor                       f;
+            state_ptr<shared_state<void>> dest;
+
+            template <typename T>
+            inline ThenableFuture<void> put( T &&value ) {
+                invoke_unpacked( f, std::forward<T>( value ));
+
+                return make_ready_future();
+            }
+
+            inline void finish( std::exception_ptr error ) {
+                if( error ) {
+                    dest->set_exception( error );
+
+                } else {
+                    dest->set_value();
+                }
+            }
+        };
+
+        template <typename R, typename Functor>
+        struct stream_reduce_sink {
+            Functor                    f;
+            std::optional<R>           acc;
+            state_ptr<shared_state<R>> dest;
+
+            template <typename T>
+            inline ThenableFuture<void> put( T &&value ) {
+                acc.emplace( f( std::move( *acc ), std::forward<T>( value )));
+
+                return make_ready_future();
+            }
+
+            inline void finish( std::exception_ptr error ) {
+                if( error ) {
+                    dest->set_exception( error );
+
+                } else {
+                    dest->set_value( std::move( *acc ));
+                }
+            }
+        };
+
+        template <typename T, typename Functor>
+        using stream_map_result_t = typename std::decay<decltype( invoke_unpacked( std::declval<Functor &>(), std::declval<T>()))>::type;
+    }
+
+    //////////
+
+    /*
+     * The reading end of a stream. Streams are move only, and each combinator consumes the one it's called on.
+     *
+     * Destroying a stream that hasn't been consumed abandons it, so the writer's pushes fail instead of waiting forever.
+     * */
+    template <typename T>
+    class ThenableStream {
+            friend class ThenableStreamWriter<T>;
+
+            template <typename>
+            friend class ThenableStream;
+
+            typedef detail::stream_state<T> state_type;
+
+            std::shared_ptr<state_type> _state;
+
+            inline explicit ThenableStream( std::shared_ptr<state_type> s ) noexcept : _state( std::move( s )) {}
+
+            template <typename Sink, typename LaunchPolicy>
+            inline void consume( Sink &&sink, LaunchPolicy policy ) {
+                typedef detail::stream_pump<T, typename std::decay<Sink>::type, LaunchPolicy> pump_type;
+
+                if( !_state ) {
+                    throw std::future_error( std::future_errc::no_state );
+                }
+
+                auto pump = std::make_shared<pump_type>( std::move( _state ), std::forward<Sink>( sink ), policy );
+
+                pump->start();
+            }
+
+            /*
+             * A new stream to feed from this one, with the same capacity
+             * */
+            template <typename U>
+            inline std::shared_ptr<detail::stream_state<U>> make_next() const {
+                if( !_state ) {
+                    throw std::future_error( std::future_errc::no_state );
+                }
+
+                return std::make_shared<detail::stream_state<U>>( _state->capacity());
+            }
+
+        public:
+            typedef T value_type;
+
+            ThenableStream() = default;
+
+            ThenableStream( ThenableStream && ) = default;
+
+            inline ThenableStream &operator=( ThenableStream &&other ) {
+                if( this != &other ) {
+                    if( _state ) {
+                        _state->abandon();
+                    }
+
+                    _state = std::move( other._state );
+                }
+
+                return *this;
+            }
+
+            ThenableStream( const ThenableStream & ) = delete;
+
+            ThenableStream &operator=( const ThenableStream & ) = delete;
+
+            inline ~ThenableStream() {
+                if( _state ) {
+                    _state->abandon();
+                }
+            }
+
+            inline bool valid() const noexcept {
+                return static_cast<bool>(_state);
+            }
+
+            /*
+             * A stream of the results of calling the functor with each item
+             * */
+            template <typename Functor, typename LaunchPolicy = work_stealing_pool>
+            inline ThenableStream<detail::stream_map_result_t<T, Functor>> map( Functor &&f, LaunchPolicy policy = default_executor()) && {
+                typedef detail::stream_map_result_t<T, Functor> R;
+
+                auto next = make_next<R>();
+
+                consume( detail::stream_map_sink<R, typename std::decay<Functor>::type>{std::forward<Functor>( f ), next}, policy );
+
+                return ThenableStream<R>( std::move( next ));
+            }
+
+            /*
+             * A stream of only the items the predicate returns true for
+             * */
+            template <typename Predicate, typename LaunchPolicy = work_stealing_pool>
+            inline ThenableStream<T> filter( Predicate &&pred, LaunchPolicy policy = default_executor()) && {
+                auto next = make_next<T>();
+
+                consume( detail::stream_filter_sink<T, typename std::decay<Predicate>::type>{std::forward<Predicate>( pred ), next}, policy );
+
+                return ThenableStream<T>( std::move( next ));
+            }
+
+            /*
+             * A stream of vectors of n items each, except the last one which gets whatever is left
+             * */
+            template <typename LaunchPolicy = work_stealing_pool>
+            inline ThenableStream<std::vector<T>> batch( std::size_t n, LaunchPolicy policy = default_executor()) && {
+                auto next = make_next<std::vector<T>>();
+
+                n = n > 0 ? n : 1;
+
+                detail::stream_batch_sink<T> sink{n, std::vector<T>(), next};
+
+                sink.pending.reserve( n );
+
+                consume( std::move( sink ), policy );
+
+                return ThenableStream<std::vector<T>>( std::move( next ));
+            }
+
+            /*
+             * Calls the functor with each item, and resolves once the stream ends
+             * */
+            template <typename Functor, typename LaunchPolicy = work_stealing_pool>
+            inline ThenableFuture<void> for_each( Functor &&f, LaunchPolicy policy = default_executor()) && {
+                auto dest = detail::make_state<void>();
+
+                auto result = detail::state_access::make<ThenableFuture<void>>( detail::state_ptr<detail::shared_state<void>>( dest ));
+
+                consume( detail::stream_for_each_sink<typename std::decay<Functor>::type>{std::forward<Functor>( f ), std::move( dest )}, policy );
+
+                return result;
+            }
+
+            /*
+             * Folds every item into the accumulator with f( accumulator, item ), and resolves to the result once the stream ends
+             * */
+            template <typename R, typename Functor, typename LaunchPolicy = work_stealing_pool>
+            inline ThenableFuture<R> reduce( R init, Functor &&f, LaunchPolicy policy = default_executor()) && {
+                auto dest = detail::make_state<R>();
+
+                auto result = detail::state_access::make<ThenableFuture<R>>( detail::state_ptr<detail::shared_state<R>>( dest ));
+
+                consume( detail::stream_reduce_sink<R, typename std::decay<Functor>::type>{std::forward<Functor>( f ), std::move( init ), std::move( dest )}, policy );
+
+                return result;
+            }
+    };
+
+    /*
+     * The writing end of a stream. Like ThenablePromise, destroying it without closing the stream ends the stream with a broken_promise error.
+     * */
+    template <typename T>
+    class ThenableStreamWriter {
+            typedef detail::stream_state<T> state_type;
+
+            std::shared_ptr<state_type> _state;
+            bool                        _stream_retrieved = false;
+
+            inline void check_state() const {
+                if( !_state ) {
+                    throw std::future_error( std::future_errc::no_state );
+                }
+            }
+
+        public:
+            inline explicit ThenableStreamWriter( std::size_t capacity = 64 ) : _state( std::make_shared<state_type>( capacity )) {}
+
+            ThenableStreamWriter( ThenableStreamWriter && ) = default;
+
+            ThenableStreamWriter( const ThenableStreamWriter & ) = delete;
+
+            ThenableStreamWriter &operator=( const ThenableStreamWriter & ) = delete;
+
+            inline ThenableStreamWriter &operator=( ThenableStreamWriter &&other ) {
+                ThenableStreamWriter( std::move( other )).swap( *this );
+
+                return *this;
+            }
+
+            inline ~ThenableStreamWriter() {
+                if( _state ) {
+                    _state->close( detail::make_broken_stream_exception());
+                }
+            }
+
+            inline void swap( ThenableStreamWriter &other ) noexcept {
+                std::swap( _state, other._state );
+                std::swap( _stream_retrieved, other._stream_retrieved );
+            }
+
+            inline ThenableStream<T> get_stream() {
+                check_state();
+
+                if( _stream_retrieved ) {
+                    throw std::future_error( std::future_errc::future_already_retrieved );
+                }
+
+                _stream_retrieved = true;
+
+                return ThenableStream<T>( _state );
+            }
+
+            /*
+             * Returns a future that's ready once the item is within the buffer's capacity.
+             * Throws a std::length_error if the future returned by the previous push isn't ready yet.
+             * */
+            inline ThenableFuture<void> push( const T &value ) {
+                check_state();
+
+                return _state->push( value );
+            }
+
+            inline ThenableFuture<void> push( T &&value ) {
+                check_state();
+
+                return _state->push( std::move( value ));
+            }
+
+            /*
+             * Returns false without waiting if the buffer is full, and leaves the value alone.
+             * Throws a broken_promise future_error if the stream has been abandoned.
+             * */
+            inline bool try_push( T &value ) {
+                check_state();
+
+                return _state->try_push( value );
+            }
+
+            /*
+             * Ends the stream once everything pushed so far has been read
+             * */
+            inline void close() {
+                check_state();
+
+                _state->close();
+            }
+
+            /*
+             * Ends the stream with an exception, which goes to the terminal future
+             * */
+            inline void set_exception( std::exception_ptr e ) {
+                check_state();
+
+                _state->close( e );
+            }
+    };
+}
+
+#endif //THENABLE_STREAM_HPP_INCLUDED
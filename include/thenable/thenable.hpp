@@ -7,11 +7,25 @@
 
 #include <function_traits.hpp>
 
+#include <thenable/function.hpp>
+#include <thenable/executor.hpp>
+#include <thenable/memory.hpp>
+#include <thenable/cancellation.hpp>
+#include <thenable/timer.hpp>
+#include <thenable/instrumentation.hpp>
+
 #include <assert.h>
 #include <future>
 #include <tuple>
 #include <memory>
+#include <memory_resource>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <optional>
 
 //This is defined so it can be quickly toggled if something needs debugging
 #define THENABLE_NOEXCEPT noexcept
@@ -46,6 +60,12 @@ namespace thenable {
     /*
      * The default launch policy of std::async is a combination of the std::launch flags,
      * allowing it to choose whatever policy it wants depending on the system.
+     *
+     * For the Thenable types, which don't go through std::async, the policies mean:
+     *
+     *  std::launch::deferred       - the continuation runs lazily on the first thread to wait on the resulting future
+     *  std::launch::async          - the continuation runs on a new thread once the value is available
+     *  std::launch::async|deferred - the continuation runs as a callback on whatever thread provides the value
      * */
 #ifdef THENABLE_DEFAULT_POLICY
     constexpr std::launch default_policy = THENABLE_DEFAULT_POLICY;
@@ -62,9 +82,123 @@ namespace thenable {
      * */
 
     enum class then_launch {
-            detached = 4
+            detached = 4,
+
+        /*
+         * If the value is already available, the continuation is invoked right away on the thread calling `then`,
+         * and the resulting future is ready by the time `then` returns. Otherwise it behaves just like detached.
+         *
+         * This is meant for things like cache hits, where the value is usually ready and a new thread would cost far more than the continuation itself.
+         * */
+            inline_if_ready = 8
+    };
+
+    /*
+     * Wraps another launch policy so that continuations, stages and functors launched with it are dropped
+     * if the token has been cancelled by the time they would start, and their futures resolve with a cancelled_error instead.
+     * The futures of `then`, `make_promise` and `await_all` resolve as soon as the token is cancelled, even if they're still waiting on their source.
+     *
+     * Created with `with_cancellation`, and accepted by `then`, `waterfall`, `await_all` and `make_promise` just like any other policy.
+     * */
+    template <typename LaunchPolicy>
+    struct cancellable_policy {
+        LaunchPolicy       policy;
+        cancellation_token token;
+    };
+
+    template <typename LaunchPolicy = std::launch>
+    inline cancellable_policy<LaunchPolicy> with_cancellation( cancellation_token token, LaunchPolicy policy = default_policy ) {
+        return cancellable_policy<LaunchPolicy>{std::move( policy ), std::move( token )};
+    }
+
+    /*
+     * Wraps another launch policy with a deadline. The future returned by `then`, `waterfall`, `await_all` or `make_promise`
+     * resolves with a timeout_error if its result isn't available by then, and continuations that haven't started by the deadline are dropped.
+     *
+     * Deadlines are tracked by default_timer(), so nothing blocks while waiting on them.
+     * Since nothing waits on the intermediate result, std::launch::deferred behaves like the default policy here.
+     * */
+    template <typename LaunchPolicy>
+    struct deadline_policy {
+        LaunchPolicy                          policy;
+        std::chrono::steady_clock::time_point deadline;
     };
 
+    template <typename LaunchPolicy = std::launch>
+    inline deadline_policy<LaunchPolicy> with_deadline( std::chrono::steady_clock::time_point deadline, LaunchPolicy policy = default_policy ) {
+        return deadline_policy<LaunchPolicy>{std::move( policy ), deadline};
+    }
+
+    template <typename Rep, typename Period, typename LaunchPolicy = std::launch>
+    inline deadline_policy<LaunchPolicy> with_timeout( const std::chrono::duration<Rep, Period> &timeout, LaunchPolicy policy = default_policy ) {
+        return with_deadline( std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>( timeout ), std::move( policy ));
+    }
+
+    namespace detail {
+        /*
+         * Policies that run a task without anything waiting on it, which is then_launch::detached or any executor
+         * */
+        template <typename LaunchPolicy>
+        struct is_detached_policy : is_executor<LaunchPolicy> {
+        };
+
+        template <>
+        struct is_detached_policy<then_launch> : std::true_type {
+        };
+
+        /*
+         * Cancellable policies only work with the Thenable types, so they go through the same overloads as the detached ones
+         * */
+        template <typename LaunchPolicy>
+        struct is_detached_policy<cancellable_policy<LaunchPolicy>> : std::true_type {
+        };
+
+        template <typename LaunchPolicy>
+        struct is_detached_policy<deadline_policy<LaunchPolicy>> : std::true_type {
+        };
+
+        /*
+         * Policies that wrap another one, which some overloads handle separately
+         * */
+        template <typename LaunchPolicy>
+        struct is_wrapped_policy : std::false_type {
+        };
+
+        template <typename LaunchPolicy>
+        struct is_wrapped_policy<cancellable_policy<LaunchPolicy>> : std::true_type {
+        };
+
+        template <typename LaunchPolicy>
+        struct is_wrapped_policy<deadline_policy<LaunchPolicy>> : std::true_type {
+        };
+
+        template <typename Executor, typename T = void>
+        using enable_if_executor_t = typename std::enable_if<is_executor<Executor>::value, T>::type;
+
+        template <typename LaunchPolicy, typename T = void>
+        using enable_if_detached_t = typename std::enable_if<is_detached_policy<LaunchPolicy>::value, T>::type;
+
+        /*
+         * For overloads that have separate cancellable and deadline versions, or that don't support them at all, like those for std futures
+         * */
+        template <typename LaunchPolicy, typename T = void>
+        using enable_if_unwrapped_detached_t = typename std::enable_if<is_detached_policy<LaunchPolicy>::value && !is_wrapped_policy<LaunchPolicy>::value, T>::type;
+
+        /*
+         * Anything that can be given as a launch policy
+         * */
+        template <typename LaunchPolicy>
+        struct is_launch_policy : is_detached_policy<LaunchPolicy> {
+        };
+
+        template <>
+        struct is_launch_policy<std::launch> : std::true_type {
+        };
+
+        template <typename LaunchPolicy, typename T = void>
+        using enable_if_launch_policy_t = typename std::enable_if<is_launch_policy<LaunchPolicy>::value, T>::type;
+    }
+
     //////////
 
     template <typename>
@@ -152,326 +286,2829 @@ namespace thenable {
 
     //////////
 
-    template <typename T>
-    constexpr ThenableFuture<T> to_thenable( std::future<T> && );
+    namespace detail {
+        /*
+         * shared_state_base
+         *
+         * This is the non-templated half of the shared state behind ThenablePromise, ThenableFuture and ThenableSharedFuture.
+         *
+         * Unlike the shared state of std::future, it keeps a list of continuations that are invoked by whatever thread
+         * completes the state, or immediately by the thread attaching them if it's already complete.
+         * That way a pending chain of `then` calls doesn't need any thread sitting in `get()` waiting for it.
+         *
+         * The usual case is one producer setting the result once and one consumer attaching a single continuation, so that handoff
+         * goes through a single atomic word of flags instead of the mutex. The producer publishes the result with one fetch_or, and the consumer
+         * claims the inline continuation slot with one compare-exchange and publishes it with one fetch_or. Whichever of them comes second runs
+         * the continuation. The mutex and condition variable are only touched once somebody blocks in wait(), a deferred task is involved,
+         * or more than one continuation is attached.
+         *
+         * Because of that, a state must only be completed from one thread at a time. Completing it a second time still throws promise_already_satisfied.
+         *
+         * It's reference counted intrusively so the state can hand out new references to itself to continuations.
+         * */
+        class shared_state_base {
+            public:
+                typedef unique_function<void()> task_type;
 
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( const std::shared_future<T> & );
+                shared_state_base( const shared_state_base & ) = delete;
 
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( std::shared_future<T> && );
+                shared_state_base &operator=( const shared_state_base & ) = delete;
 
-    template <typename T>
-    constexpr ThenablePromise<T> to_thenable( std::promise<T> && );
+                inline void add_ref() THENABLE_NOEXCEPT {
+                    _refs.fetch_add( 1, std::memory_order_relaxed );
+                }
 
-    //////////
+                inline void release() THENABLE_NOEXCEPT {
+                    if( _refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+                        destroy();
+                    }
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<std::future<Results>...> && );
+                /*
+                 * States are allocated from the thread-local state pool unless they were created with a specific allocator
+                 * */
+                static inline void *operator new( std::size_t size ) {
+                    return state_pool::allocate( size );
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<std::shared_future<Results>...> && );
+                static inline void operator delete( void *p, std::size_t size ) THENABLE_NOEXCEPT {
+                    state_pool::deallocate( p, size );
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<std::promise<Results>...> && );
+                static inline void *operator new( std::size_t size, std::align_val_t alignment ) {
+                    return ::operator new( size, alignment );
+                }
 
-    //////////
+                static inline void operator delete( void *p, std::size_t, std::align_val_t alignment ) THENABLE_NOEXCEPT {
+                    ::operator delete( p, alignment );
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<ThenableFuture<Results>...> && );
+                inline bool is_ready() const THENABLE_NOEXCEPT {
+                    return ( _flags.load( std::memory_order_acquire ) & ready_flag ) != 0;
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<ThenableSharedFuture<Results>...> && );
+                /*
+                 * Only meaningful once the state is ready
+                 * */
+                inline bool has_exception() const THENABLE_NOEXCEPT {
+                    return static_cast<bool>(_exception);
+                }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<ThenablePromise<Results>...> && );
+                /*
+                 * A deferred task is run by the first thread to wait on the state, and is expected to complete it.
+                 * */
+                inline void set_deferred( task_type &&task ) {
+                    std::lock_guard<std::mutex> lock( _mutex );
 
-    //////////
+                    _deferred = std::forward<task_type>( task );
 
-    template <typename T = void, typename Functor, typename LaunchPolicy = std::launch>
-    std::future<T> make_promise( Functor &&, LaunchPolicy = default_policy );
+                    _flags.fetch_or( deferred_flag | locked_flag, std::memory_order_acq_rel );
+                }
 
-    template <typename T = void, typename Functor, typename LaunchPolicy = std::launch>
-    ThenableFuture<T> make_promise2( Functor &&, LaunchPolicy = default_policy );
+                inline bool is_deferred() const {
+                    if( !( _flags.load( std::memory_order_acquire ) & deferred_flag )) {
+                        return false;
+                    }
 
+                    std::lock_guard<std::mutex> lock( _mutex );
 
-    //////////
+                    return !is_ready() && static_cast<bool>(_deferred);
+                }
 
-    template <typename... Functors>
-    std::tuple<std::future<recursive_result_of<Functors>>...> parallel( Functors &&... fns );
+                /*
+                 * Registers a callback to be invoked once the state is complete. If it's already complete the callback is invoked right away.
+                 *
+                 * If the state is still waiting on a deferred task, nothing is ever going to run it unless somebody waits on the state,
+                 * so it gets handed off to a new thread. This only happens for states adopted from std::future or created with std::launch::deferred.
+                 * */
+                inline void add_continuation( task_type &&continuation ) {
+                    unsigned flags = _flags.load( std::memory_order_acquire );
 
-    template <typename... Functors>
-    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( Functors &&... fns );
+                    while( !( flags & ( ready_flag | claimed_flag | deferred_flag ))) {
+                        if( _flags.compare_exchange_weak( flags, flags | claimed_flag, std::memory_order_acquire )) {
+                            _continuation = std::forward<task_type>( continuation );
 
-    template <typename... Functors>
-    std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( size_t concurrency, Functors &&... fns );
+                            if( _flags.fetch_or( attached_flag, std::memory_order_acq_rel ) & ready_flag ) {
+                                //The result arrived in between, so the producer left the continuation for us
+                                task_type next = std::move( _continuation );
 
-    template <typename... Functors>
-    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( size_t concurrency, Functors &&... fns );
+                                next();
+                            }
 
-    //////////
+                            return;
+                        }
+                    }
 
-    template <typename Functor, typename... Args>
-    inline std::future<typename std::result_of<Functor( Args... )>::type> defer( Functor &&f, Args &&... args ) {
-        return std::async( std::launch::deferred, std::forward<Functor>( f ), std::forward<Args>( args )... );
-    };
+                    if( flags & ready_flag ) {
+                        continuation();
 
-    template <typename Functor, typename... Args>
-    inline ThenableFuture<typename std::result_of<Functor( Args... )>::type> defer2( Functor &&f, Args &&... args ) {
-        return to_thenable( defer( std::forward<Functor>( f ), std::forward<Args>( args )... ));
-    };
+                    } else {
+                        add_continuation_locked( std::forward<task_type>( continuation ));
+                    }
+                }
 
-    //////////
+                inline void set_exception( std::exception_ptr e ) {
+                    complete( [this, &e] {
+                        _exception = std::move( e );
+                    } );
+                }
 
-    namespace detail {
-        using namespace fn_traits;
+                inline void wait() {
+                    if( is_ready()) {
+                        return;
+                    }
 
-        template <typename Functor, typename T, std::size_t... S>
-        inline decltype( auto ) invoke_helper( Functor &&func, T &&t, std::index_sequence<S...> ) {
-            return func( std::get<S>( std::forward<T>( t ))... );
-        }
+                    std::unique_lock<std::mutex> lock( _mutex );
 
-        template <typename Functor, typename T>
-        inline decltype( auto ) invoke_tuple( Functor &&func, T &&t ) {
-            constexpr auto Size = std::tuple_size<typename std::decay<T>::type>::value;
+                    if( _flags.fetch_or( locked_flag, std::memory_order_acq_rel ) & ready_flag ) {
+                        return;
+                    }
 
-            return invoke_helper( std::forward<Functor>( func ),
-                                  std::forward<T>( t ),
-                                  std::make_index_sequence<Size>{} );
-        }
+                    if( _deferred ) {
+                        task_type deferred = std::move( _deferred );
 
-        /*
-         * recursive_get:
-         *
-         * This will continually call "get" on any future or promise objects returned by another future,
-         * recursively, basically resolving the entire chain at once
-         * */
+                        _deferred = nullptr;
 
-        /*
-         * Forward declarations
-         * */
+                        lock.unlock();
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( std::future<T> && );
+                        deferred();
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( std::shared_future<T> && );
+                        lock.lock();
+                    }
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( std::promise<T> && );
+                    if( is_pool_worker()) {
+                        help_until_ready( lock );
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( ThenableFuture<T> && );
+                        return;
+                    }
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( ThenableSharedFuture<T> && );
+                    blocking_scope blocked;
 
-        template <typename T>
-        typename recursive_get_future_type<T>::type recursive_get( ThenablePromise<T> && );
+                    _cv.wait( lock, [this] {
+                        return is_ready();
+                    } );
+                }
 
-        template <typename T>
-        constexpr T recursive_get( T && ) THENABLE_NOEXCEPT;
+                template <typename Rep, typename Period>
+                inline std::future_status wait_for( const std::chrono::duration<Rep, Period> &timeout ) {
+                    if( is_ready()) {
+                        return std::future_status::ready;
+                    }
 
-        /*
-         * std future implementations. ThenableX implementations are below their class implementation at the bottom of the file.
-         * */
+                    std::unique_lock<std::mutex> lock( _mutex );
 
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( std::future<T> &&t ) {
-            return recursive_get( t.get());
-        };
+                    if( _flags.fetch_or( locked_flag, std::memory_order_acq_rel ) & ready_flag ) {
+                        return std::future_status::ready;
+                    }
 
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( std::shared_future<T> &&t ) {
-            return recursive_get( t.get());
-        };
+                    if( _deferred ) {
+                        return std::future_status::deferred;
+                    }
 
-        template <>
-        inline typename recursive_get_future_type<void>::type recursive_get<void>( std::future<void> &&t ) {
-            t.get();
-        };
+                    blocking_scope blocked;
 
-        template <>
-        inline typename recursive_get_future_type<void>::type recursive_get<void>( std::shared_future<void> &&t ) {
-            t.get();
-        };
+                    return _cv.wait_for( lock, timeout, [this] {
+                        return is_ready();
+                    } ) ? std::future_status::ready : std::future_status::timeout;
+                }
 
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( std::promise<T> &&t ) {
-            return recursive_get( t.get_future());
-        };
+                template <typename Clock, typename Duration>
+                inline std::future_status wait_until( const std::chrono::time_point<Clock, Duration> &deadline ) {
+                    if( is_ready()) {
+                        return std::future_status::ready;
+                    }
 
-        /*
-         * This just forwards anything that is NOT a promise or future and doesn't do anything to it.
-         * */
-        template <typename T>
-        constexpr T recursive_get( T &&t ) THENABLE_NOEXCEPT {
-            return std::forward<T>( t );
-        };
+                    std::unique_lock<std::mutex> lock( _mutex );
 
-        //////////
+                    if( _flags.fetch_or( locked_flag, std::memory_order_acq_rel ) & ready_flag ) {
+                        return std::future_status::ready;
+                    }
 
-        /*
-         * then_invoke_helper structure
-         *
-         * This just takes care of the invocation of the callback, forwarding arguments and so forth and
-         * taking care of any returned futures
-         * */
+                    if( _deferred ) {
+                        return std::future_status::deferred;
+                    }
 
-        template <typename Functor, typename R = fn_result_of<Functor>>
-        struct then_invoke_helper {
-            /*
-             * If you're seeing any of the code below, it's probably because a callback given to `then` doesn't
-             * have the same argument types as the value being passed from the previous future.
-             * */
+                    blocking_scope blocked;
 
-            template <typename... Args>
-            inline static decltype( auto ) invoke( Functor &&f, std::tuple<Args...> &&args ) {
-                return recursive_get( invoke_tuple( std::forward<Functor>( f ), std::forward<std::tuple<Args...>>( args )));
-            }
+                    return _cv.wait_until( lock, deadline, [this] {
+                        return is_ready();
+                    } ) ? std::future_status::ready : std::future_status::timeout;
+                }
 
-            template <typename T>
-            inline static decltype( auto ) invoke( Functor &&f, T &&arg ) {
-                return recursive_get( f( std::forward<T>( arg )));
-            }
+            private:
+                /*
+                 * Pool workers run the tasks queued on their own deque while they wait, so tasks waiting on work they queued themselves
+                 * can't deadlock the pool. Nothing tells them when more tasks are queued, so they only block briefly in between.
+                 * */
+                inline void help_until_ready( std::unique_lock<std::mutex> &lock ) {
+                    while( !is_ready()) {
+                        lock.unlock();
 
-            inline static decltype( auto ) invoke( Functor &&f ) {
-                return recursive_get( f());
-            }
-        };
+                        bool helped = help_while_waiting();
 
-        /*
-         * Specialization of then_invoke_helper for void callbacks.
-         * */
-        template <typename Functor>
-        struct then_invoke_helper<Functor, void> {
-            /*
-             * If you're seeing any of the code below, it's probably because a callback given to `then` doesn't
-             * have the same argument types as the value being passed from the previous future.
-             * */
+                        lock.lock();
 
-            template <typename... Args>
-            inline static void invoke( Functor &&f, std::tuple<Args...> &&args ) {
-                invoke_tuple( std::forward<Functor>( f ), std::forward<std::tuple<Args...>>( args ));
-            }
+                        if( !helped ) {
+                            blocking_scope blocked;
 
-            template <typename T>
-            inline static void invoke( Functor &&f, T &&arg ) {
-                f( std::forward<T>( arg ));
-            }
+                            _cv.wait_for( lock, std::chrono::microseconds( 500 ), [this] {
+                                return is_ready();
+                            } );
+                        }
+                    }
+                }
 
-            inline static void invoke( Functor &&f ) {
-                f();
-            }
-        };
+            protected:
+                shared_state_base() = default;
 
-        //////////
+                virtual ~shared_state_base() = default;
 
-        /*
-         * then_helper structure
-         *
-         * This takes care of resolving the first given future, and optionally passing the
-         * resulting value to the callback function.
-         * */
+                /*
+                 * Called when the last reference is released. Overridden by states that were created with an allocator.
+                 * */
+                virtual void destroy() THENABLE_NOEXCEPT {
+                    delete this;
+                }
 
-        template <typename T, typename Functor>
-        struct then_helper {
-            inline static decltype( auto ) dispatch( std::future<T> &&s, Functor &&f ) {
-                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ), recursive_get( std::forward<std::future<T>>( s )));
-            }
+                /*
+                 * Stores the result using the given setter and publishes it, then wakes any waiting threads
+                 * and runs the continuations. The mutex is only taken if somebody went through it before the result arrived.
+                 * */
+                template <typename Setter>
+                inline void complete( Setter &&setter ) {
+                    if( is_ready()) {
+                        throw std::future_error( std::future_errc::promise_already_satisfied );
+                    }
 
-            inline static decltype( auto ) dispatch( std::shared_future<T> &&s, Functor &&f ) {
-                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ), recursive_get( std::forward<std::shared_future<T>>( s )));
-            }
-        };
+                    setter();
+
+                    unsigned flags = _flags.fetch_or( ready_flag, std::memory_order_acq_rel );
+
+                    std::vector<task_type> continuations;
+                    task_type              deferred;
+
+                    if( flags & locked_flag ) {
+                        {
+                            std::lock_guard<std::mutex> lock( _mutex );
+
+                            deferred = std::move( _deferred );
+
+                            _deferred = nullptr;
+
+                            continuations.swap( _continuations );
+                        }
+
+                        _cv.notify_all();
+                    }
+
+                    if( flags & attached_flag ) {
+                        task_type continuation = std::move( _continuation );
+
+                        continuation();
+                    }
+
+                    for( auto &next : continuations ) {
+                        next();
+                    }
+                }
+
+                inline void rethrow_if_exception() const {
+                    if( _exception ) {
+                        std::rethrow_exception( _exception );
+                    }
+                }
+
+            private:
+                enum : unsigned {
+                    //The value or exception has been stored
+                    ready_flag    = 1,
+                    //Somebody has taken the inline continuation slot
+                    claimed_flag  = 2,
+                    //The inline continuation has been stored
+                    attached_flag = 4,
+                    //The producer has to go through the mutex to find waiters or more continuations
+                    locked_flag   = 8,
+                    //A deferred task was set, so attaching continuations has to go through the mutex to launch it
+                    deferred_flag = 16
+                };
+
+                inline void add_continuation_locked( task_type &&continuation ) {
+                    task_type deferred;
+                    bool      ready;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        ready = ( _flags.fetch_or( locked_flag, std::memory_order_acq_rel ) & ready_flag ) != 0;
+
+                        if( !ready ) {
+                            _continuations.push_back( std::forward<task_type>( continuation ));
+
+                            deferred = std::move( _deferred );
+
+                            _deferred = nullptr;
+                        }
+                    }
+
+                    if( ready ) {
+                        continuation();
+
+                    } else if( deferred ) {
+                        note_thread_spawn();
+
+                        std::thread( std::move( deferred )).detach();
+                    }
+                }
+
+                std::atomic_size_t      _refs{1};
+                std::atomic<unsigned>   _flags{0};
+                mutable std::mutex      _mutex;
+                std::condition_variable _cv;
+                std::exception_ptr      _exception;
+                task_type               _deferred;
+
+                /*
+                 * Most states only ever get a single continuation, so the first one is stored inline
+                 * and only the rest go into the vector.
+                 * */
+                task_type              _continuation;
+                std::vector<task_type> _continuations;
+        };
+
+        /*
+         * shared_state stores the actual value. take() moves it out for single consumers like ThenableFuture,
+         * while get() only references it for shared consumers like ThenableSharedFuture.
+         * */
+        template <typename T>
+        class shared_state : public shared_state_base {
+            public:
+                typedef T value_type;
+
+                template <typename... Args>
+                inline void set_value( Args &&... args ) {
+                    complete( [&] {
+                        _value.emplace( std::forward<Args>( args )... );
+                    } );
+                }
+
+                inline T take() {
+                    wait();
+                    rethrow_if_exception();
+
+                    return std::move( *_value );
+                }
+
+                inline const T &get() {
+                    wait();
+                    rethrow_if_exception();
+
+                    return *_value;
+                }
+
+            private:
+                std::optional<T> _value;
+        };
+
+        template <typename T>
+        class shared_state<T &> : public shared_state_base {
+            public:
+                typedef T &value_type;
+
+                inline void set_value( T &value ) {
+                    complete( [&] {
+                        _value = &value;
+                    } );
+                }
+
+                inline T &take() {
+                    return get();
+                }
+
+                inline T &get() {
+                    wait();
+                    rethrow_if_exception();
+
+                    return *_value;
+                }
+
+            private:
+                T *_value = nullptr;
+        };
+
+        template <>
+        class shared_state<void> : public shared_state_base {
+            public:
+                typedef void value_type;
+
+                inline void set_value() {
+                    complete( [] {} );
+                }
+
+                inline void take() {
+                    get();
+                }
+
+                inline void get() {
+                    wait();
+                    rethrow_if_exception();
+                }
+        };
+
+        /*
+         * Intrusive smart pointer for shared states
+         * */
+        template <typename S>
+        class state_ptr {
+                S *_ptr = nullptr;
+
+            public:
+                constexpr state_ptr() THENABLE_NOEXCEPT = default;
+
+                /*
+                 * Takes ownership of an existing reference, like the one a new state is created with
+                 * */
+                inline explicit state_ptr( S *ptr ) THENABLE_NOEXCEPT : _ptr( ptr ) {}
+
+                inline state_ptr( const state_ptr &other ) THENABLE_NOEXCEPT : _ptr( other._ptr ) {
+                    if( _ptr ) {
+                        _ptr->add_ref();
+                    }
+                }
+
+                inline state_ptr( state_ptr &&other ) THENABLE_NOEXCEPT : _ptr( other._ptr ) {
+                    other._ptr = nullptr;
+                }
+
+                inline ~state_ptr() {
+                    if( _ptr ) {
+                        _ptr->release();
+                    }
+                }
+
+                inline state_ptr &operator=( state_ptr other ) THENABLE_NOEXCEPT {
+                    std::swap( _ptr, other._ptr );
+
+                    return *this;
+                }
+
+                /*
+                 * Creates a new reference to a state that is known to be alive
+                 * */
+                inline static state_ptr from_this( S *ptr ) THENABLE_NOEXCEPT {
+                    ptr->add_ref();
+
+                    return state_ptr( ptr );
+                }
+
+                constexpr S *get() const THENABLE_NOEXCEPT {
+                    return _ptr;
+                }
+
+                constexpr S *operator->() const THENABLE_NOEXCEPT {
+                    return _ptr;
+                }
+
+                constexpr S &operator*() const THENABLE_NOEXCEPT {
+                    return *_ptr;
+                }
+
+                constexpr explicit operator bool() const THENABLE_NOEXCEPT {
+                    return _ptr != nullptr;
+                }
+        };
+
+        template <typename T>
+        inline state_ptr<shared_state<T>> make_state() {
+            return state_ptr<shared_state<T>>( new shared_state<T>());
+        }
+
+        /*
+         * A shared state that holds on to the allocator it was created with, and uses it to free itself.
+         * */
+        template <typename T, typename Alloc>
+        class allocated_state : public shared_state<T> {
+                typedef typename std::allocator_traits<Alloc>::template rebind_alloc<allocated_state> allocator_type;
+                typedef std::allocator_traits<allocator_type>                                         traits;
+
+                allocator_type _alloc;
+
+            public:
+                inline explicit allocated_state( const allocator_type &alloc ) : _alloc( alloc ) {}
+
+                template <typename A>
+                static inline allocated_state *create( const A &alloc ) {
+                    allocator_type a( alloc );
+
+                    allocated_state *p = traits::allocate( a, 1 );
+
+                    try {
+                        ::new( static_cast<void *>(p)) allocated_state( a );
+
+                    } catch( ... ) {
+                        traits::deallocate( a, p, 1 );
+
+                        throw;
+                    }
+
+                    return p;
+                }
+
+            protected:
+                void destroy() THENABLE_NOEXCEPT override {
+                    allocator_type a( std::move( _alloc ));
+
+                    this->~allocated_state();
+
+                    traits::deallocate( a, this, 1 );
+                }
+        };
+
+        template <typename T, typename Alloc>
+        inline state_ptr<shared_state<T>> make_state( const Alloc &alloc ) {
+            return state_ptr<shared_state<T>>( allocated_state<T, Alloc>::create( alloc ));
+        }
+
+        /*
+         * ready_result holds the value or exception of a ThenableFuture that was created already complete,
+         * like with make_ready_future, so that it doesn't need a shared state at all.
+         *
+         * Moving from one leaves it empty. The specializations take care of references and void.
+         * */
+        template <typename T>
+        struct ready_result {
+            std::optional<T>   value;
+            std::exception_ptr exception;
+
+            ready_result() = default;
+
+            inline ready_result( ready_result &&other ) THENABLE_NOEXCEPT
+                : value( std::move( other.value )), exception( std::move( other.exception )) {
+                other.reset();
+            }
+
+            inline ready_result &operator=( ready_result &&other ) THENABLE_NOEXCEPT {
+                value     = std::move( other.value );
+                exception = std::move( other.exception );
+
+                other.reset();
+
+                return *this;
+            }
+
+            inline bool empty() const THENABLE_NOEXCEPT {
+                return !value && !exception;
+            }
+
+            inline void reset() THENABLE_NOEXCEPT {
+                value.reset();
+                exception = nullptr;
+            }
+
+            template <typename... Args>
+            inline void set_value( Args &&... args ) {
+                value.emplace( std::forward<Args>( args )... );
+            }
+
+            inline T take() {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    std::rethrow_exception( r.exception );
+                }
+
+                return std::move( *r.value );
+            }
+
+            inline void store( shared_state<T> &s ) {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    s.set_exception( r.exception );
+
+                } else {
+                    s.set_value( std::move( *r.value ));
+                }
+            }
+        };
+
+        template <typename T>
+        struct ready_result<T &> {
+            T                  *value = nullptr;
+            std::exception_ptr exception;
+
+            ready_result() = default;
+
+            inline ready_result( ready_result &&other ) THENABLE_NOEXCEPT
+                : value( other.value ), exception( std::move( other.exception )) {
+                other.reset();
+            }
+
+            inline ready_result &operator=( ready_result &&other ) THENABLE_NOEXCEPT {
+                value     = other.value;
+                exception = std::move( other.exception );
+
+                other.reset();
+
+                return *this;
+            }
+
+            inline bool empty() const THENABLE_NOEXCEPT {
+                return !value && !exception;
+            }
+
+            inline void reset() THENABLE_NOEXCEPT {
+                value     = nullptr;
+                exception = nullptr;
+            }
+
+            inline void set_value( T &v ) THENABLE_NOEXCEPT {
+                value = &v;
+            }
+
+            inline T &take() {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    std::rethrow_exception( r.exception );
+                }
+
+                return *r.value;
+            }
+
+            inline void store( shared_state<T &> &s ) {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    s.set_exception( r.exception );
+
+                } else {
+                    s.set_value( *r.value );
+                }
+            }
+        };
+
+        template <>
+        struct ready_result<void> {
+            bool               value = false;
+            std::exception_ptr exception;
+
+            ready_result() = default;
+
+            inline ready_result( ready_result &&other ) THENABLE_NOEXCEPT
+                : value( other.value ), exception( std::move( other.exception )) {
+                other.reset();
+            }
+
+            inline ready_result &operator=( ready_result &&other ) THENABLE_NOEXCEPT {
+                value     = other.value;
+                exception = std::move( other.exception );
+
+                other.reset();
+
+                return *this;
+            }
+
+            inline bool empty() const THENABLE_NOEXCEPT {
+                return !value && !exception;
+            }
+
+            inline void reset() THENABLE_NOEXCEPT {
+                value     = false;
+                exception = nullptr;
+            }
+
+            inline void set_value() THENABLE_NOEXCEPT {
+                value = true;
+            }
+
+            inline void take() {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    std::rethrow_exception( r.exception );
+                }
+            }
+
+            inline void store( shared_state<void> &s ) {
+                ready_result r( std::move( *this ));
+
+                if( r.exception ) {
+                    s.set_exception( r.exception );
+
+                } else {
+                    s.set_value();
+                }
+            }
+        };
+
+        /*
+         * Gives the free functions below access to the shared state of the Thenable types without making it public
+         * */
+        struct state_access {
+            template <typename Thenable>
+            static inline auto release( Thenable &t ) THENABLE_NOEXCEPT {
+                return std::move( t._state );
+            }
+
+            /*
+             * A ready ThenableFuture only gets a shared state once something actually needs one
+             * */
+            template <typename T>
+            static inline state_ptr<shared_state<T>> release( ThenableFuture<T> &t ) {
+                t.materialize();
+
+                return std::move( t._state );
+            }
+
+            template <typename T>
+            static inline ready_result<T> &ready( ThenableFuture<T> &t ) THENABLE_NOEXCEPT {
+                return t._ready;
+            }
+
+            template <typename T>
+            static inline ThenableFuture<T> make_ready( ready_result<T> &&r ) THENABLE_NOEXCEPT {
+                return ThenableFuture<T>( std::forward<ready_result<T>>( r ));
+            }
+
+            template <typename Thenable>
+            static inline decltype( auto ) state( const Thenable &t ) THENABLE_NOEXCEPT {
+                return ( t._state );
+            }
+
+            template <typename Thenable, typename S>
+            static inline Thenable make( state_ptr<S> &&s ) THENABLE_NOEXCEPT {
+                return Thenable( std::forward<state_ptr<S>>( s ));
+            }
+        };
+    }
+
+    //////////
+
+    template <typename T>
+    ThenableFuture<typename std::decay<T>::type> make_ready_future( T && );
+
+    ThenableFuture<void> make_ready_future();
+
+    template <typename T>
+    ThenableFuture<T> make_exceptional_future( std::exception_ptr );
+
+    template <typename T, typename E>
+    ThenableFuture<T> make_exceptional_future( E );
+
+    //////////
+
+    template <typename T>
+    constexpr ThenableFuture<T> to_thenable( std::future<T> && );
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( const std::shared_future<T> & );
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( std::shared_future<T> && );
+
+    //////////
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<std::future<Results>...> && );
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<std::shared_future<Results>...> && );
+
+    //////////
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<ThenableFuture<Results>...> && );
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<ThenableSharedFuture<Results>...> && );
+
+    template <typename... Results>
+    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<ThenablePromise<Results>...> && );
+
+    //////////
+
+    template <typename T = void, typename Functor, typename LaunchPolicy = std::launch>
+    detail::enable_if_launch_policy_t<LaunchPolicy, std::future<T>> make_promise( Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T = void, typename Functor, typename LaunchPolicy = std::launch>
+    detail::enable_if_launch_policy_t<LaunchPolicy, ThenableFuture<T>> make_promise2( Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T = void, typename Alloc, typename Functor, typename LaunchPolicy = std::launch>
+    std::future<T> make_promise( std::allocator_arg_t, const Alloc &, Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T = void, typename Alloc, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<T> make_promise2( std::allocator_arg_t, const Alloc &, Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T = void, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<T> make_promise2( std::pmr::memory_resource *, Functor &&, LaunchPolicy = default_policy );
+
+
+    //////////
+
+    template <typename... Functors>
+    std::tuple<std::future<recursive_result_of<Functors>>...> parallel( Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( size_t concurrency, Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( size_t concurrency, Functors &&... fns );
+
+    /*
+     * Functors that haven't started by the time the token is cancelled are skipped, and their futures resolve with a cancelled_error
+     * */
+    template <typename... Functors>
+    std::tuple<std::future<recursive_result_of<Functors>>...> parallel( cancellation_token token, Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( cancellation_token token, Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( cancellation_token token, size_t concurrency, Functors &&... fns );
+
+    template <typename... Functors>
+    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( cancellation_token token, size_t concurrency, Functors &&... fns );
+
+    namespace detail {
+        template <typename Iterator, typename Functor>
+        struct range_job_traits;
+
+        template <typename R, bool Direct = std::is_default_constructible<R>::value && !std::is_same<R, bool>::value>
+        struct range_results;
+    }
+
+    template <typename Iterator, typename Functor>
+    using parallel_for_future = ThenableFuture<typename detail::range_job_traits<Iterator, Functor>::value_type>;
+
+    template <typename Range>
+    using range_iterator = decltype( std::begin( std::declval<Range &>()));
+
+    template <typename Iterator, typename Functor>
+    parallel_for_future<Iterator, Functor> parallel_for( Iterator begin, Iterator end, Functor &&fn, size_t grain = 0 );
+
+    template <typename Range, typename Functor>
+    parallel_for_future<range_iterator<Range>, Functor> parallel_map( Range &&range, Functor &&fn, size_t grain = 0 );
+
+    //////////
+
+    namespace detail {
+        template <typename T>
+        struct when_any_helper;
+    }
+
+    /*
+     * when_any resolves to the index of the first future to complete with a value, along with that value
+     * */
+    template <typename T>
+    using when_any_result = typename detail::when_any_helper<T>::value_type;
+
+    template <typename T>
+    ThenableFuture<typename detail::range_results<T>::value_type> when_all( std::vector<ThenableFuture<T>> &&futures );
+
+    template <typename T>
+    ThenableFuture<when_any_result<T>> when_any( std::vector<ThenableFuture<T>> &&futures );
+
+    //////////
+
+    template <typename Functor, typename... Args>
+    inline std::future<typename std::result_of<Functor( Args... )>::type> defer( Functor &&f, Args &&... args ) {
+        return std::async( std::launch::deferred, std::forward<Functor>( f ), std::forward<Args>( args )... );
+    };
+
+    template <typename Functor, typename... Args>
+    inline ThenableFuture<typename std::result_of<Functor( Args... )>::type> defer2( Functor &&f, Args &&... args ) {
+        return to_thenable( defer( std::forward<Functor>( f ), std::forward<Args>( args )... ));
+    };
+
+    //////////
+
+    namespace detail {
+        using namespace fn_traits;
+
+        template <typename Functor, typename T, std::size_t... S>
+        inline decltype( auto ) invoke_helper( Functor &&func, T &&t, std::index_sequence<S...> ) {
+            return func( std::get<S>( std::forward<T>( t ))... );
+        }
+
+        template <typename Functor, typename T>
+        inline decltype( auto ) invoke_tuple( Functor &&func, T &&t ) {
+            constexpr auto Size = std::tuple_size<typename std::decay<T>::type>::value;
+
+            return invoke_helper( std::forward<Functor>( func ),
+                                  std::forward<T>( t ),
+                                  std::make_index_sequence<Size>{} );
+        }
+
+        /*
+         * recursive_get:
+         *
+         * This will continually call "get" on any future or promise objects returned by another future,
+         * recursively, basically resolving the entire chain at once
+         * */
+
+        /*
+         * Forward declarations
+         * */
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( std::future<T> && );
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( std::shared_future<T> && );
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( std::promise<T> && );
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( ThenableFuture<T> && );
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( ThenableSharedFuture<T> && );
+
+        template <typename T>
+        typename recursive_get_future_type<T>::type recursive_get( ThenablePromise<T> && );
+
+        template <typename T>
+        constexpr T recursive_get( T && ) THENABLE_NOEXCEPT;
+
+        /*
+         * std future implementations. ThenableX implementations are below their class implementation at the bottom of the file.
+         * */
+
+        /*
+         * std futures can't tell us when they'd block, so the whole get() counts
+         * */
+        template <typename Future>
+        inline decltype( auto ) blocking_get( Future &t ) {
+            blocking_scope blocked;
+
+            return t.get();
+        }
+
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( std::future<T> &&t ) {
+            return recursive_get( blocking_get( t ));
+        };
+
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( std::shared_future<T> &&t ) {
+            return recursive_get( blocking_get( t ));
+        };
+
+        template <>
+        inline typename recursive_get_future_type<void>::type recursive_get<void>( std::future<void> &&t ) {
+            blocking_get( t );
+        };
+
+        template <>
+        inline typename recursive_get_future_type<void>::type recursive_get<void>( std::shared_future<void> &&t ) {
+            blocking_get( t );
+        };
+
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( std::promise<T> &&t ) {
+            return recursive_get( t.get_future());
+        };
+
+        /*
+         * This just forwards anything that is NOT a promise or future and doesn't do anything to it.
+         * */
+        template <typename T>
+        constexpr T recursive_get( T &&t ) THENABLE_NOEXCEPT {
+            return std::forward<T>( t );
+        };
+
+        //////////
+
+        /*
+         * then_invoke_helper structure
+         *
+         * This just takes care of the invocation of the callback, forwarding arguments and so forth and
+         * taking care of any returned futures
+         * */
+
+        template <typename Functor, typename R = fn_result_of<Functor>>
+        struct then_invoke_helper {
+            /*
+             * If you're seeing any of the code below, it's probably because a callback given to `then` doesn't
+             * have the same argument types as the value being passed from the previous future.
+             * */
+
+            template <typename... Args>
+            inline static decltype( auto ) invoke( Functor &&f, std::tuple<Args...> &&args ) {
+                return recursive_get( invoke_tuple( std::forward<Functor>( f ), std::forward<std::tuple<Args...>>( args )));
+            }
+
+            template <typename T>
+            inline static decltype( auto ) invoke( Functor &&f, T &&arg ) {
+                return recursive_get( f( std::forward<T>( arg )));
+            }
+
+            inline static decltype( auto ) invoke( Functor &&f ) {
+                return recursive_get( f());
+            }
+        };
+
+        /*
+         * Specialization of then_invoke_helper for void callbacks.
+         * */
+        template <typename Functor>
+        struct then_invoke_helper<Functor, void> {
+            /*
+             * If you're seeing any of the code below, it's probably because a callback given to `then` doesn't
+             * have the same argument types as the value being passed from the previous future.
+             * */
+
+            template <typename... Args>
+            inline static void invoke( Functor &&f, std::tuple<Args...> &&args ) {
+                invoke_tuple( std::forward<Functor>( f ), std::forward<std::tuple<Args...>>( args ));
+            }
+
+            template <typename T>
+            inline static void invoke( Functor &&f, T &&arg ) {
+                f( std::forward<T>( arg ));
+            }
+
+            inline static void invoke( Functor &&f ) {
+                f();
+            }
+        };
+
+        //////////
+
+        /*
+         * then_helper structure
+         *
+         * This takes care of resolving the first given future, and optionally passing the
+         * resulting value to the callback function.
+         * */
+
+        template <typename T, typename Functor>
+        struct then_helper {
+            inline static decltype( auto ) dispatch( std::future<T> &&s, Functor &&f ) {
+                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ), recursive_get( std::forward<std::future<T>>( s )));
+            }
+
+            inline static decltype( auto ) dispatch( std::shared_future<T> &&s, Functor &&f ) {
+                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ), recursive_get( std::forward<std::shared_future<T>>( s )));
+            }
+        };
+
+        template <typename Functor>
+        struct then_helper<void, Functor> {
+            inline static decltype( auto ) dispatch( std::future<void> &&s, Functor &&f ) {
+                s.get();
+
+                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ));
+            }
+
+            inline static decltype( auto ) dispatch( std::shared_future<void> &&s, Functor &&f ) {
+                s.get();
+
+                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ));
+            }
+        };
+
+        //////////
+
+        /*
+         * detached_then_helper structure
+         *
+         * These provide a function for catching exceptions and forwarding the result of the callbacks to the promise.
+         *
+         * It also accounts for void callbacks which don't return anything.
+         * */
+
+        template <typename T>
+        struct detached_then_helper {
+            template <typename Functor, typename K>
+            static inline void dispatch( std::promise<T> &p, std::future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    p.set_value( then_helper<K, Functor>::dispatch( std::forward<std::future<K>>( s ), std::forward<Functor>( f )));
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+
+            template <typename Functor, typename K>
+            static inline void dispatch( std::promise<T> &p, std::shared_future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    p.set_value( then_helper<K, Functor>::dispatch( std::forward<std::shared_future<K>>( s ), std::forward<Functor>( f )));
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        /*
+         * Specialization for void Functors
+         * */
+        template <>
+        struct detached_then_helper<void> {
+            template <typename Functor, typename K>
+            static inline void dispatch( std::promise<void> &p, std::future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    then_helper<K, Functor>::dispatch( std::forward<std::future<K>>( s ), std::forward<Functor>( f ));
+
+                    p.set_value();
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+
+            template <typename Functor, typename K>
+            static inline void dispatch( std::promise<void> &p, std::shared_future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    then_helper<K, Functor>::dispatch( std::forward<std::shared_future<K>>( s ), std::forward<Functor>( f ));
+
+                    p.set_value();
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        /*
+         * Non-blocking readiness check for std futures. Deferred futures are never considered ready.
+         * */
+        template <typename Future>
+        inline bool is_future_ready( const Future &f ) {
+            return f.valid() && f.wait_for( std::chrono::seconds( 0 )) == std::future_status::ready;
+        }
+    }
+
+    namespace detail {
+        /*
+         * The Thenable types don't derive from their std counterparts, so this maps them over for the purposes of implicit_result_of
+         * */
+        template <typename T>
+        struct std_future_type {
+            typedef T type;
+        };
+
+        template <typename T>
+        struct std_future_type<T &> {
+            typedef typename std_future_type<T>::type &type;
+        };
+
+        template <typename T>
+        struct std_future_type<ThenableFuture<T>> {
+            typedef std::future<T> type;
+        };
+
+        template <typename T>
+        struct std_future_type<ThenableSharedFuture<T>> {
+            typedef std::shared_future<T> type;
+        };
+
+        template <typename T>
+        struct std_future_type<const ThenableSharedFuture<T>> {
+            typedef std::shared_future<T> type;
+        };
+
+        template <typename T>
+        struct std_future_type<ThenablePromise<T>> {
+            typedef std::future<T> type;
+        };
+    }
+
+    //This is fun...
+    template <typename Functor, typename FutureType, typename StdFutureType = typename detail::std_future_type<FutureType>::type>
+    using implicit_result_of = decltype( detail::then_helper<typename detail::get_future_type<typename std::remove_reference<StdFutureType>::type>::type, Functor>::dispatch(
+        std::forward<StdFutureType>( std::declval<StdFutureType>()), std::forward<Functor>( std::declval<Functor>())));
+
+    //////////
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &, Functor &&, std::launch = default_policy );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&, Functor &&, std::launch = default_policy );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( const std::shared_future<T> &, Functor &&, std::launch = default_policy );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&, Functor &&, std::launch = default_policy );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &, Functor &&, std::launch = default_policy );
+
+    //////////
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &, Functor &&, then_launch );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&, Functor &&, then_launch );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( const std::shared_future<T> &, Functor &&, then_launch );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&, Functor &&, then_launch );
+
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &, Functor &&, then_launch );
+
+    //////////
+
+    template <typename T, typename Functor, typename Executor>
+    detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::future<T> &, Functor &&, Executor );
+
+    template <typename T, typename Functor, typename Executor>
+    detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::future<T> &&, Functor &&, Executor );
+
+    template <typename T, typename Functor, typename Executor>
+    detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::shared_future<T>>>> then( std::shared_future<T>, Functor &&, Executor );
+
+    template <typename T, typename Functor, typename Executor>
+    detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::promise<T> &, Functor &&, Executor );
+
+    //////////
+
+    template <typename T, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenableFuture<T> &&, Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenableFuture<T> &, Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<implicit_result_of<Functor, std::shared_future<T>>> then( const ThenableSharedFuture<T> &, Functor &&, LaunchPolicy = default_policy );
+
+    template <typename T, typename Functor, typename LaunchPolicy = std::launch>
+    ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenablePromise<T> &, Functor &&, LaunchPolicy = default_policy );
+
+    /*
+     * then function
+     *
+     * This is the overload of then that resolves futures and promises and invokes a callback with the
+     * resulting value. It uses the standard std::async for asynchronous invocation.
+     * */
+
+    /*
+     * Overload for simple futures
+     * */
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&s, Functor &&f, std::launch policy ) {
+        return std::async( policy, [policy]( std::future<T> &&s2, Functor &&f2 ) {
+            return detail::then_helper<T, Functor>::dispatch( std::forward<std::future<T>>( s2 ), std::forward<Functor>( f2 ));
+        }, std::forward<std::future<T>>( s ), std::forward<Functor>( f ));
+    };
+
+    /*
+     * Overload for futures by references. It will take ownership and forward the future,
+     * calling the above overload.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &s, Functor &&f, std::launch policy ) {
+        return then( std::forward<std::future<T>>( s ), std::forward<Functor>( f ), policy );
+    };
+
+    /*
+     * Overloads for shared_futures. Since they can be copied, lvalues are just copied into the rvalue overload.
+     * It's similar to the first overload, but can capture the shared_future in the lambda.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&s, Functor &&f, std::launch policy ) {
+        return std::async( policy, [policy]( std::shared_future<T> &&s2, Functor &&f2 ) {
+            return detail::then_helper<T, Functor>::dispatch( std::forward<std::shared_future<T>>( s2 ), std::forward<Functor>( f2 ));
+        }, std::forward<std::shared_future<T>>( s ), std::forward<Functor>( f ));
+    };
+
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( const std::shared_future<T> &s, Functor &&f, std::launch policy ) {
+        return then( std::shared_future<T>( s ), std::forward<Functor>( f ), policy );
+    };
+
+    /*
+     * Overload for promise references. The promise is NOT moved, but rather the future is acquired
+     * from it and the promise is left intact, so it can be used elsewhere.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &s, Functor &&f, std::launch policy ) {
+        return then( s.get_future(), std::forward<Functor>( f ), policy );
+    };
+
+    //////////
+
+    /*
+     * then function with detached launch flag.
+     *
+     * These are the same as the normal then functions, but launch the future resolution in a new thread
+     * to immediately wait on them and execute the callbacks. That way the future destructors don't block the main thread.
+     * */
+
+    /*
+     * Overload for simple futures
+     * */
+    template <typename T, typename Functor>
+    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&s, Functor &&f, then_launch policy ) {
+        //I don't really like having to do this, but I don't feel like rewriting almost all the recursive template logic above
+        typedef implicit_result_of<Functor, std::future<T>> P;
+
+        assert( policy == then_launch::detached || policy == then_launch::inline_if_ready );
+
+        if( policy == then_launch::inline_if_ready && detail::is_future_ready( s )) {
+            std::promise<P> p;
+
+            std::future<P> result = p.get_future();
+
+            detail::detached_then_helper<P>::dispatch( p, std::forward<std::future<T>>( s ), std::forward<Functor>( f ));
+
+            return result;
+        }
+
+        /*
+         * A shared pointer is used to keep the shared state of the future alive in both threads until it's resolved
+         * */
+
+        auto p = std::make_shared<std::promise<P>>();
+
+        detail::note_thread_spawn();
+
+        std::thread( [p]( std::future<T> &&s2, Functor &&f2 ) {
+            detail::detached_then_helper<P>::dispatch( *p, std::forward<std::future<T>>( s2 ), std::forward<Functor>( f2 ));
+        }, std::forward<std::future<T>>( s ), std::forward<Functor>( f )).detach();
+
+        return p->get_future();
+    };
+
+    /*
+     * Overload for futures by references. It will take ownership and move the future,
+     * calling the above overload.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &s, Functor &&f, then_launch policy ) {
+        return then( std::move( s ), std::forward<Functor>( f ), policy );
+    };
+
+    /*
+     * Overloads for shared_futures. Since they can be copied, lvalues are just copied into the rvalue overload.
+     * It's similar to the first overload, but can capture the shared_future in the lambda.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&s, Functor &&f, then_launch policy ) {
+        //I don't really like having to do this, but I don't feel like rewriting almost all the recursive template logic above
+        typedef implicit_result_of<Functor, std::shared_future<T>> P;
+
+        assert( policy == then_launch::detached || policy == then_launch::inline_if_ready );
+
+        if( policy == then_launch::inline_if_ready && detail::is_future_ready( s )) {
+            std::promise<P> p;
+
+            std::future<P> result = p.get_future();
+
+            detail::detached_then_helper<P>::dispatch( p, std::forward<std::shared_future<T>>( s ), std::forward<Functor>( f ));
+
+            return result;
+        }
+
+        /*
+         * A shared pointer is used to keep the shared state of the future alive in both threads until it's resolved
+         * */
+
+        auto p = std::make_shared<std::promise<P>>();
+
+        detail::note_thread_spawn();
+
+        std::thread( [p]( std::shared_future<T> &&s2, Functor &&f2 ) {
+            detail::detached_then_helper<P>::dispatch( *p, std::forward<std::shared_future<T>>( s2 ), std::forward<Functor>( f2 ));
+        }, std::forward<std::shared_future<T>>( s ), std::forward<Functor>( f )).detach();
+
+        return p->get_future();
+    };
+
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( const std::shared_future<T> &s, Functor &&f, then_launch policy ) {
+        return then( std::shared_future<T>( s ), std::forward<Functor>( f ), policy );
+    };
+
+    /*
+     * Overload for promise references. The promise is NOT moved, but rather the future is acquired
+     * from it and the promise is left intact, so it can be used elsewhere.
+     * */
+    template <typename T, typename Functor>
+    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &s, Functor &&f, then_launch policy ) {
+        return then( s.get_future(), std::forward<Functor>( f ), policy );
+    };
+
+    //////////
+
+    /*
+     * then2 is a variation of then that returns a ThenableFuture instead of a normal future
+     * */
+    template <typename FutureType, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<implicit_result_of<Functor, FutureType>> then2( FutureType &&s, Functor &&f, LaunchPolicy policy ) {
+        return to_thenable( then( std::forward<FutureType>( s ), std::forward<Functor>( f ), policy ));
+    }
+
+    template <typename FutureType, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<implicit_result_of<Functor, FutureType>> then2( FutureType &s, Functor &&f, LaunchPolicy policy ) {
+        return to_thenable( then( s, std::forward<Functor>( f ), policy ));
+    }
+
+    //////////
+
+    namespace detail {
+        template <typename S>
+        inline void check_state( const state_ptr<S> &s ) {
+            if( !s ) {
+                throw std::future_error( std::future_errc::no_state );
+            }
+        }
+
+        /*
+         * adopt_helper takes care of moving the result of a std::future or std::shared_future into a shared state
+         * */
+        template <typename T>
+        struct adopt_helper {
+            template <typename Future>
+            static inline void resolve( shared_state<T> &s, Future &f ) THENABLE_NOEXCEPT {
+                try {
+                    s.set_value( f.get());
+
+                } catch( ... ) {
+                    s.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        template <>
+        struct adopt_helper<void> {
+            template <typename Future>
+            static inline void resolve( shared_state<void> &s, Future &f ) THENABLE_NOEXCEPT {
+                try {
+                    f.get();
+
+                    s.set_value();
+
+                } catch( ... ) {
+                    s.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        /*
+         * There is no way to be notified when a std::future becomes ready, so unless it already is,
+         * the adopted state is resolved by whoever needs the value first. See shared_state_base::add_continuation.
+         * */
+        template <typename T, typename Future>
+        inline state_ptr<shared_state<T>> adopt_future( Future &&f ) {
+            state_ptr<shared_state<T>> s;
+
+            if( f.valid()) {
+                s = make_state<T>();
+
+                if( f.wait_for( std::chrono::seconds( 0 )) == std::future_status::ready ) {
+                    adopt_helper<T>::resolve( *s, f );
+
+                } else {
+                    s->set_deferred( [state = s.get(), f2 = std::forward<Future>( f )]() mutable {
+                        adopt_helper<T>::resolve( *state, f2 );
+                    } );
+                }
+            }
+
+            return s;
+        }
+
+        /*
+         * bridge_helper does the opposite of adopt_helper, moving or copying the value of a shared state into a std::promise
+         * */
+        template <typename T>
+        struct bridge_helper {
+            static inline void take( std::promise<T> &p, shared_state<T> &s ) THENABLE_NOEXCEPT {
+                try {
+                    p.set_value( s.take());
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+
+            static inline void copy( std::promise<T> &p, shared_state<T> &s ) THENABLE_NOEXCEPT {
+                try {
+                    p.set_value( s.get());
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        template <>
+        struct bridge_helper<void> {
+            static inline void take( std::promise<void> &p, shared_state<void> &s ) THENABLE_NOEXCEPT {
+                try {
+                    s.take();
+
+                    p.set_value();
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+
+            static inline void copy( std::promise<void> &p, shared_state<void> &s ) THENABLE_NOEXCEPT {
+                try {
+                    s.get();
+
+                    p.set_value();
+
+                } catch( ... ) {
+                    p.set_exception( std::current_exception());
+                }
+            }
+        };
+
+        template <typename T>
+        inline std::future<T> bridge_future( state_ptr<shared_state<T>> &&s ) {
+            if( !s ) {
+                return std::future<T>();
+
+            } else if( s->is_deferred()) {
+                //Keep it lazy
+                return std::async( std::launch::deferred, [s2 = std::move( s )]() -> T {
+                    return s2->take();
+                } );
+            }
+
+            std::promise<T> p;
+
+            std::future<T> f = p.get_future();
+
+            shared_state<T> &state = *s;
+
+            state.add_continuation( [s2 = std::move( s ), p2 = std::move( p )]() mutable {
+                bridge_helper<T>::take( p2, *s2 );
+            } );
+
+            return f;
+        }
+
+        template <typename T>
+        inline std::shared_future<T> bridge_shared_future( const state_ptr<shared_state<T>> &s ) {
+            if( !s ) {
+                return std::shared_future<T>();
+            }
+
+            std::promise<T> p;
+
+            std::shared_future<T> f = p.get_future().share();
+
+            s->add_continuation( [s2 = s, p2 = std::move( p )]() mutable {
+                bridge_helper<T>::copy( p2, *s2 );
+            } );
+
+            return f;
+        }
+    }
+
+    //////////
+
+    /*
+     * This is a promise object functionally equivalent to std::promise, but the futures it creates
+     * invoke their continuations as soon as a value is set, rather than having a thread wait on them.
+     * */
+
+    template <typename T>
+    class ThenablePromise {
+            friend struct detail::state_access;
+
+            typedef detail::shared_state<T> state_type;
+
+            detail::state_ptr<state_type> _state;
+            bool                          _future_retrieved = false;
+
+            /*
+             * Used when the future has already been handed out some other way
+             * */
+            inline explicit ThenablePromise( detail::state_ptr<state_type> &&s ) THENABLE_NOEXCEPT
+                : _state( std::move( s )), _future_retrieved( true ) {}
+
+        public:
+            inline ThenablePromise() : _state( detail::make_state<T>()) {}
+
+            /*
+             * Allocates the shared state with the given allocator, like std::promise
+             * */
+            template <typename Alloc>
+            inline ThenablePromise( std::allocator_arg_t, const Alloc &alloc ) : _state( detail::make_state<T>( alloc )) {}
+
+            inline explicit ThenablePromise( std::pmr::memory_resource *resource )
+                : ThenablePromise( std::allocator_arg, std::pmr::polymorphic_allocator<char>( resource )) {}
+
+            inline ThenablePromise( ThenablePromise &&p ) THENABLE_NOEXCEPT
+                : _state( std::move( p._state )), _future_retrieved( p._future_retrieved ) {}
+
+            ThenablePromise( const ThenablePromise & ) = delete;
+
+            ThenablePromise &operator=( const ThenablePromise & ) = delete;
+
+            inline ThenablePromise &operator=( ThenablePromise &&p ) THENABLE_NOEXCEPT {
+                ThenablePromise( std::forward<ThenablePromise>( p )).swap( *this );
+
+                return *this;
+            }
+
+            /*
+             * Just like std::promise, abandoning the shared state stores a broken_promise error in it
+             * */
+            inline ~ThenablePromise() {
+                if( _state && !_state->is_ready()) {
+                    _state->set_exception( std::make_exception_ptr( std::future_error( std::future_errc::broken_promise )));
+                }
+            }
+
+            inline void swap( ThenablePromise &other ) THENABLE_NOEXCEPT {
+                std::swap( _state, other._state );
+                std::swap( _future_retrieved, other._future_retrieved );
+            }
+
+            inline ThenableFuture<T> get_future() {
+                detail::check_state( _state );
+
+                if( _future_retrieved ) {
+                    throw std::future_error( std::future_errc::future_already_retrieved );
+                }
+
+                _future_retrieved = true;
+
+                return detail::state_access::make<ThenableFuture<T>>( detail::state_ptr<state_type>( _state ));
+            }
+
+            inline ThenableFuture<T> get_thenable_future() {
+                return get_future();
+            }
+
+            template <typename... Args>
+            inline void set_value( Args &&... args ) {
+                detail::check_state( _state );
+
+                _state->set_value( std::forward<Args>( args )... );
+            }
+
+            inline void set_exception( std::exception_ptr e ) {
+                detail::check_state( _state );
+
+                _state->set_exception( e );
+            }
+
+            template <typename Functor, typename LaunchPolicy = std::launch>
+            inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) {
+                return then2( get_future(), std::forward<Functor>( f ), policy );
+            }
+    };
+
+    /*
+     * This is a future object functionally equivalent to std::future,
+     * but with a .then function to chain together many futures.
+     * */
+
+    template <typename T>
+    class ThenableFuture {
+            friend struct detail::state_access;
+
+            typedef detail::shared_state<T> state_type;
+
+            detail::state_ptr<state_type> _state;
+            detail::ready_result<T>       _ready;
+
+            inline explicit ThenableFuture( detail::state_ptr<state_type> &&s ) THENABLE_NOEXCEPT : _state( std::move( s )) {}
+
+            inline explicit ThenableFuture( detail::ready_result<T> &&r ) THENABLE_NOEXCEPT : _ready( std::move( r )) {}
+
+            /*
+             * Moves a ready result into a new shared state, for anything that needs one
+             * */
+            inline void materialize() {
+                if( !_ready.empty()) {
+                    _state = detail::make_state<T>();
+
+                    _ready.store( *_state );
+                }
+            }
+
+        public:
+            ThenableFuture() = default;
+
+            inline ThenableFuture( std::future<T> &&f ) : _state( detail::adopt_future<T>( std::forward<std::future<T>>( f ))) {}
+
+            ThenableFuture( ThenableFuture && ) THENABLE_NOEXCEPT = default;
+
+            ThenableFuture( const ThenableFuture & ) = delete;
+
+            ThenableFuture &operator=( ThenableFuture && ) THENABLE_NOEXCEPT = default;
+
+            ThenableFuture &operator=( const ThenableFuture & ) = delete;
+
+            inline operator std::future<T>() && {
+                materialize();
+
+                return detail::bridge_future( std::move( _state ));
+            }
+
+            inline bool valid() const THENABLE_NOEXCEPT {
+                return _state || !_ready.empty();
+            }
+
+            /*
+             * Non-blocking check for whether the value or exception is available yet
+             * */
+            inline bool is_ready() const THENABLE_NOEXCEPT {
+                return !_ready.empty() || ( _state && _state->is_ready());
+            }
+
+            inline T get() {
+                if( !_ready.empty()) {
+                    return _ready.take();
+                }
+
+                detail::check_state( _state );
+
+                detail::state_ptr<state_type> s = std::move( _state );
+
+                return s->take();
+            }
+
+            inline void wait() const {
+                if( _ready.empty()) {
+                    detail::check_state( _state );
+
+                    _state->wait();
+                }
+            }
+
+            template <typename Rep, typename Period>
+            inline std::future_status wait_for( const std::chrono::duration<Rep, Period> &timeout ) const {
+                if( !_ready.empty()) {
+                    return std::future_status::ready;
+                }
+
+                detail::check_state( _state );
+
+                return _state->wait_for( timeout );
+            }
+
+            template <typename Clock, typename Duration>
+            inline std::future_status wait_until( const std::chrono::time_point<Clock, Duration> &deadline ) const {
+                if( !_ready.empty()) {
+                    return std::future_status::ready;
+                }
+
+                detail::check_state( _state );
+
+                return _state->wait_until( deadline );
+            }
+
+            template <typename Functor, typename LaunchPolicy = std::launch>
+            inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) {
+                return then2( std::move( *this ), std::forward<Functor>( f ), policy );
+            }
+
+            inline ThenableSharedFuture<T> share() {
+                return ThenableSharedFuture<T>( std::move( *this ));
+            }
+
+            inline ThenableSharedFuture<T> share_thenable() {
+                return share();
+            }
+    };
+
+    template <typename T>
+    class ThenableSharedFuture {
+            friend struct detail::state_access;
+
+            typedef detail::shared_state<T> state_type;
+
+            detail::state_ptr<state_type> _state;
+
+            inline explicit ThenableSharedFuture( detail::state_ptr<state_type> &&s ) THENABLE_NOEXCEPT : _state( std::move( s )) {}
+
+        public:
+            constexpr ThenableSharedFuture() THENABLE_NOEXCEPT = default;
+
+            inline ThenableSharedFuture( const std::shared_future<T> &f ) : _state( detail::adopt_future<T>( std::shared_future<T>( f ))) {}
+
+            inline ThenableSharedFuture( std::shared_future<T> &&f ) : _state( detail::adopt_future<T>( std::forward<std::shared_future<T>>( f ))) {}
+
+            inline ThenableSharedFuture( std::future<T> &&f ) : _state( detail::adopt_future<T>( std::forward<std::future<T>>( f ))) {}
+
+            inline ThenableSharedFuture( ThenableFuture<T> &&f ) : _state( detail::state_access::release( f )) {}
+
+            ThenableSharedFuture( const ThenableSharedFuture & ) THENABLE_NOEXCEPT = default;
+
+            ThenableSharedFuture( ThenableSharedFuture && ) THENABLE_NOEXCEPT = default;
+
+            ThenableSharedFuture &operator=( const ThenableSharedFuture & ) THENABLE_NOEXCEPT = default;
+
+            ThenableSharedFuture &operator=( ThenableSharedFuture && ) THENABLE_NOEXCEPT = default;
+
+            inline operator std::shared_future<T>() const {
+                return detail::bridge_shared_future( _state );
+            }
+
+            inline bool valid() const THENABLE_NOEXCEPT {
+                return static_cast<bool>(_state);
+            }
+
+            inline bool is_ready() const THENABLE_NOEXCEPT {
+                return _state && _state->is_ready();
+            }
+
+            /*
+             * Returns const T& for value types, T& for reference types and void for void
+             * */
+            inline decltype( auto ) get() const {
+                detail::check_state( _state );
+
+                return _state->get();
+            }
+
+            inline void wait() const {
+                detail::check_state( _state );
+
+                _state->wait();
+            }
+
+            template <typename Rep, typename Period>
+            inline std::future_status wait_for( const std::chrono::duration<Rep, Period> &timeout ) const {
+                detail::check_state( _state );
+
+                return _state->wait_for( timeout );
+            }
+
+            template <typename Clock, typename Duration>
+            inline std::future_status wait_until( const std::chrono::time_point<Clock, Duration> &deadline ) const {
+                detail::check_state( _state );
+
+                return _state->wait_until( deadline );
+            }
+
+            template <typename Functor, typename LaunchPolicy = std::launch>
+            inline ThenableFuture<implicit_result_of<Functor, std::shared_future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) const {
+                return then2( *this, std::forward<Functor>( f ), policy );
+            }
+    };
+
+    //////////
+
+    namespace detail {
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( ThenableFuture<T> &&t ) {
+            return recursive_get( t.get());
+        };
+
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( ThenableSharedFuture<T> &&t ) {
+            return recursive_get( t.get());
+        };
+
+        template <>
+        inline typename recursive_get_future_type<void>::type recursive_get<void>( ThenableFuture<void> &&t ) {
+            t.get();
+        };
+
+        template <>
+        inline typename recursive_get_future_type<void>::type recursive_get<void>( ThenableSharedFuture<void> &&t ) {
+            t.get();
+        };
+
+        template <typename T>
+        inline typename recursive_get_future_type<T>::type recursive_get( ThenablePromise<T> &&t ) {
+            return recursive_get( t.get_future());
+        };
+    }
+
+    //////////
+
+    namespace detail {
+        /*
+         * invoke_unpacked does the same thing as then_invoke_helper::invoke, but without waiting on the result,
+         * so any futures returned by the callback can be chained onto instead.
+         * */
+
+        template <typename Functor, typename... Args>
+        inline decltype( auto ) invoke_unpacked( Functor &&f, std::tuple<Args...> &&args ) {
+            return invoke_tuple( std::forward<Functor>( f ), std::forward<std::tuple<Args...>>( args ));
+        }
+
+        template <typename Functor, typename T>
+        inline decltype( auto ) invoke_unpacked( Functor &&f, T &&arg ) {
+            return f( std::forward<T>( arg ));
+        }
 
         template <typename Functor>
-        struct then_helper<void, Functor> {
-            inline static decltype( auto ) dispatch( std::future<void> &&s, Functor &&f ) {
-                s.get();
+        inline decltype( auto ) invoke_unpacked( Functor &&f ) {
+            return f();
+        }
+
+        /*
+         * fulfill:
+         *
+         * This is the non-blocking counterpart to recursive_get. It stores a value in the destination state,
+         * but if the value is another future, it attaches a continuation to that future instead of waiting on it.
+         * */
+
+        template <typename R, typename V>
+        void fulfill( const state_ptr<shared_state<R>> &, V && );
+
+        template <typename R, typename U>
+        void fulfill( const state_ptr<shared_state<R>> &, ThenableFuture<U> && );
+
+        template <typename R, typename U>
+        void fulfill( const state_ptr<shared_state<R>> &, ThenableSharedFuture<U> && );
+
+        template <typename R, typename U>
+        void fulfill( const state_ptr<shared_state<R>> &, ThenablePromise<U> && );
+
+        template <typename R, typename U>
+        void fulfill( const state_ptr<shared_state<R>> &, std::future<U> && );
+
+        template <typename R, typename U>
+        void fulfill( const state_ptr<shared_state<R>> &, std::shared_future<U> && );
+
+        /*
+         * Forwards the value of a completed state on to the destination state.
+         * */
+        template <typename U>
+        struct state_forwarder {
+            template <typename R>
+            static inline void take( const state_ptr<shared_state<R>> &dest, shared_state<U> &src ) {
+                fulfill( dest, src.take());
+            }
+
+            template <typename R>
+            static inline void copy( const state_ptr<shared_state<R>> &dest, shared_state<U> &src ) {
+                fulfill( dest, src.get());
+            }
+        };
+
+        /*
+         * Same as state_forwarder, but for the result of a ready ThenableFuture
+         * */
+        template <typename U>
+        struct ready_forwarder {
+            template <typename R>
+            static inline void forward( const state_ptr<shared_state<R>> &dest, ready_result<U> &src ) {
+                fulfill( dest, src.take());
+            }
+        };
+
+        template <>
+        struct ready_forwarder<void> {
+            template <typename R>
+            static inline void forward( const state_ptr<shared_state<R>> &dest, ready_result<void> &src ) {
+                src.take();
+
+                dest->set_value();
+            }
+        };
+
+        template <>
+        struct state_forwarder<void> {
+            template <typename R>
+            static inline void take( const state_ptr<shared_state<R>> &dest, shared_state<void> &src ) {
+                src.take();
+
+                dest->set_value();
+            }
+
+            template <typename R>
+            static inline void copy( const state_ptr<shared_state<R>> &dest, shared_state<void> &src ) {
+                src.get();
+
+                dest->set_value();
+            }
+        };
+
+        template <typename R, typename V>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, V &&value ) {
+            dest->set_value( std::forward<V>( value ));
+        }
+
+        template <typename R, typename U>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, ThenableFuture<U> &&f ) {
+            ready_result<U> &ready = state_access::ready( f );
+
+            if( !ready.empty()) {
+                try {
+                    ready_forwarder<U>::forward( dest, ready );
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+
+                return;
+            }
+
+            state_ptr<shared_state<U>> src = state_access::release( f );
+
+            check_state( src );
+
+            shared_state<U> &state = *src;
+
+            state.add_continuation( [dest, src2 = std::move( src )]() THENABLE_NOEXCEPT {
+                try {
+                    state_forwarder<U>::take( dest, *src2 );
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            } );
+        }
+
+        template <typename R, typename U>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, ThenableSharedFuture<U> &&f ) {
+            state_ptr<shared_state<U>> src = state_access::release( f );
+
+            check_state( src );
+
+            shared_state<U> &state = *src;
+
+            state.add_continuation( [dest, src2 = std::move( src )]() THENABLE_NOEXCEPT {
+                try {
+                    state_forwarder<U>::copy( dest, *src2 );
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            } );
+        }
+
+        template <typename R, typename U>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, ThenablePromise<U> &&p ) {
+            fulfill( dest, p.get_future());
+        }
+
+        template <typename R, typename U>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, std::future<U> &&f ) {
+            fulfill( dest, ThenableFuture<U>( std::forward<std::future<U>>( f )));
+        }
+
+        template <typename R, typename U>
+        inline void fulfill( const state_ptr<shared_state<R>> &dest, std::shared_future<U> &&f ) {
+            fulfill( dest, ThenableSharedFuture<U>( std::forward<std::shared_future<U>>( f )));
+        }
+
+        //////////
+
+        /*
+         * invoke_into_helper invokes the callback and fulfills the destination state with whatever it returns.
+         *
+         * The specialization takes care of void callbacks.
+         * */
+
+        template <typename Result>
+        struct invoke_into_helper {
+            template <typename R, typename Functor, typename... Args>
+            static inline void invoke( const state_ptr<shared_state<R>> &dest, Functor &&f, Args &&... args ) {
+                fulfill( dest, invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... ));
+            }
+        };
+
+        template <>
+        struct invoke_into_helper<void> {
+            template <typename R, typename Functor, typename... Args>
+            static inline void invoke( const state_ptr<shared_state<R>> &dest, Functor &&f, Args &&... args ) {
+                invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... );
+
+                dest->set_value();
+            }
+        };
+
+        template <typename R, typename Functor, typename... Args>
+        inline void invoke_into( const state_ptr<shared_state<R>> &dest, Functor &&f, Args &&... args ) {
+            typedef decltype( invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... )) Result;
+
+            invoke_into_helper<Result>::invoke( dest, std::forward<Functor>( f ), std::forward<Args>( args )... );
+        }
+
+        /*
+         * then_dispatcher is the non-blocking version of then_helper. By the time it's invoked the source state is already complete,
+         * or deferred, so it can just take the value, invoke the callback and catch any exceptions.
+         * */
+
+        template <typename T>
+        struct then_dispatcher {
+            template <typename R, typename Functor>
+            static inline void dispatch( const state_ptr<shared_state<R>> &dest, shared_state<T> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    invoke_into( dest, std::forward<Functor>( f ), src.take());
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
+
+            template <typename R, typename Functor>
+            static inline void dispatch_shared( const state_ptr<shared_state<R>> &dest, shared_state<T> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    invoke_into( dest, std::forward<Functor>( f ), src.get());
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
+        };
+
+        template <>
+        struct then_dispatcher<void> {
+            template <typename R, typename Functor>
+            static inline void dispatch( const state_ptr<shared_state<R>> &dest, shared_state<void> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                try {
+                    src.take();
+
+                    invoke_into( dest, std::forward<Functor>( f ));
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
+
+            template <typename R, typename Functor>
+            static inline void dispatch_shared( const state_ptr<shared_state<R>> &dest, shared_state<void> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                dispatch( dest, src, std::forward<Functor>( f ));
+            }
+        };
+
+        //////////
+
+        /*
+         * schedule_continuation:
+         *
+         * Attaches a task to the source state according to the launch policy. The task is given the destination state when it runs,
+         * so that deferred tasks, which are owned by the destination state, don't have to keep it alive themselves.
+         * */
+
+        template <typename D, typename Task>
+        inline void schedule_continuation( shared_state_base &src, const state_ptr<D> &dest, Task &&task, std::launch policy ) {
+            if( policy == std::launch::deferred ) {
+                dest->set_deferred( [d = dest.get(), task2 = instrument( std::forward<Task>( task ))]() mutable {
+                    task2( state_ptr<D>::from_this( d ));
+                } );
+
+            } else if( policy == std::launch::async ) {
+                src.add_continuation( [dest, task2 = std::forward<Task>( task )]() mutable {
+                    note_thread_spawn();
+
+                    std::thread( [dest2 = std::move( dest ), task3 = instrument( std::move( task2 ))]() mutable {
+                        task3( dest2 );
+                    } ).detach();
+                } );
+
+            } else {
+                src.add_continuation( [dest, task2 = std::forward<Task>( task )]() mutable {
+                    instrument( std::move( task2 ))( dest );
+                } );
+            }
+        }
+
+        template <typename D, typename Task>
+        inline void schedule_continuation( shared_state_base &src, const state_ptr<D> &dest, Task &&task, then_launch policy ) {
+            if( policy == then_launch::inline_if_ready && src.is_ready()) {
+                instrument( std::forward<Task>( task ))( dest );
+
+            } else {
+                schedule_continuation( src, dest, std::forward<Task>( task ), std::launch::async );
+            }
+        }
+
+        template <typename D, typename Task, typename Executor>
+        inline enable_if_executor_t<Executor> schedule_continuation( shared_state_base &src, const state_ptr<D> &dest, Task &&task, Executor executor ) {
+            src.add_continuation( [dest, executor, task2 = std::forward<Task>( task )]() mutable {
+                execute( executor, [dest2 = std::move( dest ), task3 = instrument( std::move( task2 ))]() mutable {
+                    task3( dest2 );
+                } );
+            } );
+        }
+
+        /*
+         * launch_into:
+         *
+         * Runs a task that fulfills the destination state according to the launch policy, when there is no source state to wait on.
+         * Like schedule_continuation, the task is given the destination state when it runs.
+         * */
+
+        template <typename D, typename Task>
+        inline void launch_into( const state_ptr<D> &dest, Task &&task, std::launch policy ) {
+            if( policy == std::launch::deferred ) {
+                dest->set_deferred( [d = dest.get(), task2 = instrument( std::forward<Task>( task ))]() mutable {
+                    task2( state_ptr<D>::from_this( d ));
+                } );
+
+            } else if( policy == std::launch::async ) {
+                note_thread_spawn();
+
+                std::thread( [dest2 = dest, task2 = instrument( std::forward<Task>( task ))]() mutable {
+                    task2( dest2 );
+                } ).detach();
+
+            } else {
+                instrument( std::forward<Task>( task ))( dest );
+            }
+        }
+
+        template <typename D, typename Task>
+        inline void launch_into( const state_ptr<D> &dest, Task &&task, then_launch policy ) {
+            //There is nothing to wait on, so inline_if_ready always runs inline
+            launch_into( dest, std::forward<Task>( task ), policy == then_launch::inline_if_ready ? std::launch::async | std::launch::deferred : std::launch::async );
+        }
+
+        template <typename D, typename Task, typename Executor>
+        inline enable_if_executor_t<Executor> launch_into( const state_ptr<D> &dest, Task &&task, Executor executor ) {
+            execute( executor, [dest2 = dest, task2 = instrument( std::forward<Task>( task ))]() mutable {
+                task2( dest2 );
+            } );
+        }
+
+        /*
+         * launch_detached runs a task that nothing is going to wait on, either on a new thread or on an executor
+         * */
+        template <typename Task>
+        inline void launch_detached( then_launch, Task &&task ) {
+            note_thread_spawn();
+
+            std::thread( instrument( std::forward<Task>( task ))).detach();
+        }
+
+        template <typename Executor, typename Task>
+        inline enable_if_executor_t<Executor> launch_detached( Executor &executor, Task &&task ) {
+            execute( executor, instrument( std::forward<Task>( task )));
+        }
+
+        /*
+         * Nothing waits on the intermediate state of a cancellable or deadline policy, so deferred tasks would never run
+         * */
+        template <typename LaunchPolicy>
+        inline LaunchPolicy undeferred( LaunchPolicy policy ) {
+            return policy;
+        }
+
+        inline std::launch undeferred( std::launch policy ) {
+            return policy == std::launch::deferred ? default_policy : policy;
+        }
+
+        /*
+         * Resolves the destination with whichever comes first, the result of the source or the cancellation of the token
+         * */
+        template <typename T>
+        inline void race_cancellation( const state_ptr<shared_state<T>> &dest, state_ptr<shared_state<T>> &&src, const cancellation_token &token ) {
+            struct race {
+                state_ptr<shared_state<T>> dest;
+                std::atomic_bool           done{false};
+
+                inline explicit race( const state_ptr<shared_state<T>> &d ) : dest( d ) {}
+
+                inline bool claim() THENABLE_NOEXCEPT {
+                    return !done.exchange( true, std::memory_order_acq_rel );
+                }
+            };
+
+            auto r = std::make_shared<race>( dest );
+
+            cancellation_registration registration = token.on_cancel( [r]() THENABLE_NOEXCEPT {
+                if( r->claim()) {
+                    r->dest->set_exception( make_cancelled_exception());
+                }
+            } );
+
+            shared_state<T> &state = *src;
+
+            state.add_continuation( [r, src2 = std::move( src ), registration2 = std::move( registration )]() mutable THENABLE_NOEXCEPT {
+                registration2.reset();
+
+                if( r->claim()) {
+                    try {
+                        state_forwarder<T>::take( r->dest, *src2 );
+
+                    } catch( ... ) {
+                        r->dest->set_exception( std::current_exception());
+                    }
+                }
+            } );
+        }
+
+        /*
+         * Cancellable policies wrap the task so that it checks the token right before it would run,
+         * and just resolves the destination with a cancelled_error if it's been cancelled.
+         * */
+        template <typename Task>
+        inline auto cancellable_task( const cancellation_token &token, Task &&task ) {
+            return [token, task2 = std::forward<Task>( task )]( const auto &dest ) mutable {
+                if( token.is_cancelled()) {
+                    dest->set_exception( make_cancelled_exception());
+
+                } else {
+                    task2( dest );
+                }
+            };
+        }
 
-                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ));
-            }
+        /*
+         * The task runs into an intermediate state that's raced against the token, so the destination is resolved
+         * with a cancelled_error as soon as the token is cancelled, even while the task is still waiting on its source.
+         * */
+        template <typename D, typename Task, typename LaunchPolicy>
+        inline void schedule_continuation( shared_state_base &src, const state_ptr<D> &dest, Task &&task, cancellable_policy<LaunchPolicy> policy ) {
+            auto mid = make_state<typename D::value_type>();
 
-            inline static decltype( auto ) dispatch( std::shared_future<void> &&s, Functor &&f ) {
-                s.get();
+            schedule_continuation( src, mid, cancellable_task( policy.token, std::forward<Task>( task )), undeferred( policy.policy ));
 
-                return then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ));
+            race_cancellation( dest, std::move( mid ), policy.token );
+        }
+
+        template <typename D, typename Task, typename LaunchPolicy>
+        inline void launch_into( const state_ptr<D> &dest, Task &&task, cancellable_policy<LaunchPolicy> policy ) {
+            auto mid = make_state<typename D::value_type>();
+
+            launch_into( mid, cancellable_task( policy.token, std::forward<Task>( task )), undeferred( policy.policy ));
+
+            race_cancellation( dest, std::move( mid ), policy.token );
+        }
+
+        /*
+         * Detached tasks have no destination of their own, so they're launched as usual.
+         * Everything that launches one with a cancellable policy takes care of the token itself.
+         * */
+        template <typename LaunchPolicy, typename Task>
+        inline void launch_detached( cancellable_policy<LaunchPolicy> &policy, Task &&task ) {
+            launch_detached( policy.policy, std::forward<Task>( task ));
+        }
+
+        /*
+         * Resolves the destination with whichever comes first, the result of the source or the deadline
+         * */
+        template <typename T>
+        inline void race_deadline( const state_ptr<shared_state<T>> &dest, state_ptr<shared_state<T>> &&src,
+                                   std::chrono::steady_clock::time_point deadline, const timer_wheel &timer ) {
+            struct race {
+                state_ptr<shared_state<T>> dest;
+                std::atomic_bool           done{false};
+
+                inline explicit race( const state_ptr<shared_state<T>> &d ) : dest( d ) {}
+
+                inline bool claim() THENABLE_NOEXCEPT {
+                    return !done.exchange( true, std::memory_order_acq_rel );
+                }
+            };
+
+            if( src->is_ready()) {
+                try {
+                    state_forwarder<T>::take( dest, *src );
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+
+                return;
             }
+
+            auto r = std::make_shared<race>( dest );
+
+            //Completing the destination runs its continuations, which must never end up on the timer thread
+            timer_handle handle = timer.schedule_at( deadline, [r]() THENABLE_NOEXCEPT {
+                if( r->claim()) {
+                    try {
+                        execute( default_executor(), instrument( [r] {
+                            r->dest->set_exception( make_timeout_exception());
+                        } ));
+
+                    } catch( ... ) {
+                        r->dest->set_exception( make_timeout_exception());
+                    }
+                }
+            } );
+
+            shared_state<T> &state = *src;
+
+            state.add_continuation( [r, src2 = std::move( src ), handle2 = std::move( handle )]() mutable THENABLE_NOEXCEPT {
+                handle2.cancel();
+
+                if( r->claim()) {
+                    try {
+                        state_forwarder<T>::take( r->dest, *src2 );
+
+                    } catch( ... ) {
+                        r->dest->set_exception( std::current_exception());
+                    }
+                }
+            } );
+        }
+
+        /*
+         * Deadline policies run the task into an intermediate state and race that against the deadline,
+         * and the task itself is dropped if it would start after the deadline.
+         * */
+        template <typename Task>
+        inline auto deadline_task( std::chrono::steady_clock::time_point deadline, Task &&task ) {
+            return [deadline, task2 = std::forward<Task>( task )]( const auto &dest ) mutable {
+                if( std::chrono::steady_clock::now() >= deadline ) {
+                    dest->set_exception( make_timeout_exception());
+
+                } else {
+                    task2( dest );
+                }
+            };
+        }
+
+        template <typename D, typename Task, typename LaunchPolicy>
+        inline void schedule_continuation( shared_state_base &src, const state_ptr<D> &dest, Task &&task, deadline_policy<LaunchPolicy> policy ) {
+            auto mid = make_state<typename D::value_type>();
+
+            schedule_continuation( src, mid, deadline_task( policy.deadline, std::forward<Task>( task )), undeferred( policy.policy ));
+
+            race_deadline( dest, std::move( mid ), policy.deadline, default_timer());
+        }
+
+        template <typename D, typename Task, typename LaunchPolicy>
+        inline void launch_into( const state_ptr<D> &dest, Task &&task, deadline_policy<LaunchPolicy> policy ) {
+            auto mid = make_state<typename D::value_type>();
+
+            launch_into( mid, deadline_task( policy.deadline, std::forward<Task>( task )), undeferred( policy.policy ));
+
+            race_deadline( dest, std::move( mid ), policy.deadline, default_timer());
+        }
+
+        template <typename LaunchPolicy, typename Task>
+        inline void launch_detached( deadline_policy<LaunchPolicy> &policy, Task &&task ) {
+            launch_detached( policy.policy, std::forward<Task>( task ));
+        }
+    }
+
+    /*
+     * Ready futures
+     *
+     * These create a ThenableFuture that already holds its value or exception, without allocating a shared state.
+     * then, recursive_get and await_all all check for them and complete right away.
+     * */
+
+    template <typename T>
+    inline ThenableFuture<typename std::decay<T>::type> make_ready_future( T &&value ) {
+        detail::ready_result<typename std::decay<T>::type> r;
+
+        r.set_value( std::forward<T>( value ));
+
+        return detail::state_access::make_ready( std::move( r ));
+    }
+
+    inline ThenableFuture<void> make_ready_future() {
+        detail::ready_result<void> r;
+
+        r.set_value();
+
+        return detail::state_access::make_ready( std::move( r ));
+    }
+
+    template <typename T>
+    inline ThenableFuture<T> make_exceptional_future( std::exception_ptr e ) {
+        detail::ready_result<T> r;
+
+        r.exception = std::move( e );
+
+        return detail::state_access::make_ready( std::move( r ));
+    }
+
+    template <typename T, typename E>
+    inline ThenableFuture<T> make_exceptional_future( E e ) {
+        return make_exceptional_future<T>( std::make_exception_ptr( std::move( e )));
+    }
+
+    namespace detail {
+        /*
+         * Whether a launch policy would run the continuation on the calling thread if the value is already available
+         * */
+        template <typename LaunchPolicy>
+        constexpr bool runs_inline_if_ready( const LaunchPolicy & ) {
+            return false;
+        }
+
+        constexpr bool runs_inline_if_ready( std::launch policy ) {
+            return policy != std::launch::deferred && policy != std::launch::async;
+        }
+
+        constexpr bool runs_inline_if_ready( then_launch policy ) {
+            return policy == then_launch::inline_if_ready;
+        }
+
+        template <typename LaunchPolicy>
+        inline bool runs_inline_if_ready( const cancellable_policy<LaunchPolicy> &policy ) {
+            return !policy.token.is_cancelled() && runs_inline_if_ready( policy.policy );
+        }
+
+        template <typename T, typename = void>
+        struct is_future_like : std::false_type {
         };
 
-        //////////
+        template <typename T>
+        struct is_future_like<T, std::void_t<typename get_future_type<T>::type>> : std::true_type {
+        };
+
+        template <typename R, typename... V>
+        inline ThenableFuture<R> ready_future( V &&... v ) {
+            ready_result<R> r;
+
+            r.set_value( std::forward<V>( v )... );
+
+            return state_access::make_ready( std::move( r ));
+        }
 
         /*
-         * detached_then_helper structure
-         *
-         * These provide a function for catching exceptions and forwarding the result of the callbacks to the promise.
-         *
-         * It also accounts for void callbacks which don't return anything.
+         * Callbacks that return another future still need a state to flatten it into, unless it's already the right type
          * */
+        template <typename R>
+        inline ThenableFuture<R> flatten_ready( ThenableFuture<R> &&f ) {
+            return std::move( f );
+        }
+
+        template <typename R, typename F>
+        inline ThenableFuture<R> flatten_ready( F &&f ) {
+            auto dest = make_state<R>();
+
+            fulfill( dest, std::forward<F>( f ));
+
+            return state_access::make<ThenableFuture<R>>( std::move( dest ));
+        }
+
+        template <typename Result, bool = is_future_like<typename std::decay<Result>::type>::value>
+        struct ready_invoker {
+            template <typename R, typename Functor, typename... Args>
+            static inline ThenableFuture<R> invoke( Functor &&f, Args &&... args ) {
+                return ready_future<R>( invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... ));
+            }
+        };
+
+        template <typename Result>
+        struct ready_invoker<Result, true> {
+            template <typename R, typename Functor, typename... Args>
+            static inline ThenableFuture<R> invoke( Functor &&f, Args &&... args ) {
+                return flatten_ready<R>( invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... ));
+            }
+        };
+
+        template <>
+        struct ready_invoker<void, false> {
+            template <typename R, typename Functor, typename... Args>
+            static inline ThenableFuture<R> invoke( Functor &&f, Args &&... args ) {
+                invoke_unpacked( std::forward<Functor>( f ), std::forward<Args>( args )... );
+
+                return ready_future<R>();
+            }
+        };
 
+        /*
+         * Invokes a continuation on a ready result, and returns another ready future unless the continuation itself returned a future
+         * */
         template <typename T>
-        struct detached_then_helper {
-            template <typename Functor, typename K>
-            static inline void dispatch( std::promise<T> &p, std::future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
+        struct ready_dispatcher {
+            template <typename R, typename Functor>
+            static inline ThenableFuture<R> dispatch( ready_result<T> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                typedef decltype( invoke_unpacked( std::declval<Functor>(), std::declval<T>())) Result;
+
                 try {
-                    p.set_value( then_helper<K, Functor>::dispatch( std::forward<std::future<K>>( s ), std::forward<Functor>( f )));
+                    return ready_invoker<Result>::template invoke<R>( std::forward<Functor>( f ), src.take());
 
                 } catch( ... ) {
-                    p.set_exception( std::current_exception());
+                    return make_exceptional_future<R>( std::current_exception());
                 }
             }
+        };
+
+        template <>
+        struct ready_dispatcher<void> {
+            template <typename R, typename Functor>
+            static inline ThenableFuture<R> dispatch( ready_result<void> &src, Functor &&f ) THENABLE_NOEXCEPT {
+                typedef decltype( invoke_unpacked( std::declval<Functor>())) Result;
 
-            template <typename Functor, typename K>
-            static inline void dispatch( std::promise<T> &p, std::shared_future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
                 try {
-                    p.set_value( then_helper<K, Functor>::dispatch( std::forward<std::shared_future<K>>( s ), std::forward<Functor>( f )));
+                    src.take();
+
+                    return ready_invoker<Result>::template invoke<R>( std::forward<Functor>( f ));
 
                 } catch( ... ) {
-                    p.set_exception( std::current_exception());
+                    return make_exceptional_future<R>( std::current_exception());
                 }
             }
         };
+    }
+
+    /*
+     * then function for Thenable types
+     *
+     * These don't go through std::async at all. The callback is registered on the shared state of the future,
+     * and is scheduled according to the launch policy once the value is available, so no thread has to wait on it.
+     * */
+
+    namespace detail {
+        /*
+         * then_as does the work of `then` for ThenableFuture, given the flattened result type up front.
+         * Since it doesn't have to work that out from the functor's signature, the functor can be generic.
+         * */
+        template <typename R, typename T, typename Functor, typename LaunchPolicy>
+        ThenableFuture<R> then_as( ThenableFuture<T> &&s, Functor &&f, LaunchPolicy policy ) {
+            ready_result<T> &ready = state_access::ready( s );
+
+            if( !ready.empty() && runs_inline_if_ready( policy )) {
+                return ready_dispatcher<T>::template dispatch<R>( ready, std::forward<Functor>( f ));
+            }
+
+            state_ptr<shared_state<T>> src = state_access::release( s );
+
+            check_state( src );
+
+            auto dest = make_state<R>();
+
+            shared_state<T> &state = *src;
+
+            schedule_continuation( state, dest, [src2 = std::move( src ), f2 = std::forward<Functor>( f )]( const state_ptr<shared_state<R>> &d ) mutable {
+                then_dispatcher<T>::dispatch( d, *src2, std::move( f2 ));
+            }, policy );
+
+            return state_access::make<ThenableFuture<R>>( std::move( dest ));
+        }
+    }
+
+    template <typename T, typename Functor, typename LaunchPolicy>
+    ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenableFuture<T> &&s, Functor &&f, LaunchPolicy policy ) {
+        return detail::then_as<implicit_result_of<Functor, std::future<T>>>( std::move( s ), std::forward<Functor>( f ), policy );
+    }
+
+    template <typename T, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenableFuture<T> &s, Functor &&f, LaunchPolicy policy ) {
+        return then( std::move( s ), std::forward<Functor>( f ), policy );
+    }
+
+    /*
+     * Shared futures can have any number of continuations attached, and each one is given a const reference to the value
+     * */
+    template <typename T, typename Functor, typename LaunchPolicy>
+    ThenableFuture<implicit_result_of<Functor, std::shared_future<T>>> then( const ThenableSharedFuture<T> &s, Functor &&f, LaunchPolicy policy ) {
+        typedef implicit_result_of<Functor, std::shared_future<T>> R;
+
+        detail::state_ptr<detail::shared_state<T>> src = detail::state_access::state( s );
+
+        detail::check_state( src );
+
+        auto dest = detail::make_state<R>();
+
+        detail::shared_state<T> &state = *src;
+
+        detail::schedule_continuation( state, dest, [src2 = std::move( src ), f2 = std::forward<Functor>( f )]( const detail::state_ptr<detail::shared_state<R>> &d ) mutable {
+            detail::then_dispatcher<T>::dispatch_shared( d, *src2, std::move( f2 ));
+        }, policy );
+
+        return detail::state_access::make<ThenableFuture<R>>( std::move( dest ));
+    }
+
+    template <typename T, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( ThenablePromise<T> &s, Functor &&f, LaunchPolicy policy ) {
+        return then( s.get_future(), std::forward<Functor>( f ), policy );
+    }
+
+    //////////
+
+    /*
+     * then function with executors for std futures and promises.
+     *
+     * These adopt the std::future as a ThenableFuture and attach the callback to that, so the callback itself runs on the executor.
+     * Since a std::future can't notify anyone when it's ready, the wait itself still happens on a separate thread unless it is already ready.
+     * */
+
+    template <typename T, typename Functor, typename Executor>
+    inline detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::future<T> &&s, Functor &&f, Executor executor ) {
+        return then( ThenableFuture<T>( std::forward<std::future<T>>( s )), std::forward<Functor>( f ), executor );
+    }
+
+    template <typename T, typename Functor, typename Executor>
+    inline detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::future<T> &s, Functor &&f, Executor executor ) {
+        return then( std::move( s ), std::forward<Functor>( f ), executor );
+    }
+
+    template <typename T, typename Functor, typename Executor>
+    inline detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::shared_future<T>>>> then( std::shared_future<T> s, Functor &&f, Executor executor ) {
+        return then( ThenableSharedFuture<T>( std::move( s )), std::forward<Functor>( f ), executor );
+    }
+
+    template <typename T, typename Functor, typename Executor>
+    inline detail::enable_if_executor_t<Executor, std::future<implicit_result_of<Functor, std::future<T>>>> then( std::promise<T> &s, Functor &&f, Executor executor ) {
+        return then( s.get_future(), std::forward<Functor>( f ), executor );
+    }
+
+    //////////
+
+    /*
+     * These just convert future, shared_future and promise to their Thenable equivalent
+     * */
+
+    template <typename T>
+    constexpr ThenableFuture<T> to_thenable( std::future<T> &&t ) {
+        return ThenableFuture<T>( std::forward<std::future<T>>( t ));
+    }
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( const std::shared_future<T> &t ) {
+        return ThenableSharedFuture<T>( t );
+    }
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( std::shared_future<T> &&t ) {
+        return ThenableSharedFuture<T>( std::forward<std::shared_future<T>>( t ));
+    }
+
+    //////////
+
+    template <typename T>
+    constexpr ThenableFuture<T> to_thenable( ThenableFuture<T> &&t ) {
+        return std::forward<ThenableFuture<T>>( t );
+    }
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( const ThenableSharedFuture<T> &t ) {
+        return t;
+    }
+
+    template <typename T>
+    constexpr ThenableSharedFuture<T> to_thenable( ThenableSharedFuture<T> &&t ) {
+        return std::forward<ThenableSharedFuture<T>>( t );
+    }
+
+    template <typename T>
+    constexpr ThenablePromise<T> to_thenable( ThenablePromise<T> &&t ) {
+        return std::forward<ThenablePromise<T>>( t );
+    }
+
+    //////////
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<std::future<Results>...> &&futures ) {
+        return std::tuple<ThenableFuture<Results>...>( std::forward<std::tuple<std::future<Results>...>>( futures ));
+    }
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<std::shared_future<Results>...> &&futures ) {
+        return std::tuple<ThenableSharedFuture<Results>...>( std::forward<std::tuple<std::shared_future<Results>...>>( futures ));
+    }
+
+    //////////
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<ThenableFuture<Results>...> &&futures ) {
+        return std::forward<std::tuple<ThenableFuture<Results>...>>( futures );
+    }
+
+    template <typename... Results>
+    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<ThenableSharedFuture<Results>...> &&futures ) {
+        return std::forward<std::tuple<ThenableSharedFuture<Results>...>>( futures );
+    }
+
+    template <typename... Results>
+    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<ThenablePromise<Results>...> &&promises ) {
+        return std::forward<std::tuple<ThenablePromise<Results>...>>( promises );
+    }
+
+    //////////
 
+    namespace detail {
         /*
-         * Specialization for void Functors
+         * The resolve callback given to make_promise functors. Values passed as rvalues are moved straight into the shared state,
+         * so move-only types work and nothing is copied on the way.
          * */
-        template <>
-        struct detached_then_helper<void> {
-            template <typename Functor, typename K>
-            static inline void dispatch( std::promise<void> &p, std::future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
-                try {
-                    then_helper<K, Functor>::dispatch( std::forward<std::future<K>>( s ), std::forward<Functor>( f ));
-
-                    p.set_value();
+        template <typename T>
+        struct promise_resolver {
+            std::shared_ptr<ThenablePromise<T>> p;
 
-                } catch( ... ) {
-                    p.set_exception( std::current_exception());
-                }
+            inline void operator()( const T &resolved_value ) const THENABLE_NOEXCEPT {
+                p->set_value( resolved_value );
             }
 
-            template <typename Functor, typename K>
-            static inline void dispatch( std::promise<void> &p, std::shared_future<K> &&s, Functor &&f ) THENABLE_NOEXCEPT {
-                try {
-                    then_helper<K, Functor>::dispatch( std::forward<std::shared_future<K>>( s ), std::forward<Functor>( f ));
+            inline void operator()( T &&resolved_value ) const THENABLE_NOEXCEPT {
+                p->set_value( std::move( resolved_value ));
+            }
+        };
 
-                    p.set_value();
+        template <typename T>
+        struct promise_resolver<T &> {
+            std::shared_ptr<ThenablePromise<T &>> p;
 
-                } catch( ... ) {
-                    p.set_exception( std::current_exception());
-                }
+            inline void operator()( T &resolved_value ) const THENABLE_NOEXCEPT {
+                p->set_value( resolved_value );
             }
         };
 
         template <typename T>
         struct make_promise_helper {
             template <typename Functor>
-            inline static void dispatch( Functor &&f, const std::shared_ptr<std::promise<T>> &p ) THENABLE_NOEXCEPT {
+            inline static void dispatch( Functor &&f, const std::shared_ptr<ThenablePromise<T>> &p ) THENABLE_NOEXCEPT {
                 try {
-                    f( [p]( const T &resolved_value ) THENABLE_NOEXCEPT {
-                        p->set_value( resolved_value );
-
-                    }, [p]( auto rejected_value ) THENABLE_NOEXCEPT {
+                    f( promise_resolver<T>{p}, [p]( auto rejected_value ) THENABLE_NOEXCEPT {
                         p->set_exception( std::make_exception_ptr( rejected_value ));
                     } );
 
@@ -484,7 +3121,7 @@ namespace thenable {
         template <>
         struct make_promise_helper<void> {
             template <typename Functor>
-            inline static void dispatch( Functor &&f, const std::shared_ptr<std::promise<void>> &p ) THENABLE_NOEXCEPT {
+            inline static void dispatch( Functor &&f, const std::shared_ptr<ThenablePromise<void>> &p ) THENABLE_NOEXCEPT {
                 try {
                     f( [p]() THENABLE_NOEXCEPT {
                         p->set_value();
@@ -498,596 +3135,784 @@ namespace thenable {
                 }
             }
         };
-    }
-
-    //This is fun...
-    template <typename Functor, typename FutureType>
-    using implicit_result_of = decltype( detail::then_helper<typename detail::get_future_type<typename std::remove_reference<FutureType>::type>::type, Functor>::dispatch(
-        std::forward<FutureType>( std::declval<FutureType>()), std::forward<Functor>( std::declval<Functor>())));
-
-    //////////
-
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &, Functor &&, std::launch = default_policy );
-
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&, Functor &&, std::launch = default_policy );
-
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T>, Functor &&, std::launch = default_policy );
-
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&, Functor &&, std::launch = default_policy );
 
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &, Functor &&, std::launch = default_policy );
-
-    //////////
-
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &, Functor &&, then_launch );
+    }
 
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&, Functor &&, then_launch );
+    /*
+     * make_promise invokes the functor with resolve and reject callbacks, like the JavaScript Promise constructor.
+     *
+     * The functor itself is launched according to the policy, so with the default policy it runs right away on the calling thread,
+     * but it can just as well be run on an executor, a new thread or deferred until the result is needed.
+     * */
 
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T>, Functor &&, then_launch );
+    namespace detail {
+        template <typename T, typename Alloc, typename Functor, typename LaunchPolicy>
+        ThenableFuture<T> make_promise_into( state_ptr<shared_state<T>> &&dest, const Alloc &alloc, Functor &&f, LaunchPolicy policy ) {
+            ThenableFuture<T> result = state_access::make<ThenableFuture<T>>( state_ptr<shared_state<T>>( dest ));
 
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&, Functor &&, then_launch );
+            launch_into( dest, [alloc, f2 = std::forward<Functor>( f )]( const state_ptr<shared_state<T>> &d ) mutable {
+                //The resolve and reject callbacks share the promise, so it's only broken once both are gone
+                auto p = std::allocate_shared<ThenablePromise<T>>( alloc, state_access::make<ThenablePromise<T>>( state_ptr<shared_state<T>>( d )));
 
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &, Functor &&, then_launch );
+                make_promise_helper<T>::dispatch( std::move( f2 ), p );
 
+            }, policy );
 
-    /*
-     * then function
-     *
-     * This is the overload of then that resolves futures and promises and invokes a callback with the
-     * resulting value. It uses the standard std::async for asynchronous invocation.
-     * */
+            return result;
+        }
+    }
 
-    /*
-     * Overload for simple futures
-     * */
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&s, Functor &&f, std::launch policy ) {
-        return std::async( policy, [policy]( std::future<T> &&s2, Functor &&f2 ) {
-            return detail::then_helper<T, Functor>::dispatch( std::forward<std::future<T>>( s2 ), std::forward<Functor>( f2 ));
-        }, std::forward<std::future<T>>( s ), std::forward<Functor>( f ));
-    };
+    template <typename T, typename Functor, typename LaunchPolicy>
+    inline detail::enable_if_launch_policy_t<LaunchPolicy, ThenableFuture<T>> make_promise2( Functor &&f, LaunchPolicy policy ) {
+        return detail::make_promise_into( detail::make_state<T>(), pool_allocator<char>(), std::forward<Functor>( f ), policy );
+    }
 
     /*
-     * Overload for futures by references. It will take ownership and forward the future,
-     * calling the above overload.
+     * These allocate the shared state and everything else make_promise needs with the given allocator or memory resource
      * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &s, Functor &&f, std::launch policy ) {
-        return then( std::forward<std::future<T>>( s ), std::forward<Functor>( f ), policy );
-    };
+    template <typename T, typename Alloc, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<T> make_promise2( std::allocator_arg_t, const Alloc &alloc, Functor &&f, LaunchPolicy policy ) {
+        return detail::make_promise_into( detail::make_state<T>( alloc ), alloc, std::forward<Functor>( f ), policy );
+    }
 
-    /*
-     * Overload for shared_futures, passed by value because they can be copied.
-     * It's similar to the first overload, but can capture the shared_future in the lambda.
-     * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&s, Functor &&f, std::launch policy ) {
-        return std::async( policy, [policy]( std::shared_future<T> &&s2, Functor &&f2 ) {
-            return detail::then_helper<T, Functor>::dispatch( std::forward<std::shared_future<T>>( s2 ), std::forward<Functor>( f2 ));
-        }, std::forward<std::shared_future<T>>( s ), std::forward<Functor>( f ));
-    };
+    template <typename T, typename Functor, typename LaunchPolicy>
+    inline ThenableFuture<T> make_promise2( std::pmr::memory_resource *resource, Functor &&f, LaunchPolicy policy ) {
+        return make_promise2<T>( std::allocator_arg, std::pmr::polymorphic_allocator<char>( resource ), std::forward<Functor>( f ), policy );
+    }
 
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> s, Functor &&f, std::launch policy ) {
-        return then( std::move( s ), std::forward<Functor>( f ), policy );
-    };
+    template <typename T, typename Functor, typename LaunchPolicy>
+    inline detail::enable_if_launch_policy_t<LaunchPolicy, std::future<T>> make_promise( Functor &&f, LaunchPolicy policy ) {
+        return make_promise2<T>( std::forward<Functor>( f ), policy );
+    }
 
-    /*
-     * Overload for promise references. The promise is NOT moved, but rather the future is acquired
-     * from it and the promise is left intact, so it can be used elsewhere.
-     * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &s, Functor &&f, std::launch policy ) {
-        return then( s.get_future(), std::forward<Functor>( f ), policy );
-    };
+    template <typename T, typename Alloc, typename Functor, typename LaunchPolicy>
+    inline std::future<T> make_promise( std::allocator_arg_t, const Alloc &alloc, Functor &&f, LaunchPolicy policy ) {
+        return make_promise2<T>( std::allocator_arg, alloc, std::forward<Functor>( f ), policy );
+    }
 
     //////////
 
-    /*
-     * then function with detached launch flag.
-     *
-     * These are the same as the normal then functions, but launch the future resolution in a new thread
-     * to immediately wait on them and execute the callbacks. That way the future destructors don't block the main thread.
-     * */
+    namespace detail {
+        /*
+         * parallel_block holds everything a single call to `parallel_n` needs, and is shared between the tasks it submits.
+         *
+         * Each task claims the next functor with a single fetch_add and runs it straight into its state, until every functor
+         * has been claimed. So there are only ever as many tasks as the requested concurrency, and each functor is run exactly once.
+         * */
+        template <typename... Functors>
+        struct parallel_block {
+            typedef std::tuple<typename std::decay<Functors>::type...>                         functor_tuple;
+            typedef std::tuple<state_ptr<shared_state<recursive_result_of<Functors>>>...> state_tuple;
 
-    /*
-     * Overload for simple futures
-     * */
-    template <typename T, typename Functor>
-    std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &&s, Functor &&f, then_launch policy ) {
-        //I don't really like having to do this, but I don't feel like rewriting almost all the recursive template logic above
-        typedef implicit_result_of<Functor, std::future<T>> P;
+            functor_tuple      functors;
+            state_tuple        states;
+            cancellation_token token;
+            std::atomic_size_t next{0};
 
-        assert( policy == then_launch::detached );
+            template <typename... Fns>
+            inline parallel_block( cancellation_token t, Fns &&... fns )
+                : functors( std::forward<Fns>( fns )... ),
+                  states( make_state<recursive_result_of<Functors>>()... ),
+                  token( std::move( t )) {}
 
-        /*
-         * A shared pointer is used to keep the shared state of the future alive in both threads until it's resolved
-         * */
+            template <size_t i>
+            static inline void invoke( parallel_block &block ) THENABLE_NOEXCEPT {
+                auto &dest = std::get<i>( block.states );
 
-        auto p = std::make_shared<std::promise<P>>();
+                if( block.token.is_cancelled()) {
+                    dest->set_exception( make_cancelled_exception());
 
-        std::thread( [p]( std::future<T> &&s2, Functor &&f2 ) {
-            detail::detached_then_helper<P>::dispatch( *p, std::forward<std::future<T>>( s2 ), std::forward<Functor>( f2 ));
-        }, std::forward<std::future<T>>( s ), std::forward<Functor>( f )).detach();
+                    return;
+                }
 
-        return p->get_future();
-    };
+                try {
+                    invoke_into( dest, std::move( std::get<i>( block.functors )));
 
-    /*
-     * Overload for futures by references. It will take ownership and move the future,
-     * calling the above overload.
-     * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::future<T> &s, Functor &&f, then_launch policy ) {
-        return then( std::move( s ), std::forward<Functor>( f ), policy );
-    };
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
 
-    /*
-     * Overload for shared_futures, passed by value because they can be copied.
-     * It's similar to the first overload, but can capture the shared_future in the lambda.
-     * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> &&s, Functor &&f, then_launch policy ) {
-        //I don't really like having to do this, but I don't feel like rewriting almost all the recursive template logic above
-        typedef implicit_result_of<Functor, std::shared_future<T>> P;
+            template <size_t... S>
+            inline void run( std::index_sequence<S...> ) THENABLE_NOEXCEPT {
+                static constexpr void (*table[])( parallel_block & ) = {&invoke<S>...};
 
-        assert( policy == then_launch::detached );
+                size_t i;
 
-        /*
-         * A shared pointer is used to keep the shared state of the future alive in both threads until it's resolved
-         * */
+                while(( i = next.fetch_add( 1, std::memory_order_relaxed )) < sizeof...( Functors )) {
+                    table[i]( *this );
+                }
+            }
 
-        auto p = std::make_shared<std::promise<P>>();
+            inline void run() THENABLE_NOEXCEPT {
+                run( std::index_sequence_for<Functors...>());
+            }
 
-        std::thread( [p]( std::shared_future<T> &&s2, Functor &&f2 ) {
-            detail::detached_then_helper<P>::dispatch( *p, std::forward<std::shared_future<T>>( s2 ), std::forward<Functor>( f2 ));
-        }, std::forward<std::shared_future<T>>( s ), std::forward<Functor>( f )).detach();
+            template <size_t... S>
+            inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> futures( std::index_sequence<S...> ) const {
+                return std::tuple<ThenableFuture<recursive_result_of<Functors>>...>(
+                    state_access::make<ThenableFuture<recursive_result_of<Functors>>>( state_ptr<shared_state<recursive_result_of<Functors>>>( std::get<S>( states )))...
+                );
+            }
+        };
 
-        return p->get_future();
-    };
+        template <typename K, typename T, std::size_t... S>
+        inline K get_tuple_futures( T &&t, std::index_sequence<S...> ) {
+            return K( recursive_get( std::get<S>( std::forward<T>( t )))... );
+        }
 
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::shared_future<T>>> then( std::shared_future<T> s, Functor &&f, then_launch policy ) {
-        return then( std::move( s ), std::forward<Functor>( f ), policy );
-    };
+        /*
+         * The promises are left where they are, so they can still be fulfilled through the tuple
+         * */
+        template <typename K, typename T, std::size_t... S>
+        inline K get_promise_futures( T &t, std::index_sequence<S...> ) {
+            return K( std::get<S>( t ).get_future()... );
+        }
+    }
 
     /*
-     * Overload for promise references. The promise is NOT moved, but rather the future is acquired
-     * from it and the promise is left intact, so it can be used elsewhere.
+     * Runs every functor on the default work_stealing_pool, with at most `concurrency` of them running at once.
+     *
+     * Any futures returned by the functors are flattened without blocking a worker.
      * */
-    template <typename T, typename Functor>
-    inline std::future<implicit_result_of<Functor, std::future<T>>> then( std::promise<T> &s, Functor &&f, then_launch policy ) {
-        return then( s.get_future(), std::forward<Functor>( f ), policy );
-    };
+    template <typename... Functors>
+    std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( cancellation_token token, size_t concurrency, Functors &&... fns ) {
+        static_assert( sizeof...( Functors ) > 0 );
+        assert( concurrency > 0 );
 
-    //////////
+        typedef detail::parallel_block<Functors...> block_type;
 
-    /*
-     * then2 is a variation of then that returns a ThenableFuture instead of a normal future
-     * */
-    template <typename FutureType, typename Functor, typename LaunchPolicy>
-    inline ThenableFuture<implicit_result_of<Functor, FutureType>> then2( FutureType &&s, Functor &&f, LaunchPolicy policy ) {
-        return to_thenable( then( std::forward<FutureType>( s ), std::forward<Functor>( f ), policy ));
-    }
+        auto block = std::make_shared<block_type>( std::move( token ), std::forward<Functors>( fns )... );
 
-    template <typename FutureType, typename Functor, typename LaunchPolicy>
-    inline ThenableFuture<implicit_result_of<Functor, FutureType>> then2( FutureType &s, Functor &&f, LaunchPolicy policy ) {
-        return to_thenable( then( s, std::forward<Functor>( f ), policy ));
-    }
+        auto result = block->futures( std::index_sequence_for<Functors...>());
 
-    //////////
+        const work_stealing_pool &pool = default_executor();
 
-    template <typename T>
-    class ThenablePromise : public std::promise<T> {
-        public:
-            inline ThenablePromise() : std::promise<T>() {}
+        for( size_t i = 0, min_concurrency = std::min( concurrency, sizeof...( Functors )); i < min_concurrency; ++i ) {
+            pool.execute( detail::instrument( [block]() THENABLE_NOEXCEPT {
+                block->run();
+            } ));
+        }
 
-            inline ThenablePromise( std::promise<T> &&p ) : std::promise<T>( std::forward<std::promise<T>>( p )) {}
+        return result;
+    }
 
-            inline ThenablePromise( ThenablePromise &&p ) : std::promise<T>( std::forward<std::promise<T>>( p )) {}
+    template <typename... Functors>
+    inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( size_t concurrency, Functors &&... fns ) {
+        return parallel2_n( cancellation_token(), concurrency, std::forward<Functors>( fns )... );
+    }
 
-            ThenablePromise( const ThenablePromise & ) = delete;
+    template <typename... Functors>
+    inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( cancellation_token token, Functors &&... fns ) {
+        return parallel2_n( std::move( token ), std::max<size_t>( default_executor().size(), 1 ), std::forward<Functors>( fns )... );
+    }
 
-            ThenablePromise &operator=( const ThenablePromise & ) = delete;
+    template <typename... Functors>
+    inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( Functors &&... fns ) {
+        return parallel2( cancellation_token(), std::forward<Functors>( fns )... );
+    }
 
-            constexpr operator std::promise<T> &() THENABLE_NOEXCEPT {
-                return *static_cast<std::promise<T> *>(this);
-            }
+    template <typename... Functors>
+    inline std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( cancellation_token token, size_t concurrency, Functors &&... fns ) {
+        //Implicit conversion to std::future
+        return parallel2_n( std::move( token ), concurrency, std::forward<Functors>( fns )... );
+    }
 
-            constexpr operator std::promise<T> &&() THENABLE_NOEXCEPT {
-                return std::move( *static_cast<std::promise<T> *>(this));
-            }
+    template <typename... Functors>
+    inline std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( size_t concurrency, Functors &&... fns ) {
+        //Implicit conversion to std::future
+        return parallel2_n( concurrency, std::forward<Functors>( fns )... );
+    }
 
-            inline ThenableFuture<T> get_thenable_future() {
-                return this->get_future(); //Automatically converts it
-            }
+    template <typename... Functors>
+    inline std::tuple<std::future<recursive_result_of<Functors>>...> parallel( cancellation_token token, Functors &&... fns ) {
+        //Implicit conversion to std::future
+        return parallel2( std::move( token ), std::forward<Functors>( fns )... );
+    }
 
-            template <typename Functor, typename LaunchPolicy = std::launch>
-            inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) {
-                return then2( this->get_future(), std::forward<Functor>( f ), policy );
-            }
-    };
+    template <typename... Functors>
+    inline std::tuple<std::future<recursive_result_of<Functors>>...> parallel( Functors &&... fns ) {
+        //Implicit conversion to std::future
+        return parallel2( std::forward<Functors>( fns )... );
+    }
 
-    /*
-     * This is a future object functionally equivalent to std::future,
-     * but with a .then function to chain together many futures.
-     * */
+    //////////
+
+    namespace detail {
+        /*
+         * Ranges can be given either as a pair of random-access iterators, or as a pair of integers, in which case the functor is given the index itself.
+         * */
+        template <typename Iterator>
+        inline typename std::enable_if<std::is_integral<Iterator>::value, Iterator>::type
+        range_element( const Iterator &begin, size_t i ) {
+            return static_cast<Iterator>( begin + static_cast<Iterator>( i ));
+        }
 
-    template <typename T>
-    class ThenableFuture : public std::future<T> {
-        public:
-            constexpr ThenableFuture() THENABLE_NOEXCEPT : std::future<T>() {}
+        template <typename Iterator>
+        inline typename std::enable_if<!std::is_integral<Iterator>::value, decltype( *std::declval<const Iterator &>())>::type
+        range_element( const Iterator &begin, size_t i ) {
+            return *( begin + static_cast<typename std::iterator_traits<Iterator>::difference_type>( i ));
+        }
 
-            inline ThenableFuture( std::future<T> &&f ) THENABLE_NOEXCEPT : std::future<T>( std::forward<std::future<T>>( f )) {}
+        template <typename Iterator>
+        inline typename std::enable_if<std::is_integral<Iterator>::value, size_t>::type
+        range_size( const Iterator &begin, const Iterator &end ) {
+            return end > begin ? static_cast<size_t>( end - begin ) : 0;
+        }
 
-            inline ThenableFuture( ThenableFuture &&f ) THENABLE_NOEXCEPT : std::future<T>( std::forward<std::future<T>>( f )) {}
+        template <typename Iterator>
+        inline typename std::enable_if<!std::is_integral<Iterator>::value, size_t>::type
+        range_size( const Iterator &begin, const Iterator &end ) {
+            static_assert( std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>::value );
 
-            ThenableFuture( const ThenableFuture & ) = delete;
+            return end > begin ? static_cast<size_t>( end - begin ) : 0;
+        }
 
-            ThenableFuture &operator=( const ThenableFuture & ) = delete;
+        /*
+         * range_results is the preallocated buffer the results of parallel_for are written into.
+         *
+         * Default-constructible results are written directly into their slot in the final vector. Anything else,
+         * along with bool since std::vector<bool> can't be written to concurrently, goes through a buffer of std::optional first.
+         * */
+        template <typename R, bool Direct>
+        struct range_results {
+            typedef std::vector<R> value_type;
 
-            constexpr operator std::future<T> &() {
-                return *static_cast<std::future<T> *>(this);
-            }
+            value_type values;
 
-            constexpr operator std::future<T> &&() {
-                return std::move( *static_cast<std::future<T> *>(this));
-            }
+            inline explicit range_results( size_t n ) : values( n ) {}
 
-            template <typename Functor, typename LaunchPolicy = std::launch>
-            inline ThenableFuture<implicit_result_of<Functor, std::future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) {
-                return then2( std::move( *this ), std::forward<Functor>( f ), policy );
+            template <typename Functor, typename E>
+            inline void invoke( size_t i, Functor &f, E &&element ) {
+                values[i] = f( std::forward<E>( element ));
             }
 
-            inline ThenableSharedFuture<T> share_thenable() {
-                return ThenableSharedFuture<T>( this->share());
+            inline void resolve( const state_ptr<shared_state<value_type>> &dest ) {
+                dest->set_value( std::move( values ));
             }
-    };
+        };
 
-    template <typename T>
-    class ThenableSharedFuture : public std::shared_future<T> {
-        public:
-            constexpr ThenableSharedFuture() THENABLE_NOEXCEPT : std::shared_future<T>() {}
+        template <typename R>
+        struct range_results<R, false> {
+            typedef std::vector<R> value_type;
 
-            inline ThenableSharedFuture( const std::shared_future<T> &f ) THENABLE_NOEXCEPT : std::shared_future<T>( f ) {}
+            std::unique_ptr<std::optional<R>[]> slots;
+            size_t                              size;
 
-            inline ThenableSharedFuture( const ThenableSharedFuture &f ) THENABLE_NOEXCEPT : std::shared_future<T>( f ) {}
+            inline explicit range_results( size_t n ) : slots( new std::optional<R>[n] ), size( n ) {}
 
-            inline ThenableSharedFuture( std::future<T> &&f ) THENABLE_NOEXCEPT : std::shared_future<T>( std::forward<std::shared_future<T>>( f )) {}
+            template <typename Functor, typename E>
+            inline void invoke( size_t i, Functor &f, E &&element ) {
+                slots[i].emplace( f( std::forward<E>( element )));
+            }
 
-            inline ThenableSharedFuture( ThenableFuture<T> &&f ) THENABLE_NOEXCEPT : std::shared_future<T>( std::forward<std::shared_future<T>>( f )) {}
+            inline void resolve( const state_ptr<shared_state<value_type>> &dest ) {
+                value_type values;
 
-            inline ThenableSharedFuture( std::shared_future<T> &&f ) THENABLE_NOEXCEPT : std::shared_future<T>( std::forward<std::shared_future<T>>( f )) {}
+                values.reserve( size );
 
-            inline ThenableSharedFuture( ThenableSharedFuture &&f ) THENABLE_NOEXCEPT : std::shared_future<T>( std::forward<std::shared_future<T>>( f )) {}
+                for( size_t i = 0; i < size; ++i ) {
+                    values.emplace_back( std::move( *slots[i] ));
+                }
 
-            constexpr operator std::shared_future<T> &() {
-                return *static_cast<std::shared_future<T> *>(this);
+                dest->set_value( std::move( values ));
             }
+        };
+
+        template <>
+        struct range_results<void, false> {
+            typedef void value_type;
+
+            inline explicit range_results( size_t ) {}
 
-            constexpr operator std::shared_future<T> &&() {
-                return std::move( *static_cast<std::shared_future<T> *>(this));
+            template <typename Functor, typename E>
+            inline void invoke( size_t, Functor &f, E &&element ) {
+                f( std::forward<E>( element ));
             }
 
-            template <typename Functor, typename LaunchPolicy = std::launch>
-            inline ThenableFuture<implicit_result_of<Functor, std::shared_future<T>>> then( Functor &&f, LaunchPolicy policy = default_policy ) {
-                return then2( *this, std::forward<Functor>( f ), policy );
+            inline void resolve( const state_ptr<shared_state<void>> &dest ) {
+                dest->set_value();
             }
-    };
+        };
 
-    //////////
+        template <typename Iterator, typename Functor>
+        struct range_job_traits {
+            typedef typename std::decay<decltype( std::declval<Functor &>()( range_element( std::declval<const Iterator &>(), 0 )))>::type result_type;
 
-    namespace detail {
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( ThenableFuture<T> &&t ) {
-            return recursive_get( t.get());
+            typedef typename range_results<result_type>::value_type value_type;
         };
 
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( ThenableSharedFuture<T> &&t ) {
-            return recursive_get( t.get());
+        /*
+         * range_job splits the range into chunks of `grain` elements, which the tasks running it claim one at a time.
+         * Whichever task finishes the last chunk resolves the destination state.
+         *
+         * If any element throws, the first exception is kept and the remaining chunks are skipped.
+         * */
+        template <typename Iterator, typename Functor>
+        struct range_job {
+            typedef typename range_job_traits<Iterator, Functor>::result_type result_type;
+            typedef range_results<result_type>                                results_type;
+            typedef typename results_type::value_type                         value_type;
+
+            Iterator                               begin;
+            size_t                                 size, grain, chunks;
+            typename std::decay<Functor>::type     f;
+            results_type                           results;
+            state_ptr<shared_state<value_type>>    dest;
+            std::atomic_size_t                     next{0}, remaining;
+            std::atomic_bool                       failed{false};
+            std::exception_ptr                     exception;
+
+            template <typename F>
+            inline range_job( Iterator _begin, size_t _size, size_t _grain, F &&_f )
+                : begin( _begin ), size( _size ), grain( _grain ), chunks(( _size + _grain - 1 ) / _grain ),
+                  f( std::forward<F>( _f )), results( _size ), dest( make_state<value_type>()), remaining( chunks ) {}
+
+            inline void run() THENABLE_NOEXCEPT {
+                size_t chunk;
+
+                while(( chunk = next.fetch_add( 1, std::memory_order_relaxed )) < chunks ) {
+                    if( !failed.load( std::memory_order_relaxed )) {
+                        try {
+                            for( size_t i = chunk * grain, last = std::min( size, i + grain ); i < last; ++i ) {
+                                results.invoke( i, f, range_element( begin, i ));
+                            }
+
+                        } catch( ... ) {
+                            if( !failed.exchange( true )) {
+                                exception = std::current_exception();
+                            }
+                        }
+                    }
+
+                    if( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+                        finish();
+                    }
+                }
+            }
+
+            inline void finish() THENABLE_NOEXCEPT {
+                try {
+                    if( failed.load()) {
+                        dest->set_exception( exception );
+
+                    } else {
+                        results.resolve( dest );
+                    }
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
         };
 
-        template <>
-        inline typename recursive_get_future_type<void>::type recursive_get<void>( ThenableFuture<void> &&t ) {
-            t.get();
+        template <bool Owned>
+        struct parallel_map_helper {
+            template <typename Range, typename Functor>
+            static inline parallel_for_future<range_iterator<Range>, Functor> dispatch( Range &&range, Functor &&fn, size_t grain ) {
+                return parallel_for( std::begin( range ), std::end( range ), std::forward<Functor>( fn ), grain );
+            }
         };
 
+        /*
+         * Temporary ranges are moved into the functor so they live as long as the job does
+         * */
         template <>
-        inline typename recursive_get_future_type<void>::type recursive_get<void>( ThenableSharedFuture<void> &&t ) {
-            t.get();
-        };
+        struct parallel_map_helper<true> {
+            template <typename Range, typename Functor>
+            static inline parallel_for_future<range_iterator<Range>, Functor> dispatch( Range &&range, Functor &&fn, size_t grain ) {
+                auto owned = std::make_shared<typename std::decay<Range>::type>( std::forward<Range>( range ));
 
-        template <typename T>
-        inline typename recursive_get_future_type<T>::type recursive_get( ThenablePromise<T> &&t ) {
-            return recursive_get( t.get_future());
+                auto begin = std::begin( *owned );
+                auto end   = std::end( *owned );
+
+                return parallel_for( begin, end, [owned, f = std::forward<Functor>( fn )]( auto &&element ) mutable -> decltype( auto ) {
+                    return f( std::forward<decltype( element )>( element ));
+                }, grain );
+            }
         };
     }
 
-    //////////
-
     /*
-     * These just convert future, shared_future and promise to their Thenable equivalent
+     * Invokes `fn` on every element of [begin, end) using the default work_stealing_pool, and resolves to a vector of the results in order,
+     * or to void if `fn` returns void. `begin` and `end` can be random-access iterators or integers.
+     *
+     * The range is split into chunks of `grain` elements which are handed out to the workers as they become free. If `grain` is zero,
+     * a chunk size is picked that gives each worker several chunks to balance out uneven work. `fn` may be invoked concurrently, and the range
+     * must outlive the returned future.
      * */
+    template <typename Iterator, typename Functor>
+    parallel_for_future<Iterator, Functor> parallel_for( Iterator begin, Iterator end, Functor &&fn, size_t grain ) {
+        typedef detail::range_job<Iterator, Functor> job_type;
 
-    template <typename T>
-    constexpr ThenableFuture<T> to_thenable( std::future<T> &&t ) {
-        return ThenableFuture<T>( std::forward<std::future<T>>( t ));
-    }
-
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( const std::shared_future<T> &t ) {
-        return ThenableSharedFuture<T>( t );
-    }
-
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( std::shared_future<T> &&t ) {
-        return ThenableSharedFuture<T>( std::forward<std::shared_future<T>>( t ));
-    }
-
-    template <typename T>
-    constexpr ThenablePromise<T> to_thenable( std::promise<T> &&t ) {
-        return ThenablePromise<T>( std::forward<std::promise<T>>( t ));
-    }
-
-    //////////
+        const work_stealing_pool &pool = default_executor();
 
-    template <typename T>
-    constexpr ThenableFuture<T> to_thenable( ThenableFuture<T> &&t ) {
-        return std::forward<ThenableFuture<T>>( t );
-    }
+        size_t size = detail::range_size( begin, end );
 
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( const ThenableSharedFuture<T> &t ) {
-        return std::forward<ThenableSharedFuture<T>>( t );
-    }
+        if( grain == 0 ) {
+            grain = std::max<size_t>( size / ( pool.size() * 8 ), 1 );
+        }
 
-    template <typename T>
-    constexpr ThenableSharedFuture<T> to_thenable( ThenableSharedFuture<T> &&t ) {
-        return std::forward<ThenableSharedFuture<T>>( t );
-    }
+        auto job = std::make_shared<job_type>( begin, size, grain, std::forward<Functor>( fn ));
 
-    template <typename T>
-    constexpr ThenablePromise<T> to_thenable( ThenablePromise<T> &&t ) {
-        return std::forward<ThenablePromise<T>>( t );
-    }
+        auto result = detail::state_access::make<parallel_for_future<Iterator, Functor>>( detail::state_ptr<detail::shared_state<typename job_type::value_type>>( job->dest ));
 
-    //////////
+        if( size == 0 ) {
+            job->finish();
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<std::future<Results>...> &&futures ) {
-        return std::tuple<ThenableFuture<Results>...>( std::forward<std::tuple<std::future<Results>...>>( futures ));
-    }
+        } else {
+            for( size_t i = 0, n = std::min( pool.size(), job->chunks ); i < n; ++i ) {
+                pool.execute( detail::instrument( [job]() THENABLE_NOEXCEPT {
+                    job->run();
+                } ));
+            }
+        }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<std::shared_future<Results>...> &&futures ) {
-        return std::tuple<ThenableSharedFuture<Results>...>( std::forward<std::tuple<std::shared_future<Results>...>>( futures ));
+        return result;
     }
 
-    template <typename... Results>
-    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<std::promise<Results>...> &&promises ) {
-        return std::tuple<ThenablePromise<Results>...>( std::forward<std::tuple<std::promise<Results>...>>( promises ));
+    /*
+     * Same as parallel_for, but over any range with random-access iterators. Temporary ranges are kept alive until the job completes.
+     * */
+    template <typename Range, typename Functor>
+    inline parallel_for_future<range_iterator<Range>, Functor> parallel_map( Range &&range, Functor &&fn, size_t grain ) {
+        return detail::parallel_map_helper<!std::is_lvalue_reference<Range>::value>::dispatch( std::forward<Range>( range ), std::forward<Functor>( fn ), grain );
     }
 
     //////////
 
-    template <typename... Results>
-    constexpr std::tuple<ThenableFuture<Results>...> to_thenable( std::tuple<ThenableFuture<Results>...> &&futures ) {
-        return std::forward<std::tuple<ThenableFuture<Results>...>>( futures );
-    }
-
-    template <typename... Results>
-    constexpr std::tuple<ThenableSharedFuture<Results>...> to_thenable( std::tuple<ThenableSharedFuture<Results>...> &&futures ) {
-        return std::forward<std::tuple<ThenableSharedFuture<Results>...>>( futures );
-    }
+    namespace detail {
+        template <typename T>
+        struct take_state {
+            inline decltype( auto ) operator()( shared_state<T> &src ) const {
+                return src.take();
+            }
+        };
 
-    template <typename... Results>
-    constexpr std::tuple<ThenablePromise<Results>...> to_thenable( std::tuple<ThenablePromise<Results>...> &&promises ) {
-        return std::forward<std::tuple<ThenablePromise<Results>...>>( promises );
-    }
+        /*
+         * when_all_block is shared by the continuations attached to every future given to when_all.
+         *
+         * Each continuation writes its value into its own slot and counts down. The first exception rejects the result right away,
+         * otherwise the last one to count down resolves it.
+         * */
+        template <typename T>
+        struct when_all_block {
+            typedef range_results<T>                  results_type;
+            typedef typename results_type::value_type value_type;
 
-    //////////
+            results_type                        results;
+            state_ptr<shared_state<value_type>> dest;
+            std::atomic_size_t                  remaining;
+            std::atomic_bool                    failed{false};
 
-    template <typename T, typename Functor, typename LaunchPolicy>
-    std::future<T> make_promise( Functor &&f, LaunchPolicy policy ) {
-        auto p = std::make_shared<std::promise<T>>();
+            inline explicit when_all_block( size_t n ) : results( n ), dest( make_state<value_type>()), remaining( n ) {}
 
-        return then( defer( [p]( Functor &&f2 ) THENABLE_NOEXCEPT {
-            detail::make_promise_helper<T>::dispatch( std::forward<Functor>( f2 ), p );
+            inline void complete( size_t i, shared_state<T> &src ) THENABLE_NOEXCEPT {
+                if( !failed.load( std::memory_order_relaxed )) {
+                    try {
+                        take_state<T> take;
 
-        }, std::forward<Functor>( f )), [p] {
-            return p->get_future();
+                        results.invoke( i, take, src );
 
-        }, policy );
-    }
+                    } catch( ... ) {
+                        if( !failed.exchange( true )) {
+                            dest->set_exception( std::current_exception());
+                        }
+                    }
+                }
 
-    template <typename T, typename Functor, typename LaunchPolicy>
-    ThenableFuture<T> make_promise2( Functor &&f, LaunchPolicy policy ) {
-        auto p = std::make_shared<std::promise<T>>();
+                if( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 && !failed.load()) {
+                    try {
+                        results.resolve( dest );
 
-        return then2( defer( [p]( Functor &&f2 ) THENABLE_NOEXCEPT {
-            detail::make_promise_helper<T>::dispatch( std::forward<Functor>( f2 ), p );
+                    } catch( ... ) {
+                        dest->set_exception( std::current_exception());
+                    }
+                }
+            }
+        };
 
-        }, std::forward<Functor>( f )), [p] {
-            return p->get_future();
+        template <typename T>
+        struct when_any_helper {
+            typedef std::pair<size_t, T> value_type;
 
-        }, policy );
-    }
+            static inline void resolve( const state_ptr<shared_state<value_type>> &dest, size_t i, shared_state<T> &src, std::atomic_bool &done ) {
+                T value = src.take();
 
-    //////////
+                if( !done.exchange( true )) {
+                    dest->set_value( value_type( i, std::move( value )));
+                }
+            }
+        };
 
-    namespace detail {
-        template <typename... Functors>
-        using promise_tuple = std::tuple<std::promise<typename recursive_get_future_type<fn_traits::fn_result_of<Functors>>::type>...>;
+        template <>
+        struct when_any_helper<void> {
+            typedef size_t value_type;
 
-        template <typename... Functors>
-        using result_tuple = std::tuple<std::future<typename detail::recursive_get_future_type<fn_traits::fn_result_of<Functors>>::type>...>;
+            static inline void resolve( const state_ptr<shared_state<value_type>> &dest, size_t i, shared_state<void> &src, std::atomic_bool &done ) {
+                src.take();
 
-        template <size_t i, typename... Functors>
-        constexpr typename std::enable_if<i == sizeof...( Functors )>::type
-        initialize_parallel_futures( result_tuple<Functors...> &, promise_tuple<Functors...> & ) {
-            //No-op
+                if( !done.exchange( true )) {
+                    dest->set_value( i );
+                }
+            }
         };
 
-        template <size_t i, typename... Functors>
-        inline typename std::enable_if<i < sizeof...( Functors )>::type
-        initialize_parallel_futures( result_tuple<Functors...> &result, promise_tuple<Functors...> &promises ) {
-            std::get<i>( result ) = std::get<i>( promises ).get_future();
+        /*
+         * The first future to complete with a value resolves the result, and the rest are ignored.
+         * If every future fails, the result is rejected with the last exception.
+         *
+         * Only failures are counted, so the result can't be rejected while a success is still taking its value,
+         * and `done` is only set once that value has been taken.
+         * */
+        template <typename T>
+        struct when_any_block {
+            typedef typename when_any_helper<T>::value_type value_type;
 
-            initialize_parallel_futures<i + 1, Functors...>( result, promises );
-        };
+            state_ptr<shared_state<value_type>> dest;
+            std::atomic_size_t                  remaining_failures;
+            std::atomic_bool                    done{false};
 
-        template <typename Functor, typename R = fn_traits::fn_result_of<Functor>>
-        struct tagged_functor {
-            std::atomic_bool ran;
-            Functor          f;
+            inline explicit when_any_block( size_t n ) : dest( make_state<value_type>()), remaining_failures( n ) {}
 
-            inline tagged_functor( Functor &&_f ) : f( std::forward<Functor>( _f )) {}
+            inline void complete( size_t i, shared_state<T> &src ) THENABLE_NOEXCEPT {
+                if( done.load( std::memory_order_relaxed )) {
+                    return;
+                }
 
-            inline void invoke( std::promise<typename recursive_get_future_type<fn_traits::fn_result_of<Functor>>::type> &p ) THENABLE_NOEXCEPT {
                 try {
-                    p.set_value( recursive_get( f()));
+                    when_any_helper<T>::resolve( dest, i, src, done );
 
                 } catch( ... ) {
-                    p.set_exception( std::current_exception());
+                    if( remaining_failures.fetch_sub( 1, std::memory_order_acq_rel ) == 1 && !done.exchange( true )) {
+                        dest->set_exception( std::current_exception());
+                    }
                 }
             }
         };
 
-        template <typename Functor>
-        struct tagged_functor<Functor, void> {
-            std::atomic_bool ran;
-            Functor          f;
-
-            inline tagged_functor( Functor &&_f ) : f( std::forward<Functor>( _f )) {}
+        /*
+         * Attaches a continuation to every future that reports back to the block, so no thread ever blocks waiting on them.
+         * */
+        template <typename Block, typename T>
+        inline void attach_when_block( const std::shared_ptr<Block> &block, std::vector<ThenableFuture<T>> &futures ) {
+            std::vector<state_ptr<shared_state<T>>> states;
 
-            inline void invoke( std::promise<void> &p ) THENABLE_NOEXCEPT {
-                try {
-                    f();
+            states.reserve( futures.size());
 
-                    p.set_value();
+            for( ThenableFuture<T> &f : futures ) {
+                states.push_back( state_access::release( f ));
 
-                } catch( ... ) {
-                    p.set_exception( std::current_exception());
-                }
+                check_state( states.back());
             }
-        };
 
-        template <size_t i, typename... Functors>
-        constexpr typename std::enable_if<i == sizeof...( Functors )>::type
-        invoke_parallel_functors( promise_tuple<Functors...> &, std::tuple<tagged_functor<Functors>...> & ) THENABLE_NOEXCEPT {
-            //No-op
-        };
+            for( size_t i = 0; i < states.size(); ++i ) {
+                shared_state<T> &state = *states[i];
 
-        template <size_t i, typename... Functors>
-        inline typename std::enable_if<i < sizeof...( Functors )>::type
-        invoke_parallel_functors( promise_tuple<Functors...> &promises, std::tuple<tagged_functor<Functors>...> &fns ) THENABLE_NOEXCEPT {
-            bool expect_ran = false;
+                state.add_continuation( [block, i, src = std::move( states[i] )]() THENABLE_NOEXCEPT {
+                    block->complete( i, *src );
+                } );
+            }
+        }
+    }
 
-            auto &func = std::get<i>( fns );
+    /*
+     * Resolves to a vector of the values of every future, in order, once they have all completed, or to void for void futures.
+     * If any of them fails, the result is rejected with the first exception without waiting on the rest.
+     * */
+    template <typename T>
+    ThenableFuture<typename detail::range_results<T>::value_type> when_all( std::vector<ThenableFuture<T>> &&futures ) {
+        typedef detail::when_all_block<T>        block_type;
+        typedef typename block_type::value_type value_type;
 
-            func.ran.compare_exchange_strong( expect_ran, true );
+        auto block = std::make_shared<block_type>( futures.size());
 
-            if( !expect_ran ) {
-                func.invoke( std::get<i>( promises ));
-            }
+        auto result = detail::state_access::make<ThenableFuture<value_type>>( detail::state_ptr<detail::shared_state<value_type>>( block->dest ));
 
-            invoke_parallel_functors<i + 1, Functors...>( promises, fns );
-        };
+        if( futures.empty()) {
+            block->results.resolve( block->dest );
 
-        template <typename K, typename T, std::size_t... S>
-        inline K get_tuple_futures( T &&t, std::index_sequence<S...> ) {
-            return K( recursive_get( std::get<S>( std::forward<T>( t )))... );
+        } else {
+            detail::attach_when_block( block, futures );
         }
 
-        template <typename K, typename T, std::size_t... S>
-        inline K get_tuple_futures_from_promises( T &&t, std::index_sequence<S...> ) {
-            return K( recursive_get( std::get<S>( std::forward<T>( t )).get_future())... );
-        }
+        return result;
     }
 
-    template <typename... Functors>
-    std::tuple<std::future<recursive_result_of<Functors>>...> parallel_n( size_t concurrency, Functors &&... fns ) {
-        static_assert( sizeof...( Functors ) > 0 );
-        assert( concurrency > 0 );
-
-        typedef detail::promise_tuple<Functors...>              promise_tuple;
-        typedef detail::result_tuple<Functors...>               result_tuple;
-        typedef std::tuple<detail::tagged_functor<Functors>...> tagged_functors;
+    /*
+     * Resolves as soon as any of the futures completes with a value. If they all fail, the result is rejected with the last exception,
+     * and if there are none at all it's rejected as a broken promise.
+     * */
+    template <typename T>
+    ThenableFuture<when_any_result<T>> when_any( std::vector<ThenableFuture<T>> &&futures ) {
+        typedef detail::when_any_block<T>        block_type;
+        typedef typename block_type::value_type value_type;
 
-        result_tuple result;
+        auto block = std::make_shared<block_type>( futures.size());
 
-        auto p = std::make_shared<promise_tuple>();
-        auto f = std::make_shared<tagged_functors>( std::forward<Functors>( fns )... );
+        auto result = detail::state_access::make<ThenableFuture<value_type>>( detail::state_ptr<detail::shared_state<value_type>>( block->dest ));
 
-        detail::initialize_parallel_futures<0, Functors...>( result, *p );
+        if( futures.empty()) {
+            block->dest->set_exception( std::make_exception_ptr( std::future_error( std::future_errc::broken_promise )));
 
-        for( size_t i = 0, min_concurrency = std::min( concurrency, sizeof...( Functors )); i < min_concurrency; ++i ) {
-            std::thread( [p, f]() THENABLE_NOEXCEPT {
-                detail::invoke_parallel_functors<0, Functors...>( *p, *f );
-            } ).detach();
+        } else {
+            detail::attach_when_block( block, futures );
         }
 
-        return std::move( result );
+        return result;
     }
 
-    template <typename... Functors>
-    inline std::tuple<std::future<recursive_result_of<Functors>>...> parallel( Functors &&... fns ) {
-        return parallel_n( std::thread::hardware_concurrency(), std::forward<Functors>( fns )... );
+    //////////
+
+    template <typename... Results>
+    std::future<std::tuple<Results...>> await_all( std::tuple<std::future<Results>...> &&results, std::launch policy = default_policy ) {
+        typedef std::tuple<std::future<Results>...> tuple_type;
+        constexpr auto                              Size = std::tuple_size<tuple_type>::value;
+
+        return std::async( policy, []( tuple_type &&inner_results ) {
+            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
+        }, std::forward<tuple_type>( results ));
+    }
+
+    template <typename... Results>
+    std::future<std::tuple<Results...>> await_all( std::tuple<std::shared_future<Results>...> &&results, std::launch policy = default_policy ) {
+        typedef std::tuple<std::shared_future<Results>...> tuple_type;
+        constexpr auto                                     Size = std::tuple_size<tuple_type>::value;
+
+        return std::async( policy, []( tuple_type &&inner_results ) {
+            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
+        }, std::forward<tuple_type>( results ));
     }
 
-    template <typename... Functors>
-    inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2_n( size_t concurrency, Functors &&... fns ) {
-        //Implicit conversion to ThenableFuture
-        return parallel_n( concurrency, std::forward<Functors>( fns )... );
-    }
+    namespace detail {
+        template <typename Tuple, std::size_t... S>
+        inline bool tuple_futures_ready( const Tuple &t, std::index_sequence<S...> ) {
+            return ( std::get<S>( t ).is_ready() && ... );
+        }
+
+        /*
+         * If every future is already complete, the results can just be collected right away without launching anything
+         * */
+        template <typename... Results>
+        inline ThenableFuture<std::tuple<Results...>> await_ready( std::tuple<ThenableFuture<Results>...> &&results ) {
+            try {
+                return ready_future<std::tuple<Results...>>( get_tuple_futures<std::tuple<Results...>>( std::move( results ), std::index_sequence_for<Results...>()));
+
+            } catch( ... ) {
+                return make_exceptional_future<std::tuple<Results...>>( std::current_exception());
+            }
+        }
+
+        template <typename T>
+        struct get_state {
+            inline decltype( auto ) operator()( shared_state<T> &src ) const {
+                return src.get();
+            }
+        };
+
+        /*
+         * await_all_block is shared by the continuations attached to every future given to await_all, like when_all_block,
+         * except each result goes into its own slot of a tuple.
+         *
+         * Each continuation stores its value and counts down. The first exception rejects the result right away,
+         * otherwise the last one to count down moves the slots into the resulting tuple.
+         * */
+        template <typename... Results>
+        struct await_all_block {
+            typedef std::tuple<Results...> value_type;
+
+            std::tuple<ready_result<Results>...> slots;
+            state_ptr<shared_state<value_type>>  dest;
+            std::atomic_size_t                   remaining;
+            std::atomic_bool                     failed{false};
+
+            inline await_all_block() : dest( make_state<value_type>()), remaining( sizeof...( Results )) {}
+
+            template <size_t I, typename Fetch, typename T>
+            inline void complete( Fetch fetch, shared_state<T> &src ) THENABLE_NOEXCEPT {
+                if( !failed.load( std::memory_order_relaxed )) {
+                    try {
+                        std::get<I>( slots ).set_value( fetch( src ));
+
+                    } catch( ... ) {
+                        if( !failed.exchange( true )) {
+                            dest->set_exception( std::current_exception());
+                        }
+                    }
+                }
+
+                if( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 && !failed.load()) {
+                    resolve( std::index_sequence_for<Results...>());
+                }
+            }
+
+            template <size_t... S>
+            inline void resolve( std::index_sequence<S...> ) THENABLE_NOEXCEPT {
+                try {
+                    dest->set_value( std::get<S>( slots ).take()... );
+
+                } catch( ... ) {
+                    dest->set_exception( std::current_exception());
+                }
+            }
+        };
+
+        template <size_t I, template <typename> class Fetch, typename Block, typename T>
+        inline void attach_await_slot( const std::shared_ptr<Block> &block, state_ptr<shared_state<T>> &&state ) {
+            shared_state<T> &s = *state;
+
+            s.add_continuation( [block, src = std::move( state )]() THENABLE_NOEXCEPT {
+                block->template complete<I>( Fetch<T>(), *src );
+            } );
+        }
+
+        /*
+         * Attaches a continuation to every future that stores its result straight into the block,
+         * so no thread waits on any of them and the last one to complete resolves the result.
+         * */
+        template <template <typename> class Fetch, template <typename> class Future, typename... Results, size_t... S>
+        inline ThenableFuture<std::tuple<Results...>> attach_await_all( std::tuple<Future<Results>...> &futures, std::index_sequence<S...> ) {
+            typedef await_all_block<Results...>     block_type;
+            typedef typename block_type::value_type value_type;
+
+            std::tuple<state_ptr<shared_state<Results>>...> states( state_access::release( std::get<S>( futures ))... );
 
-    template <typename... Functors>
-    inline std::tuple<ThenableFuture<recursive_result_of<Functors>>...> parallel2( Functors &&... fns ) {
-        //Implicit conversion to ThenableFuture
-        return parallel( std::forward<Functors>( fns )... );
-    }
+            ( check_state( std::get<S>( states )), ... );
 
-    //////////
+            auto block = std::make_shared<block_type>();
 
-    template <typename... Results>
-    std::future<std::tuple<Results...>> await_all( std::tuple<std::future<Results>...> &&results, std::launch policy = default_policy ) {
-        typedef std::tuple<std::future<Results>...> tuple_type;
-        constexpr auto                              Size = std::tuple_size<tuple_type>::value;
+            auto result = state_access::make<ThenableFuture<value_type>>( state_ptr<shared_state<value_type>>( block->dest ));
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
-    }
+            if( sizeof...( Results ) == 0 ) {
+                block->resolve( std::index_sequence<S...>());
+            }
 
-    template <typename... Results>
-    std::future<std::tuple<Results...>> await_all( std::tuple<std::shared_future<Results>...> &&results, std::launch policy = default_policy ) {
-        typedef std::tuple<std::shared_future<Results>...> tuple_type;
-        constexpr auto                                     Size = std::tuple_size<tuple_type>::value;
+            ( attach_await_slot<S, Fetch>( block, std::move( std::get<S>( states ))), ... );
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
+            return result;
+        }
     }
 
+    /*
+     * Resolves once every future has completed, with the last one to complete resolving the result, so no thread waits on them.
+     * With std::launch::deferred the results are instead collected by the first thread to wait on the result.
+     * */
     template <typename... Results>
     ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableFuture<Results>...> &&results, std::launch policy = default_policy ) {
         typedef std::tuple<ThenableFuture<Results>...> tuple_type;
         constexpr auto                                 Size = std::tuple_size<tuple_type>::value;
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
+        if( policy == std::launch::deferred ) {
+            return std::async( policy, []( tuple_type &&inner_results ) {
+                return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
+            }, std::forward<tuple_type>( results ));
+        }
+
+        if( detail::tuple_futures_ready( results, std::make_index_sequence<Size>())) {
+            return detail::await_ready( std::forward<tuple_type>( results ));
+        }
+
+        return detail::attach_await_all<detail::take_state>( results, std::make_index_sequence<Size>());
     }
 
     template <typename... Results>
@@ -1095,273 +3920,508 @@ namespace thenable {
         typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
         constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
+        if( policy == std::launch::deferred ) {
+            return std::async( policy, []( tuple_type &&inner_results ) {
+                return detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
+            }, std::forward<tuple_type>( results ));
+        }
+
+        return detail::attach_await_all<detail::get_state>( results, std::make_index_sequence<Size>());
     }
 
+    /*
+     * await_all on promises waits on their futures. The promises themselves aren't moved out of the tuple,
+     * so they can still be fulfilled through it afterwards.
+     * */
     template <typename... Results>
     std::future<std::tuple<Results...>> await_all( std::tuple<std::promise<Results>...> &&results, std::launch policy = default_policy ) {
-        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
-        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
+        typedef std::tuple<std::future<Results>...> tuple_type;
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures_from_promises<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
+        return await_all( detail::get_promise_futures<tuple_type>( results, std::index_sequence_for<Results...>()), policy );
     }
 
     template <typename... Results>
     ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenablePromise<Results>...> &&results, std::launch policy = default_policy ) {
-        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
-        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
+        typedef std::tuple<ThenableFuture<Results>...> tuple_type;
+        constexpr auto                                 Size = std::tuple_size<tuple_type>::value;
 
-        return std::async( policy, []( tuple_type &&inner_results ) {
-            return detail::get_tuple_futures_from_promises<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>());
-        }, std::forward<tuple_type>( results ));
+        return await_all( detail::get_promise_futures<tuple_type>( results, std::make_index_sequence<Size>()), policy );
     }
 
     //////////
 
-    template <typename... Results>
-    std::future<std::tuple<Results...>> await_all( std::tuple<std::future<Results>...> &&results, then_launch policy ) {
+    /*
+     * await_all with then_launch::detached or an executor.
+     *
+     * For std futures and promises the launched task waits on each future in turn, so it occupies a thread or executor worker until they're all done.
+     * Thenable futures don't need anything launched at all, since the last one to complete resolves the result.
+     * Cancellable and deadline policies are only accepted for the Thenable types.
+     * */
+
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, std::future<std::tuple<Results...>>> await_all( std::tuple<std::future<Results>...> &&results, LaunchPolicy policy ) {
         typedef std::tuple<std::future<Results>...> tuple_type;
         constexpr auto                              Size = std::tuple_size<tuple_type>::value;
 
-        assert( policy == then_launch::detached );
-
         auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
 
-        std::thread( [p]( tuple_type &&inner_results ) {
+        detail::launch_detached( policy, [p, inner_results = tuple_type( std::forward<tuple_type>( results ))]() mutable {
             try {
-                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::move( inner_results ), std::make_index_sequence<Size>()));
 
             } catch( ... ) {
                 p->set_exception( std::current_exception());
             }
-        }, std::forward<tuple_type>( results )).detach();
+        } );
 
         return p->get_future();
     }
 
-    template <typename... Results>
-    std::future<std::tuple<Results...>> await_all( std::tuple<std::shared_future<Results>...> &&results, then_launch policy ) {
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, std::future<std::tuple<Results...>>> await_all( std::tuple<std::shared_future<Results>...> &&results, LaunchPolicy policy ) {
         typedef std::tuple<std::shared_future<Results>...> tuple_type;
         constexpr auto                                     Size = std::tuple_size<tuple_type>::value;
 
-        assert( policy == then_launch::detached );
-
         auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
 
-        std::thread( [p]( tuple_type &&inner_results ) {
+        detail::launch_detached( policy, [p, inner_results = tuple_type( std::forward<tuple_type>( results ))]() mutable {
             try {
-                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::move( inner_results ), std::make_index_sequence<Size>()));
 
             } catch( ... ) {
                 p->set_exception( std::current_exception());
             }
-        }, std::forward<tuple_type>( results )).detach();
+        } );
 
         return p->get_future();
     }
 
-    template <typename... Results>
-    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableFuture<Results>...> &&results, then_launch policy ) {
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, ThenableFuture<std::tuple<Results...>>> await_all( std::tuple<ThenableFuture<Results>...> &&results, LaunchPolicy policy ) {
         typedef std::tuple<ThenableFuture<Results>...> tuple_type;
         constexpr auto                                 Size = std::tuple_size<tuple_type>::value;
 
-        assert( policy == then_launch::detached );
+        if( detail::runs_inline_if_ready( policy ) && detail::tuple_futures_ready( results, std::make_index_sequence<Size>())) {
+            return detail::await_ready( std::forward<tuple_type>( results ));
+        }
 
-        auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
+        return detail::attach_await_all<detail::take_state>( results, std::make_index_sequence<Size>());
+    }
 
-        std::thread( [p]( tuple_type &&inner_results ) {
-            try {
-                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, ThenableFuture<std::tuple<Results...>>> await_all( std::tuple<ThenableSharedFuture<Results>...> &&results, LaunchPolicy ) {
+        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
+        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
 
-            } catch( ... ) {
-                p->set_exception( std::current_exception());
-            }
-        }, std::forward<tuple_type>( results )).detach();
+        return detail::attach_await_all<detail::get_state>( results, std::make_index_sequence<Size>());
+    }
 
-        return p->get_future();
+
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, std::future<std::tuple<Results...>>> await_all( std::tuple<std::promise<Results>...> &&results, LaunchPolicy policy ) {
+        typedef std::tuple<std::future<Results>...> tuple_type;
+
+        return await_all( detail::get_promise_futures<tuple_type>( results, std::index_sequence_for<Results...>()), policy );
     }
 
-    template <typename... Results>
-    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableSharedFuture<Results>...> &&results, then_launch policy ) {
-        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
-        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
+    template <typename LaunchPolicy, typename... Results>
+    detail::enable_if_unwrapped_detached_t<LaunchPolicy, ThenableFuture<std::tuple<Results...>>> await_all( std::tuple<ThenablePromise<Results>...> &&results, LaunchPolicy policy ) {
+        typedef std::tuple<ThenableFuture<Results>...> tuple_type;
+        constexpr auto                                 Size = std::tuple_size<tuple_type>::value;
 
-        assert( policy == then_launch::detached );
+        return await_all( detail::get_promise_futures<tuple_type>( results, std::make_index_sequence<Size>()), policy );
+    }
 
-        auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
+    //////////
 
-        std::thread( [p]( tuple_type &&inner_results ) {
-            try {
-                p->set_value( detail::get_tuple_futures<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+    namespace detail {
+        template <typename T>
+        inline ThenableFuture<T> race_cancellation( ThenableFuture<T> &&source, const cancellation_token &token ) {
+            state_ptr<shared_state<T>> src = state_access::release( source );
 
-            } catch( ... ) {
-                p->set_exception( std::current_exception());
-            }
-        }, std::forward<tuple_type>( results )).detach();
+            check_state( src );
 
-        return p->get_future();
+            auto dest = make_state<T>();
+
+            race_cancellation( dest, std::move( src ), token );
+
+            return state_access::make<ThenableFuture<T>>( std::move( dest ));
+        }
     }
 
+    /*
+     * await_all with a cancellable policy resolves with a cancelled_error as soon as the token is cancelled,
+     * rather than waiting on the rest of the futures first.
+     * */
 
-    template <typename... Results>
-    std::future<std::tuple<Results...>> await_all( std::tuple<std::promise<Results>...> &&results, then_launch policy ) {
-        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
-        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
+    template <typename LaunchPolicy, typename... Results>
+    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableFuture<Results>...> &&results, cancellable_policy<LaunchPolicy> policy ) {
+        if( policy.token.is_cancelled()) {
+            return make_exceptional_future<std::tuple<Results...>>( detail::make_cancelled_exception());
+        }
 
-        assert( policy == then_launch::detached );
+        return detail::race_cancellation( await_all( std::move( results ), policy.policy ), policy.token );
+    }
 
-        auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
+    template <typename LaunchPolicy, typename... Results>
+    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableSharedFuture<Results>...> &&results, cancellable_policy<LaunchPolicy> policy ) {
+        if( policy.token.is_cancelled()) {
+            return make_exceptional_future<std::tuple<Results...>>( detail::make_cancelled_exception());
+        }
 
-        std::thread( [p]( tuple_type &&inner_results ) {
-            try {
-                p->set_value( detail::get_tuple_futures_from_promises<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+        return detail::race_cancellation( await_all( std::move( results ), policy.policy ), policy.token );
+    }
 
-            } catch( ... ) {
-                p->set_exception( std::current_exception());
-            }
-        }, std::forward<tuple_type>( results )).detach();
+    template <typename LaunchPolicy, typename... Results>
+    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenablePromise<Results>...> &&results, cancellable_policy<LaunchPolicy> policy ) {
+        if( policy.token.is_cancelled()) {
+            return make_exceptional_future<std::tuple<Results...>>( detail::make_cancelled_exception());
+        }
 
-        return p->get_future();
+        return detail::race_cancellation( await_all( std::move( results ), policy.policy ), policy.token );
     }
 
-    template <typename... Results>
-    ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenablePromise<Results>...> &&results, then_launch policy ) {
-        typedef std::tuple<ThenableSharedFuture<Results>...> tuple_type;
-        constexpr auto                                       Size = std::tuple_size<tuple_type>::value;
+    /*
+     * Timeouts
+     *
+     * with_deadline and with_timeout return a future that resolves with the result of the given one,
+     * or with a timeout_error if it isn't available in time. The deadline is tracked by a timer_wheel rather than a waiting thread,
+     * and the timer is cancelled as soon as the result arrives.
+     *
+     * The original future is consumed either way, and whatever it resolves to after the deadline is discarded.
+     * */
 
-        assert( policy == then_launch::detached );
+    template <typename T>
+    ThenableFuture<T> with_deadline( ThenableFuture<T> &&f, std::chrono::steady_clock::time_point deadline, const timer_wheel &timer = default_timer()) {
+        if( f.is_ready()) {
+            return std::move( f );
+        }
 
-        auto p = std::make_shared<std::promise<std::tuple<Results...>>>();
+        detail::state_ptr<detail::shared_state<T>> src = detail::state_access::release( f );
 
-        std::thread( [p]( tuple_type &&inner_results ) {
-            try {
-                p->set_value( detail::get_tuple_futures_from_promises<std::tuple<Results...>>( std::forward<tuple_type>( inner_results ), std::make_index_sequence<Size>()));
+        detail::check_state( src );
 
-            } catch( ... ) {
-                p->set_exception( std::current_exception());
-            }
-        }, std::forward<tuple_type>( results )).detach();
+        auto dest = detail::make_state<T>();
 
-        return p->get_future();
+        detail::race_deadline( dest, std::move( src ), deadline, timer );
+
+        return detail::state_access::make<ThenableFuture<T>>( std::move( dest ));
+    }
+
+    template <typename T>
+    inline ThenableFuture<T> with_deadline( ThenableFuture<T> &f, std::chrono::steady_clock::time_point deadline, const timer_wheel &timer = default_timer()) {
+        return with_deadline( std::move( f ), deadline, timer );
+    }
+
+    template <typename T, typename Rep, typename Period>
+    inline ThenableFuture<T> with_timeout( ThenableFuture<T> &&f, const std::chrono::duration<Rep, Period> &timeout, const timer_wheel &timer = default_timer()) {
+        return with_deadline( std::move( f ), std::chrono::steady_clock::now() + std::chrono::ceil<std::chrono::steady_clock::duration>( timeout ), timer );
+    }
+
+    template <typename T, typename Rep, typename Period>
+    inline ThenableFuture<T> with_timeout( ThenableFuture<T> &f, const std::chrono::duration<Rep, Period> &timeout, const timer_wheel &timer = default_timer()) {
+        return with_timeout( std::move( f ), timeout, timer );
+    }
+
+    /*
+     * await_all with a deadline policy times out as a whole
+     * */
+
+    template <typename LaunchPolicy, typename... Results>
+    inline ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableFuture<Results>...> &&results, deadline_policy<LaunchPolicy> policy ) {
+        return with_deadline( await_all( std::move( results ), policy.policy ), policy.deadline );
+    }
+
+    template <typename LaunchPolicy, typename... Results>
+    inline ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenableSharedFuture<Results>...> &&results, deadline_policy<LaunchPolicy> policy ) {
+        return with_deadline( await_all( std::move( results ), policy.policy ), policy.deadline );
+    }
+
+    template <typename LaunchPolicy, typename... Results>
+    inline ThenableFuture<std::tuple<Results...>> await_all( std::tuple<ThenablePromise<Results>...> &&results, deadline_policy<LaunchPolicy> policy ) {
+        return with_deadline( await_all( std::move( results ), policy.policy ), policy.deadline );
     }
 
     namespace detail {
         /*
-         * These are very similar to the detached_then_helper helper structures, exception it bypasses the then_helper::dispatch part since this doesn't have to wait
-         * on a future. It just invokes it with a value using then_invoke_helper, and sets the promise to the result
+         * The result types of every stage of a waterfall, each one computed from the result of the stage before it
          * */
-        template <typename T>
-        struct detached_waterfall_helper {
-            template <typename Functor>
-            static inline void dispatch( std::promise<T> &p, Functor &&f ) {
-                try {
-                    p.set_value( then_invoke_helper<Functor>::invoke( std::forward<Functor>( f )));
+        template <typename R, typename Tuple>
+        struct tuple_prepend;
 
-                } catch( ... ) {
-                    p.set_exception( std::current_exception());
-                }
-            }
+        template <typename R, typename... Rs>
+        struct tuple_prepend<R, std::tuple<Rs...>> {
+            typedef std::tuple<R, Rs...> type;
         };
 
-        template <>
-        struct detached_waterfall_helper<void> {
-            template <typename Functor>
-            static inline void dispatch( std::promise<void> &p, Functor &&f ) {
-                try {
-                    then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ));
+        template <typename Prev, typename... Functors>
+        struct waterfall_types {
+            typedef std::tuple<> type;
+        };
 
-                    p.set_value();
+        template <typename Prev, typename Functor, typename... Functors>
+        struct waterfall_types<Prev, Functor, Functors...> {
+            typedef implicit_result_of<Functor, std::future<Prev>> result_type;
 
-                } catch( ... ) {
-                    p.set_exception( std::current_exception());
-                }
-            }
+            typedef typename tuple_prepend<result_type, typename waterfall_types<result_type, Functors...>::type>::type type;
         };
-    }
 
+        template <typename... Functors>
+        using waterfall_result = typename std::tuple_element<sizeof...( Functors ) - 1, typename waterfall_types<void, typename std::decay<Functors>::type...>::type>::type;
 
-    /*
-     * So because of the nature of variadic templates, the actual waterfall implementation needed to be in reverse.
-     * It goes from the last functor to first
-     * */
-    template <typename Functor>
-    inline THENABLE_DECLTYPE_AUTO_HINTED( std::future ) reverse_waterfall( std::launch policy, Functor &&f ) {
-        return std::async( policy, []( Functor &&f2 ) {
-            return detail::then_invoke_helper<Functor>::invoke( std::forward<Functor>( f2 ));
-        }, std::forward<Functor>( f ));
-    }
+        /*
+         * Whether a policy says the next stage shouldn't start, and what to resolve the waterfall with instead
+         * */
+        template <typename LaunchPolicy>
+        inline std::exception_ptr stage_interruption( const LaunchPolicy & ) {
+            return nullptr;
+        }
 
-    template <typename Functor>
-    THENABLE_DECLTYPE_AUTO_HINTED( std::future ) reverse_waterfall( then_launch policy, Functor &&f ) {
-        typedef decltype( detail::then_invoke_helper<Functor>::invoke( std::forward<Functor>( f ))) P;
+        template <typename LaunchPolicy>
+        inline std::exception_ptr stage_interruption( const cancellable_policy<LaunchPolicy> &policy ) {
+            return policy.token.is_cancelled() ? make_cancelled_exception() : stage_interruption( policy.policy );
+        }
 
-        assert( policy == then_launch::detached );
+        template <typename LaunchPolicy>
+        inline std::exception_ptr stage_interruption( const deadline_policy<LaunchPolicy> &policy ) {
+            return std::chrono::steady_clock::now() >= policy.deadline ? make_timeout_exception() : stage_interruption( policy.policy );
+        }
 
-        auto p = std::make_shared<std::promise<P>>();
+        /*
+         * Picks the waterfall back up after a stage returned a future that wasn't ready. Executors get the rest of it as a new task,
+         * and otherwise it just carries on as a callback on whatever thread provided the value.
+         * */
+        template <typename Task>
+        inline void resume_stage( std::launch, Task &&task ) {
+            task();
+        }
 
-        std::thread( [p]( Functor &&f2 ) {
-            detail::detached_waterfall_helper<P>::dispatch( *p, std::forward<Functor>( f2 ));
-        }, std::forward<Functor>( f )).detach();
+        template <typename Task>
+        inline void resume_stage( then_launch, Task &&task ) {
+            task();
+        }
 
-        return p->get_future();
-    }
+        template <typename Executor, typename Task>
+        inline enable_if_executor_t<Executor> resume_stage( Executor &executor, Task &&task ) {
+            execute( executor, instrument( std::forward<Task>( task )));
+        }
 
-    template <typename PolicyType, typename Functor, typename... Functors>
-    inline THENABLE_DECLTYPE_AUTO_HINTED( std::future ) reverse_waterfall( PolicyType policy, Functor &&f, Functors &&... fns ) {
-        return then( reverse_waterfall( policy, std::forward<Functors>( fns )... ), std::forward<Functor>( f ), policy );
-    }
+        template <typename LaunchPolicy, typename Task>
+        inline void resume_stage( cancellable_policy<LaunchPolicy> &policy, Task &&task ) {
+            resume_stage( policy.policy, std::forward<Task>( task ));
+        }
+
+        template <typename LaunchPolicy, typename Task>
+        inline void resume_stage( deadline_policy<LaunchPolicy> &policy, Task &&task ) {
+            resume_stage( policy.policy, std::forward<Task>( task ));
+        }
 
+        template <typename T>
+        inline void load_result( ready_result<T> &dest, shared_state<T> &src ) {
+            try {
+                dest.set_value( src.take());
+
+            } catch( ... ) {
+                dest.exception = std::current_exception();
+            }
+        }
+
+        inline void load_result( ready_result<void> &dest, shared_state<void> &src ) {
+            try {
+                src.take();
+
+                dest.set_value();
+
+            } catch( ... ) {
+                dest.exception = std::current_exception();
+            }
+        }
 
-    namespace detail {
         /*
-         * Found this solution at http://stackoverflow.com/a/15907838
+         * waterfall_block runs the stages of a waterfall one after another in a loop, rather than nesting a future per stage.
+         *
+         * The result of each stage is kept in a ready_result until the next stage takes it. As long as the stages return plain values
+         * or futures that are already ready, they all run back-to-back within the same task. When a stage returns a future that isn't ready yet,
+         * the loop stops and a continuation on that future resumes it at the next stage, so only one stage is ever in flight
+         * and the stack doesn't grow with the number of stages.
          *
-         * It applies variadic templates to a function in reverse by recursively calling itself with the template parameters shifted over
+         * The stages themselves only go through waterfall_base, so the code generated for each one depends on its own functor
+         * and result types rather than on every functor in the waterfall, which keeps long waterfalls cheap to compile.
          * */
+        struct waterfall_base : std::enable_shared_from_this<waterfall_base> {
+            virtual ~waterfall_base() = default;
 
-        template <typename... Head>
-        struct forward_waterfall;
+            virtual void run( size_t i ) THENABLE_NOEXCEPT = 0;
 
-        template <>
-        struct forward_waterfall<> {
-            template <typename... Rest>
-            static inline decltype( auto ) apply( Rest &&... rest ) {
-                return reverse_waterfall( std::forward<Rest>( rest )... );
-            }
+            virtual void resume( size_t i ) THENABLE_NOEXCEPT = 0;
+
+            virtual void fail( std::exception_ptr e ) THENABLE_NOEXCEPT = 0;
         };
 
-        template <typename First, typename... Head>
-        struct forward_waterfall<First, Head...> {
-            template <typename... Rest>
-            static inline decltype( auto ) apply( First &&first, Head &&... head, Rest &&... rest ) {
-                return forward_waterfall<Head...>::apply( std::forward<Head>( head )..., std::forward<First>( first ), std::forward<Rest>( rest )... );
+        /*
+         * Runs one stage, and returns true if its result is already available so the next stage can start right away
+         * */
+        template <typename T, typename R, typename Functor>
+        inline bool run_waterfall_stage( waterfall_base &block, size_t i, ready_result<T> &src, Functor &&f, ready_result<R> &dst ) THENABLE_NOEXCEPT {
+            ThenableFuture<R> next = ready_dispatcher<T>::template dispatch<R>( src, std::forward<Functor>( f ));
+
+            ready_result<R> &ready = state_access::ready( next );
+
+            if( !ready.empty()) {
+                dst = std::move( ready );
+
+            } else {
+                state_ptr<shared_state<R>> s = state_access::release( next );
+
+                if( !s->is_ready()) {
+                    shared_state<R> &state = *s;
+
+                    state.add_continuation( [self = block.shared_from_this(), i, &dst, s2 = std::move( s )]() THENABLE_NOEXCEPT {
+                        load_result( dst, *s2 );
+
+                        if( dst.exception ) {
+                            self->fail( std::move( dst.exception ));
+
+                        } else {
+                            self->resume( i + 1 );
+                        }
+                    } );
+
+                    return false;
+                }
+
+                load_result( dst, *s );
+            }
+
+            //A stage that failed resolves the whole waterfall right away, without going through the rest
+            if( dst.exception ) {
+                block.fail( std::move( dst.exception ));
+
+                return false;
+            }
+
+            return true;
+        }
+
+        template <typename LaunchPolicy, typename... Functors>
+        struct waterfall_block final : waterfall_base {
+            typedef std::tuple<typename std::decay<Functors>::type...>                            functor_tuple;
+            typedef typename waterfall_types<void, typename std::decay<Functors>::type...>::type result_tuple;
+            typedef typename tuple_prepend<void, result_tuple>::type                             input_tuple;
+            typedef waterfall_result<Functors...>                                                 result_type;
+
+            template <typename Tuple>
+            struct result_slots;
+
+            template <typename... Rs>
+            struct result_slots<std::tuple<Rs...>> {
+                typedef std::tuple<ready_result<Rs>...> type;
+            };
+
+            static constexpr size_t stages = sizeof...( Functors );
+
+            functor_tuple                            functors;
+            typename result_slots<input_tuple>::type results;
+            LaunchPolicy                             policy;
+            state_ptr<shared_state<result_type>>     dest;
+
+            template <typename... Fns>
+            inline explicit waterfall_block( LaunchPolicy p, Fns &&... fns ) : functors( std::forward<Fns>( fns )... ), policy( std::move( p )) {
+                //The first stage takes no arguments
+                std::get<0>( results ).set_value();
+            }
+
+            template <size_t i>
+            static inline bool stage( waterfall_block &block ) THENABLE_NOEXCEPT {
+                return run_waterfall_stage( block, i, std::get<i>( block.results ), std::move( std::get<i>( block.functors )), std::get<i + 1>( block.results ));
+            }
+
+            template <size_t... S>
+            inline void run( size_t i, std::index_sequence<S...> ) THENABLE_NOEXCEPT {
+                static constexpr bool (*table[])( waterfall_block & ) = {&stage<S>...};
+
+                for( ; i < stages; ++i ) {
+                    if( std::exception_ptr e = stage_interruption( policy )) {
+                        dest->set_exception( std::move( e ));
+
+                        return;
+                    }
+
+                    if( !table[i]( *this )) {
+                        return;
+                    }
+                }
+
+                std::get<stages>( results ).store( *dest );
+            }
+
+            void run( size_t i ) THENABLE_NOEXCEPT override {
+                run( i, std::index_sequence_for<Functors...>());
+            }
+
+            void resume( size_t i ) THENABLE_NOEXCEPT override {
+                resume_stage( policy, [self = shared_from_this(), i]() THENABLE_NOEXCEPT {
+                    self->run( i );
+                } );
+            }
+
+            void fail( std::exception_ptr e ) THENABLE_NOEXCEPT override {
+                dest->set_exception( std::move( e ));
             }
         };
-    }
 
+        template <typename LaunchPolicy, typename... Functors>
+        inline std::shared_ptr<waterfall_block<LaunchPolicy, Functors...>> make_waterfall( LaunchPolicy policy, Functors &&... fns ) {
+            static_assert( sizeof...( Functors ) > 0, "waterfall needs at least one functor" );
+
+            return std::make_shared<waterfall_block<LaunchPolicy, Functors...>>( std::move( policy ), std::forward<Functors>( fns )... );
+        }
+    }
 
     /*
-     * Actual waterfall implementations that just forward the policy and functors through the forward_waterfall
-     * which reverses them and calls reverse_waterfall
+     * waterfall runs each functor with the result of the one before it, and resolves with the result of the last one.
+     *
+     * With a std::launch policy the whole waterfall runs as a single std::async task, and with then_launch::detached, executors
+     * and wrapped policies it's launched straight into a ThenableFuture. Either way the stages run back-to-back in a loop,
+     * and any futures returned by them are waited on with a continuation rather than a thread per stage.
      * */
 
     template <typename... Functors>
-    inline THENABLE_DECLTYPE_AUTO_HINTED( std::future ) waterfall( std::launch policy, Functors &&... fns ) {
-        return detail::forward_waterfall<Functors..., std::launch>::apply( std::forward<Functors>( fns )..., std::forward<std::launch>( policy ));
+    std::future<detail::waterfall_result<Functors...>> waterfall( std::launch policy, Functors &&... fns ) {
+        typedef detail::waterfall_result<Functors...> R;
+
+        auto block = detail::make_waterfall( policy, std::forward<Functors>( fns )... );
+
+        return std::async( policy, [block = std::move( block )]() -> R {
+            block->dest = detail::make_state<R>();
+
+            block->run( 0 );
+
+            return block->dest->take();
+        } );
     }
 
-    template <typename... Functors>
-    inline THENABLE_DECLTYPE_AUTO_HINTED( std::future ) waterfall( then_launch policy, Functors &&... fns ) {
-        return detail::forward_waterfall<Functors..., then_launch>::apply( std::forward<Functors>( fns )..., std::forward<then_launch>( policy ));
+    template <typename LaunchPolicy, typename... Functors, typename = detail::enable_if_detached_t<LaunchPolicy>>
+    ThenableFuture<detail::waterfall_result<Functors...>> waterfall( LaunchPolicy policy, Functors &&... fns ) {
+        typedef detail::waterfall_result<Functors...> R;
+
+        auto block = detail::make_waterfall( policy, std::forward<Functors>( fns )... );
+
+        auto dest = detail::make_state<R>();
+
+        //Wrapped policies may hand the task a different state to fulfill, so the block only keeps whichever one it's given
+        detail::launch_into( dest, [block = std::move( block )]( const detail::state_ptr<detail::shared_state<R>> &d ) mutable THENABLE_NOEXCEPT {
+            block->dest = d;
+
+            block->run( 0 );
+        }, policy );
+
+        return detail::state_access::make<ThenableFuture<R>>( std::move( dest ));
     }
 
-    template <typename... Functors>
-    inline THENABLE_DECLTYPE_AUTO_HINTED( std::future ) waterfall( Functors &&... fns ) {
-        return waterfall( default_policy, std::forward<Functors>( fns )... );
+    template <typename Functor, typename... Functors, typename = typename std::enable_if<!detail::is_launch_policy<typename std::decay<Functor>::type>::value>::type>
+    inline std::future<detail::waterfall_result<Functor, Functors...>> waterfall( Functor &&f, Functors &&... fns ) {
+        return waterfall( default_policy, std::forward<Functor>( f ), std::forward<Functors>( fns )... );
     }
 
     template <typename... Args>
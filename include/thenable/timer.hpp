@@ -0,0 +1,428 @@
+#ifndef THENABLE_TIMER_HPP_INCLUDED
+#define THENABLE_TIMER_HPP_INCLUDED
+
+#include <thenable/function.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+/*
+ * Timers
+ *
+ * A timer_wheel runs callbacks at given deadlines from a single background thread, so timeouts don't need a thread blocked in wait_for each.
+ *
+ * Deadlines are rounded up to ticks of a fixed resolution and hashed into a ring of slots, each holding an intrusive list of timers.
+ * Adding or cancelling a timer is just linking or unlinking it from its slot, no matter how many others are pending,
+ * and for each tick the thread only looks at the one slot for that tick. Timers more than one full turn of the ring away
+ * simply stay in their slot until the ring comes around to them again.
+ *
+ * The thread doesn't wake up on every tick, only on the next one something is actually due on, so a far-off timer costs nothing until then.
+ *
+ * Callbacks are run on the timer thread, so they should be short and must not throw.
+ * */
+
+namespace thenable {
+    /*
+     * The exception stored in futures that didn't resolve before their deadline
+     * */
+    class timeout_error : public std::runtime_error {
+        public:
+            inline timeout_error() : std::runtime_error( "operation timed out" ) {}
+    };
+
+    namespace detail {
+        inline std::exception_ptr make_timeout_exception() {
+            return std::make_exception_ptr( timeout_error());
+        }
+
+        /*
+         * While a timer is pending the wheel owns it through `self`, and any handles to it just keep the memory around.
+         * */
+        struct timer_entry {
+            timer_entry                  *prev = nullptr;
+            timer_entry                  *next = nullptr;
+            std::uint64_t                tick  = 0;
+            std::size_t                  slot  = 0;
+            unique_function<void()>      callback;
+            std::shared_ptr<timer_entry> self;
+        };
+
+        class timer_wheel_state {
+            public:
+                typedef std::chrono::steady_clock clock_type;
+
+            private:
+                std::mutex                 _mutex;
+                std::condition_variable    _cv;
+                clock_type::time_point     _epoch;
+                clock_type::duration       _resolution;
+                std::vector<timer_entry *> _slots;
+                std::size_t                _mask;
+                std::uint64_t              _current = 0;
+                std::uint64_t              _wake    = 0;
+                std::size_t                _count   = 0;
+                bool                       _stopped = false;
+                bool                       _idle    = false;
+
+                inline std::uint64_t now_tick() const {
+                    return static_cast<std::uint64_t>(( clock_type::now() - _epoch ) / _resolution );
+                }
+
+                /*
+                 * Rounds up, so a timer never fires before its deadline
+                 * */
+                inline std::uint64_t deadline_tick( clock_type::time_point deadline ) const {
+                    if( deadline <= _epoch ) {
+                        return 0;
+                    }
+
+                    return static_cast<std::uint64_t>(( deadline - _epoch + _resolution - clock_type::duration( 1 )) / _resolution );
+                }
+
+                inline void link( timer_entry *e, std::size_t slot ) noexcept {
+                    e->slot = slot;
+                    e->prev = nullptr;
+                    e->next = _slots[slot];
+
+                    if( e->next ) {
+                        e->next->prev = e;
+                    }
+
+                    _slots[slot] = e;
+
+                    ++_count;
+                }
+
+                /*
+                 * Unlinks the timer and takes its callback, returning the wheel's own reference to it
+                 * */
+                inline std::shared_ptr<timer_entry> unlink( timer_entry *e, unique_function<void()> &callback ) noexcept {
+                    if( e->prev ) {
+                        e->prev->next = e->next;
+
+                    } else {
+                        _slots[e->slot] = e->next;
+                    }
+
+                    if( e->next ) {
+                        e->next->prev = e->prev;
+                    }
+
+                    e->prev = e->next = nullptr;
+
+                    --_count;
+
+                    callback = std::move( e->callback );
+
+                    return std::move( e->self );
+                }
+
+                inline void expire_slot( std::size_t slot, std::uint64_t tick, std::vector<unique_function<void()>> &expired ) {
+                    timer_entry *e = _slots[slot];
+
+                    while( e ) {
+                        timer_entry *next = e->next;
+
+                        if( e->tick <= tick ) {
+                            expired.emplace_back();
+
+                            unlink( e, expired.back());
+                        }
+
+                        e = next;
+                    }
+                }
+
+                /*
+                 * If the thread fell more than a full turn behind, it's cheaper to sweep every slot once than to walk the ticks it missed
+                 * */
+                inline void advance( std::uint64_t target, std::vector<unique_function<void()>> &expired ) {
+                    if( target - _current > _mask ) {
+                        for( std::size_t slot = 0; slot <= _mask; ++slot ) {
+                            expire_slot( slot, target, expired );
+                        }
+
+                        _current = target;
+
+                    } else {
+                        while( _current < target ) {
+                            ++_current;
+
+                            expire_slot( _current & _mask, _current, expired );
+                        }
+                    }
+                }
+
+                /*
+                 * The first tick anything is due on. Slots are visited in tick order for one full turn,
+                 * and if nothing in them is due within it, the earliest timer is further away than that.
+                 * */
+                inline std::uint64_t next_due_tick() const noexcept {
+                    std::uint64_t earliest = std::numeric_limits<std::uint64_t>::max();
+
+                    for( std::uint64_t tick = _current + 1, end = _current + _mask + 1; tick <= end; ++tick ) {
+                        for( const timer_entry *e = _slots[tick & _mask]; e; e = e->next ) {
+                            if( e->tick <= tick ) {
+                                return tick;
+                            }
+
+                            earliest = std::min( earliest, e->tick );
+                        }
+                    }
+
+                    return earliest;
+                }
+
+            public:
+                inline timer_wheel_state( clock_type::duration resolution, std::size_t slots )
+                    : _epoch( clock_type::now()), _resolution( resolution > clock_type::duration::zero() ? resolution : clock_type::duration( 1 )) {
+                    std::size_t size = 1;
+
+                    while( size < slots ) {
+                        size <<= 1;
+                    }
+
+                    _slots.assign( size, nullptr );
+                    _mask = size - 1;
+                }
+
+                inline void insert( const std::shared_ptr<timer_entry> &e, clock_type::time_point deadline ) {
+                    std::uint64_t tick = deadline_tick( deadline );
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( _stopped ) {
+                            return;
+                        }
+
+                        //The thread doesn't tick while nothing is pending, so catch up before placing anything
+                        if( _count == 0 ) {
+                            _current = std::max( _current, now_tick());
+                        }
+
+                        e->tick = tick;
+                        e->self = e;
+
+                        link( e.get(), std::max( tick, _current + 1 ) & _mask );
+
+                        //Otherwise the thread is either awake and will see it, or already sleeping until something earlier
+                        if( !_idle && ( _wake == 0 || std::max( tick, _current + 1 ) >= _wake )) {
+                            return;
+                        }
+                    }
+
+                    _cv.notify_one();
+                }
+
+                /*
+                 * Returns false if the timer already fired or was cancelled
+                 * */
+                inline bool cancel( timer_entry *e ) {
+                    unique_function<void()>      callback;
+                    std::shared_ptr<timer_entry> self;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        if( !e->self ) {
+                            return false;
+                        }
+
+                        self = unlink( e, callback );
+                    }
+
+                    return true;
+                }
+
+                inline std::size_t size() {
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    return _count;
+                }
+
+                inline void run() {
+                    std::vector<unique_function<void()>> expired;
+
+                    std::unique_lock<std::mutex> lock( _mutex );
+
+                    while( !_stopped ) {
+                        if( _count == 0 ) {
+                            _idle = true;
+
+                            _cv.wait( lock, [this] {
+                                return _stopped || _count > 0;
+                            } );
+
+                            _idle = false;
+
+                            continue;
+                        }
+
+                        //Capped so timers with absurdly distant deadlines can't overflow the time point
+                        std::uint64_t          due  = std::min( next_due_tick(), _current + ( std::uint64_t( 1 ) << 31 ));
+                        clock_type::time_point next = _epoch + _resolution * static_cast<clock_type::rep>( due );
+
+                        if( clock_type::now() < next ) {
+                            _wake = due;
+
+                            _cv.wait_until( lock, next );
+
+                            _wake = 0;
+
+                            continue;
+                        }
+
+                        advance( now_tick(), expired );
+
+                        if( !expired.empty()) {
+                            lock.unlock();
+
+                            for( auto &callback : expired ) {
+                                callback();
+                            }
+
+                            expired.clear();
+
+                            lock.lock();
+                        }
+                    }
+                }
+
+                /*
+                 * Pending timers are dropped without running
+                 * */
+                inline void stop() {
+                    std::vector<unique_function<void()>>      dropped;
+                    std::vector<std::shared_ptr<timer_entry>> entries;
+
+                    {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        _stopped = true;
+
+                        for( timer_entry *head : _slots ) {
+                            while( head ) {
+                                timer_entry *next = head->next;
+
+                                dropped.emplace_back();
+
+                                entries.push_back( unlink( head, dropped.back()));
+
+                                head = next;
+                            }
+                        }
+                    }
+
+                    _cv.notify_all();
+                }
+        };
+    }
+
+    /*
+     * Refers to a single timer, so it can be cancelled. Destroying the handle doesn't cancel the timer.
+     * */
+    class timer_handle {
+            std::shared_ptr<detail::timer_wheel_state> _wheel;
+            std::shared_ptr<detail::timer_entry>       _entry;
+
+        public:
+            timer_handle() noexcept = default;
+
+            inline timer_handle( std::shared_ptr<detail::timer_wheel_state> wheel, std::shared_ptr<detail::timer_entry> entry ) noexcept
+                : _wheel( std::move( wheel )), _entry( std::move( entry )) {}
+
+            inline bool valid() const noexcept {
+                return static_cast<bool>(_entry);
+            }
+
+            /*
+             * Returns true if the timer was cancelled before it fired. The callback is destroyed without running.
+             * */
+            inline bool cancel() {
+                return _entry && _wheel->cancel( _entry.get());
+            }
+    };
+
+    /*
+     * timer_wheel objects are handles like thread_pool, so copies share the same thread and timers.
+     * When the last handle is destroyed, the thread is joined and any timers still pending are dropped.
+     * */
+    class timer_wheel {
+        public:
+            typedef detail::timer_wheel_state::clock_type clock_type;
+
+        private:
+            struct worker {
+                std::shared_ptr<detail::timer_wheel_state> state;
+                std::thread                                thread;
+
+                inline ~worker() {
+                    state->stop();
+
+                    if( thread.get_id() == std::this_thread::get_id()) {
+                        thread.detach();
+
+                    } else {
+                        thread.join();
+                    }
+                }
+            };
+
+            std::shared_ptr<detail::timer_wheel_state> _state;
+            std::shared_ptr<worker>                    _worker;
+
+        public:
+            inline explicit timer_wheel( clock_type::duration resolution = std::chrono::milliseconds( 1 ), std::size_t slots = 4096 )
+                : _state( std::make_shared<detail::timer_wheel_state>( resolution, slots )), _worker( std::make_shared<worker>()) {
+                _worker->state  = _state;
+                _worker->thread = std::thread( [state = _state] {
+                    state->run();
+                } );
+            }
+
+            template <typename Functor>
+            inline timer_handle schedule_at( clock_type::time_point deadline, Functor &&f ) const {
+                auto e = std::make_shared<detail::timer_entry>();
+
+                e->callback = unique_function<void()>( std::forward<Functor>( f ));
+
+                _state->insert( e, deadline );
+
+                return timer_handle( _state, std::move( e ));
+            }
+
+            template <typename Rep, typename Period, typename Functor>
+            inline timer_handle schedule_after( const std::chrono::duration<Rep, Period> &delay, Functor &&f ) const {
+                return schedule_at( clock_type::now() + std::chrono::ceil<clock_type::duration>( delay ), std::forward<Functor>( f ));
+            }
+
+            /*
+             * The number of pending timers
+             * */
+            inline std::size_t size() const {
+                return _state->size();
+            }
+    };
+
+    /*
+     * The process-wide timer_wheel used by `with_timeout`, `with_deadline` and deadline policies, with a resolution of one millisecond.
+     * */
+    inline const timer_wheel &default_timer() {
+        static timer_wheel timer;
+
+        return timer;
+    }
+}
+
+#endif //THENABLE_TIMER_HPP_INCLUDED
@@ -0,0 +1,251 @@
+#ifndef THENABLE_TRACE_HPP_INCLUDED
+#define THENABLE_TRACE_HPP_INCLUDED
+
+#include <thenable/instrumentation.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Tracing
+ *
+ * A tracer records every task the library runs, with its id, the id of the task that scheduled it, the thread it ran on
+ * and when it was scheduled, started and completed. The records can be written out as Chrome trace event JSON,
+ * which can be opened in Perfetto or chrome://tracing.
+ *
+ * Each task shows up as a slice on the thread that ran it, with a flow arrow from the slice of the task that scheduled it,
+ * so following the arrows back from the last slice to finish shows the critical path of a graph of then, parallel_n, await_all and waterfall calls.
+ *
+ * It's built on the instrumentation hooks, so nothing is recorded unless THENABLE_INSTRUMENTATION is defined.
+ *
+ * Each thread records into its own ring buffer, so recording never takes a lock except the first time a thread records anything.
+ * Once a ring buffer is full the oldest records on that thread are overwritten.
+ * Writing the trace reads every ring buffer, so it should only be done once the traced work is done.
+ * */
+
+namespace thenable {
+    namespace instrumentation {
+        class tracer {
+                struct record {
+                    std::uint64_t          id;
+                    std::uint64_t          parent;
+                    clock_type::time_point scheduled;
+                    clock_type::time_point started;
+                    clock_type::time_point completed;
+                };
+
+                struct ring {
+                    std::uint32_t            tid;
+                    std::vector<record>      records;
+                    std::atomic<std::size_t> head{0};
+                };
+
+                struct thread_cache {
+                    std::uint64_t serial = 0;
+                    ring          *r     = nullptr;
+                };
+
+                std::size_t                                    _capacity;
+                std::uint64_t                                  _serial;
+                clock_type::time_point                         _epoch;
+                hooks                                          _hooks;
+                mutable std::mutex                             _mutex;
+                std::vector<std::unique_ptr<ring>>             _rings;
+                std::unordered_map<std::thread::id, ring *>    _by_thread;
+
+                static inline std::uint64_t next_serial() noexcept {
+                    static std::atomic<std::uint64_t> next{0};
+
+                    return next.fetch_add( 1, std::memory_order_relaxed ) + 1;
+                }
+
+                /*
+                 * Each thread remembers the ring of the last tracer it recorded into, and only has to look it up again if that changes
+                 * */
+                inline ring &local() {
+                    thread_local thread_cache cache;
+
+                    if( cache.serial != _serial ) {
+                        std::lock_guard<std::mutex> lock( _mutex );
+
+                        ring *&r = _by_thread[std::this_thread::get_id()];
+
+                        if( !r ) {
+                            _rings.emplace_back( new ring );
+
+                            r = _rings.back().get();
+
+                            r->tid = static_cast<std::uint32_t>(_rings.size());
+                            r->records.resize( _capacity );
+                        }
+
+                        cache.serial = _serial;
+                        cache.r      = r;
+                    }
+
+                    return *cache.r;
+                }
+
+                static inline void on_complete( void *context, const task_event &e ) noexcept {
+                    ring &r = static_cast<tracer *>(context)->local();
+
+                    std::size_t head = r.head.load( std::memory_order_relaxed );
+
+                    r.records[head % r.records.size()] = record{e.id, e.parent, e.scheduled, e.started, e.completed};
+
+                    r.head.store( head + 1, std::memory_order_release );
+                }
+
+                inline double micros( clock_type::time_point t ) const {
+                    return std::chrono::duration<double, std::micro>( t - _epoch ).count();
+                }
+
+            public:
+                /*
+                 * Keeps up to events_per_thread of the most recent tasks run on each thread
+                 * */
+                inline explicit tracer( std::size_t events_per_thread = 1 << 16 )
+                    : _capacity( events_per_thread > 0 ? events_per_thread : 1 ), _serial( next_serial()), _epoch( clock_type::now()) {
+                    _hooks.context     = this;
+                    _hooks.on_complete = &tracer::on_complete;
+                }
+
+                tracer( const tracer & ) = delete;
+
+                tracer &operator=( const tracer & ) = delete;
+
+                inline const hooks &get_hooks() const noexcept {
+                    return _hooks;
+                }
+
+                inline void install() const noexcept {
+                    instrumentation::install( &_hooks );
+                }
+
+                /*
+                 * The number of records currently held, across all threads
+                 * */
+                inline std::size_t size() const {
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    std::size_t total = 0;
+
+                    for( const auto &r : _rings ) {
+                        total += std::min( r->head.load( std::memory_order_acquire ), _capacity );
+                    }
+
+                    return total;
+                }
+
+                inline void clear() {
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    for( const auto &r : _rings ) {
+                        r->head.store( 0, std::memory_order_release );
+                    }
+                }
+
+                inline void write_json( std::ostream &out ) const {
+                    std::lock_guard<std::mutex> lock( _mutex );
+
+                    //Which thread each recorded task ran on, for drawing the flow arrows from it
+                    std::unordered_map<std::uint64_t, std::uint32_t> ran_on;
+
+                    for( const auto &r : _rings ) {
+                        std::size_t head  = r->head.load( std::memory_order_acquire );
+                        std::size_t first = head > _capacity ? head - _capacity : 0;
+
+                        for( std::size_t i = first; i < head; ++i ) {
+                            ran_on[r->records[i % _capacity].id] = r->tid;
+                        }
+                    }
+
+                    bool first_event = true;
+
+                    auto begin_event = [&out, &first_event] {
+                        out << ( first_event ? "\n" : ",\n" );
+
+                        first_event = false;
+                    };
+
+                    std::ios_base::fmtflags flags     = out.flags();
+                    std::streamsize         precision = out.precision();
+
+                    //Timestamps are in microseconds, so three decimals keeps them to the nanosecond
+                    out << std::fixed;
+                    out.precision( 3 );
+
+                    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+                    for( const auto &r : _rings ) {
+                        begin_event();
+
+                        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->tid
+                            << ",\"args\":{\"name\":\"thread " << r->tid << "\"}}";
+
+                        std::size_t head  = r->head.load( std::memory_order_acquire );
+                        std::size_t first = head > _capacity ? head - _capacity : 0;
+
+                        for( std::size_t i = first; i < head; ++i ) {
+                            const record &e = r->records[i % _capacity];
+
+                            begin_event();
+
+                            out << "{\"name\":\"task " << e.id << "\",\"cat\":\"thenable\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid
+                                << ",\"ts\":" << micros( e.started ) << ",\"dur\":" << micros( e.completed ) - micros( e.started )
+                                << ",\"args\":{\"id\":" << e.id << ",\"parent\":" << e.parent
+                                << ",\"queue_delay_us\":" << micros( e.started ) - micros( e.scheduled ) << "}}";
+
+                            auto parent = ran_on.find( e.parent );
+
+                            if( e.parent != 0 && parent != ran_on.end()) {
+                                //The task was scheduled while its parent was running, so the arrow starts inside the parent's slice
+                                begin_event();
+
+                                out << "{\"name\":\"scheduled\",\"cat\":\"thenable\",\"ph\":\"s\",\"id\":" << e.id << ",\"pid\":1,\"tid\":" << parent->second
+                                    << ",\"ts\":" << micros( e.scheduled ) << "}";
+
+                                begin_event();
+
+                                out << "{\"name\":\"scheduled\",\"cat\":\"thenable\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << e.id << ",\"pid\":1,\"tid\":" << r->tid
+                                    << ",\"ts\":" << micros( e.started ) << "}";
+                            }
+                        }
+                    }
+
+                    out << "\n]}\n";
+
+                    out.flags( flags );
+                    out.precision( precision );
+                }
+
+                /*
+                 * Returns false if the file couldn't be written
+                 * */
+                inline bool write_json( const std::string &path ) const {
+                    std::ofstream out( path );
+
+                    if( !out ) {
+                        return false;
+                    }
+
+                    write_json( out );
+
+                    return static_cast<bool>(out);
+                }
+        };
+    }
+}
+
+#endif //THENABLE_TRACE_HPP_INCLUDED
@@ -0,0 +1,143 @@
+#include <thenable/thenable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <vector>
+
+/*
+ * Pushes a type that counts its copies, and a move-only std::unique_ptr, through make_promise, make_promise2, then and recursive_get
+ * under every kind of launch policy, and fails if the value was ever copied along the way.
+ * */
+
+using namespace thenable;
+
+namespace {
+    std::atomic_size_t copies{0};
+    std::size_t        failures = 0;
+
+    struct counted {
+        std::vector<char> data;
+
+        counted() = default;
+
+        explicit counted( std::size_t n ) : data( n ) {}
+
+        counted( const counted &other ) : data( other.data ) {
+            ++copies;
+        }
+
+        counted( counted && ) = default;
+
+        counted &operator=( const counted &other ) {
+            data = other.data;
+
+            ++copies;
+
+            return *this;
+        }
+
+        counted &operator=( counted && ) = default;
+    };
+
+    const std::size_t payload = 1 << 16;
+
+    struct pass_counted {
+        counted operator()( counted c ) const {
+            return c;
+        }
+    };
+
+    struct nest_counted {
+        ThenableFuture<counted> operator()( counted c ) const {
+            return make_ready_future( std::move( c ));
+        }
+    };
+
+    struct pass_pointer {
+        std::unique_ptr<int> operator()( std::unique_ptr<int> p ) const {
+            return p;
+        }
+    };
+
+    void check( bool ok, const char *what, const char *policy ) {
+        if( !ok ) {
+            std::fprintf( stderr, "FAILED: %s (%s)\n", what, policy );
+
+            ++failures;
+        }
+    }
+
+    template <typename LaunchPolicy>
+    void run( const char *name, LaunchPolicy policy ) {
+        std::size_t before = copies.load();
+
+        std::future<counted> a = make_promise<counted>( []( auto resolve, auto ) {
+            resolve( counted( payload ));
+        }, policy );
+
+        check( a.get().data.size() == payload, "make_promise value", name );
+
+        ThenableFuture<counted> b = make_promise2<counted>( []( auto resolve, auto ) {
+            counted c( payload );
+
+            resolve( std::move( c ));
+        }, policy );
+
+        check( b.then( pass_counted(), policy ).then( nest_counted(), policy ).get().data.size() == payload, "make_promise2 and then", name );
+
+        ThenableFuture<std::unique_ptr<int>> c = make_promise2<std::unique_ptr<int>>( []( auto resolve, auto ) {
+            resolve( std::make_unique<int>( 7 ));
+        }, policy );
+
+        std::unique_ptr<int> p = c.then( pass_pointer(), policy ).get();
+
+        check( p && *p == 7, "unique_ptr through then", name );
+
+        std::future<std::unique_ptr<int>> d = make_promise<std::unique_ptr<int>>( []( auto resolve, auto ) {
+            resolve( std::make_unique<int>( 8 ));
+        }, policy );
+
+        p = detail::recursive_get( std::move( d ));
+
+        check( p && *p == 8, "unique_ptr through recursive_get", name );
+
+        std::future<counted> e = make_promise<counted>( []( auto resolve, auto ) {
+            resolve( counted( payload ));
+        }, policy );
+
+        check( detail::recursive_get( std::move( e )).data.size() == payload, "recursive_get of a std::future", name );
+
+        ThenableFuture<counted> f = make_promise2<counted>( []( auto resolve, auto ) {
+            resolve( counted( payload ));
+        }, policy ).then( nest_counted(), policy );
+
+        check( detail::recursive_get( std::move( f )).data.size() == payload, "recursive_get of a ThenableFuture", name );
+
+        check( copies.load() == before, "no copies", name );
+    }
+}
+
+int main() {
+    cancellation_source source;
+
+    run( "default", default_policy );
+    run( "async", std::launch::async );
+    run( "deferred", std::launch::deferred );
+    run( "detached", then_launch::detached );
+    run( "inline_if_ready", then_launch::inline_if_ready );
+    run( "default_executor", default_executor());
+    run( "inline_executor", inline_executor());
+    run( "cancellable", with_cancellation( source.token()));
+    run( "deadline", with_timeout( std::chrono::seconds( 30 )));
+
+    if( failures != 0 ) {
+        std::fprintf( stderr, "%zu checks failed, %zu copies\n", failures, copies.load());
+
+        return 1;
+    }
+
+    return 0;
+}